@@ -0,0 +1,261 @@
+#ifndef __BACKEND__
+#define __BACKEND__
+
+//
+//      Target access interface.
+//      The debugger only talks to the target through a target_backend_t:
+//      the Target Manager of a devkit (tmapi_backend.cpp) or the in-process
+//      simulator (sim_backend.cpp).
+//
+
+#include <vector>
+#include <string>
+#include <pro.h>
+
+// Register numbers, in the order of the debugger register table
+enum
+{
+	TREG_GPR0   = 0,
+	TREG_PC     = 32,
+	TREG_CR,
+	TREG_LR,
+	TREG_CTR,
+	TREG_FPR0,
+	TREG_VR0    = TREG_FPR0 + 32,
+	TREG_VSCR   = TREG_VR0 + 32,
+	TREG_VRSAVE,
+	TREG_COUNT
+};
+
+// Registers are transferred in slots of this size, in target byte order
+#define TREG_SLOT_SIZE 16
+
+// SPU register numbers, in TREG_SLOT_SIZE slots as well
+enum
+{
+	SREG_GPR0   = 0,
+	SREG_NPC    = 128,
+	SREG_FPSCR,
+	SREG_STATUS,
+	SREG_COUNT
+};
+
+// Size of the local store of an SPU
+#define SPU_LS_SIZE 0x40000
+
+//-------------------------------------------------------------------------
+static inline uint32 bswap32(uint32 x)
+{
+	return ( (x << 24) & 0xff000000 ) |
+           ( (x <<  8) & 0x00ff0000 ) |
+           ( (x >>  8) & 0x0000ff00 ) |
+           ( (x >> 24) & 0x000000ff );
+}
+
+static inline uint64 bswap64(uint64 x)
+{
+	return ( (x << 56) & 0xff00000000000000ULL ) |
+           ( (x << 40) & 0x00ff000000000000ULL ) |
+           ( (x << 24) & 0x0000ff0000000000ULL ) |
+           ( (x <<  8) & 0x000000ff00000000ULL ) |
+           ( (x >>  8) & 0x00000000ff000000ULL ) |
+           ( (x >> 24) & 0x0000000000ff0000ULL ) |
+           ( (x >> 40) & 0x000000000000ff00ULL ) |
+           ( (x >> 56) & 0x00000000000000ffULL );
+}
+
+// Thread states
+enum
+{
+	TSTATE_IDLE,
+	TSTATE_RUNNABLE,
+	TSTATE_ONPROC,
+	TSTATE_SLEEP,
+	TSTATE_SUSPENDED,
+	TSTATE_SLEEP_SUSPENDED,
+	TSTATE_STOP,
+	TSTATE_ZOMBIE,
+	TSTATE_DELETED
+};
+
+// SPU thread group states
+enum
+{
+	SGSTATE_NOT_CONFIGURED,
+	SGSTATE_CONFIGURED,
+	SGSTATE_READY,
+	SGSTATE_WAITING,
+	SGSTATE_SUSPENDED,
+	SGSTATE_WAITING_SUSPENDED,
+	SGSTATE_RUNNING,
+	SGSTATE_STOPPED
+};
+
+// Asynchronous target events
+enum
+{
+	TEV_NONE,
+	TEV_PROCESS_CREATE,
+	TEV_PROCESS_EXIT,               // arg: exit code
+	TEV_TRAP,
+	TEV_PRIV_INSTR,
+	TEV_ALIGNMENT,
+	TEV_ILLEGAL_INSTR,
+	TEV_TEXT_HTAB_MISS,
+	TEV_TEXT_SLB_MISS,
+	TEV_DATA_HTAB_MISS,
+	TEV_FLOAT,
+	TEV_DATA_SLB_MISS,
+	TEV_DABR_MATCH,
+	TEV_STOP,                       // thread stopped on request
+	TEV_STOP_INIT,                  // primary thread stopped at the entry point
+	TEV_DATA_MAT,
+	TEV_THREAD_CREATE,
+	TEV_THREAD_EXIT,
+	TEV_MODULE_LOAD,                // arg: module id
+	TEV_MODULE_UNLOAD,              // arg: module id
+	TEV_STEP,                       // thread stopped after step_thread
+	TEV_SPU_THREAD_START,           // tid: SPU thread, arg: group id
+	TEV_SPU_THREAD_STOP,            // tid: SPU thread, pc: NPC, arg: SPU status
+	TEV_SPU_GROUP_DESTROY,          // arg: group id
+};
+
+// error() of the requests a target can't serve at all
+#define TARGET_E_UNSUPPORTED 0x7fff0001
+
+struct target_event_t
+{
+	uint32 type;                    // TEV_...
+	uint64 tid;
+	uint64 pc;                      // 0 if the event carries none
+	uint64 arg;
+	uint64 timebase;                // target timebase, 0 if the event carries none
+
+	target_event_t() : type(TEV_NONE), tid(0), pc(0), arg(0), timebase(0) {}
+};
+
+struct target_process_t
+{
+	uint32 pid;
+	std::string path;
+};
+
+struct target_thread_t
+{
+	uint64 tid;
+	uint32 state;                   // TSTATE_...
+	uint32 priority;
+	uint64 stack_addr;
+	uint64 stack_size;
+	std::string name;
+};
+
+struct target_segment_t
+{
+	uint64 base;
+	uint64 file_size;
+	uint64 mem_size;
+	uint32 elf_type;
+};
+
+struct target_memory_area_t
+{
+	uint64 base;
+	uint64 size;
+};
+
+struct target_spu_group_t
+{
+	uint32 id;
+	uint32 state;                   // SGSTATE_...
+	uint32 priority;
+	std::string name;
+	std::vector<uint32> threads;    // SPU thread ids, in the order of the group
+};
+
+struct target_module_t
+{
+	uint32 id;
+	std::string name;               // "elf name - module name"
+	std::vector<target_segment_t> segments;
+};
+
+// Called by poll() for every event received from the target
+typedef void target_event_handler_t(const target_event_t &ev, void *ud);
+
+// Every request returns false on failure, error() then holds the backend
+// specific error code. The backends are not reentrant: the callers issue
+// the requests, poll() included, one at a time (debug.cpp holds
+// dispatch_lock), and read error() before the next request.
+class target_backend_t
+{
+public:
+	virtual ~target_backend_t() {}
+
+	virtual const char *name(void) const = 0;
+	virtual int error(void) const = 0;
+
+	// Connection
+	virtual bool open(void) = 0;
+	virtual void close(void) = 0;
+
+	// Events are only delivered from poll(), on the calling thread.
+	// poll() returns once no event is pending.
+	virtual void set_event_handler(target_event_handler_t *handler, void *ud) = 0;
+	virtual void poll(void) = 0;
+
+	// Processes
+	virtual bool get_processes(std::vector<target_process_t> *list) = 0;
+	virtual bool load_process(const char *path, uint32 *pid) = 0;
+	virtual bool attach(uint32 pid) = 0;
+	virtual bool stop(void) = 0;
+	virtual bool resume(void) = 0;
+
+	// Threads
+	virtual bool get_threads(std::vector<uint64> *tids) = 0;
+	virtual bool get_thread_info(uint64 tid, target_thread_t *info) = 0;
+	virtual bool stop_thread(uint64 tid) = 0;
+	virtual bool resume_thread(uint64 tid) = 0;
+
+	// Execute one instruction of thread 'tid' alone, the other threads stay
+	// stopped. TEV_STEP follows unless the instruction raised another event.
+	virtual bool step_thread(uint64 tid) = 0;
+
+	// Registers 'regs[0..count-1]' (TREG_...) in consecutive slots
+	virtual bool get_registers(uint64 tid, uint32 count, const uint32 *regs, uint8 *slots) = 0;
+	virtual bool set_registers(uint64 tid, uint32 count, const uint32 *regs, const uint8 *slots) = 0;
+
+	// SPU thread groups of the process
+	virtual bool get_spu_groups(std::vector<uint32> *ids) = 0;
+	virtual bool get_spu_group_info(uint32 id, target_spu_group_t *info) = 0;
+
+	// Registers 'regs[0..count-1]' (SREG_...) of SPU thread 'tid' in consecutive slots
+	virtual bool get_spu_registers(uint32 tid, uint32 count, const uint32 *regs, uint8 *slots) = 0;
+
+	// Memory
+	virtual bool read_memory(ea_t ea, void *buffer, uint32 size) = 0;
+	virtual bool write_memory(ea_t ea, const void *buffer, uint32 size) = 0;
+
+	// Virtual memory areas of the process, sorted by address
+	virtual bool get_memory_areas(std::vector<target_memory_area_t> *areas) = 0;
+
+	// Local store of SPU thread 'tid', 'addr' is an LS address
+	virtual bool read_spu_ls(uint32 tid, uint32 addr, void *buffer, uint32 size) = 0;
+
+	// Software breakpoints of thread 'tid', or of all threads if tid is -1
+	virtual bool set_breakpoint(uint64 tid, ea_t ea) = 0;
+	virtual bool clear_breakpoint(uint64 tid, ea_t ea) = 0;
+	virtual bool get_breakpoints(uint64 tid, std::vector<uint64> *list) = 0;
+
+	// Data address breakpoint register, address | flags
+	virtual bool set_dabr(uint64 value) = 0;
+
+	// Modules
+	virtual bool get_modules(std::vector<uint32> *ids) = 0;
+	virtual bool get_module_info(uint32 id, target_module_t *info) = 0;
+};
+
+// The Target Manager backend, see tmapi_backend.cpp
+target_backend_t *create_tmapi_backend(void);
+
+#endif
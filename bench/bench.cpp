@@ -0,0 +1,884 @@
+// Copyright (C) 2014 oct0xor
+//
+// This program is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License 2.0 for more details.
+//
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http ://www.gnu.org/licenses/
+
+//
+//      Micro-benchmarks of the target independent code, run against the
+//      simulated target. Each operation is timed in batches, the median and
+//      90th percentile of the time per operation are reported.
+//
+//      deci3bench [-s scale] [-f filter] [-o results] [-c baseline [-t percent]]
+//
+//        -s  multiply the number of batches timed
+//        -f  only run the benchmarks whose name contains 'filter'
+//        -o  save the results, in the format read by -c
+//        -c  compare with saved results, exit with 1 if any median is more
+//            than 'percent' (default 25) slower
+//
+//      The behaviour of the code timed is checked first: the branch decoder,
+//      the breakpoint shadow and the write back of the words patched under
+//      breakpoints, the write combiner and the event ring. A failed check is
+//      printed and makes the run exit with 3, nothing is timed.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <kernwin.hpp>
+#include "sim_backend.h"
+#include "replay.h"
+#include "memcache.h"
+#include "bpts.h"
+#include "regcache.h"
+#include "evqueue.h"
+#include "coalesce.h"
+#include "ppcstep.h"
+#include "evtrace.h"
+#include "btrace.h"
+#include "memmap.h"
+#include "threads.h"
+#include "spu.h"
+
+#define BENCH_ROUNDS 25
+#define BENCH_DATA   0x100000           // simulated data area
+#define BENCH_DATA_SIZE 0x200000
+#define BENCH_TID    0x100              // thread of the demo process
+
+static const uchar bpt_code[BPT_SIZE] = { 0x7f, 0xe0, 0x00, 0x08 };
+
+static volatile uint32 sink;
+
+static sim_backend_t *sim;
+static mem_cache_t memcache;
+static bpt_shadow_t bpt_shadow;
+static bpt_table_t bpt_table;
+static reg_cache_t regcache;
+static uint32 reg_ids[TREG_COUNT];
+static int reg_classes[TREG_COUNT];
+static event_ring_t<1024> event_ring;
+static eventlist_t eventlist;
+static event_coalescer_t coalescer;
+static insn_cache_t insn_cache;
+static replay_backend_t *replay;
+static btrace_writer_t btrace;
+static memory_map_t memory_map;
+static thread_table_t thread_table;
+static spu_table_t spu_table;
+
+static std::vector<uint8> buf(0x100000);
+static std::vector<uint8> shadow_page(0x1000);
+static std::vector<ea_t> bpt_eas;
+static std::vector<uint32> insns;
+
+//--------------------------------------------------------------------------
+static bool fetch_sim_memory(ea_t ea, void *buffer, uint32 size, void *ud)
+{
+	return ((target_backend_t *)ud)->read_memory(ea, buffer, size);
+}
+
+static bool fetch_sim_registers(uint64 tid, uint32 count, const uint32 *ids, uint8 *slots, void *)
+{
+	return sim->get_registers(tid, count, ids, slots);
+}
+
+static void noop_post(const debug_event_t &)
+{
+}
+
+//--------------------------------------------------------------------------
+static void bench_sim_read4(uint32 n)
+{
+	uint32 w;
+
+	for (uint32 i = 0; i < n; i++)
+		sim->read_memory(0x10200, &w, 4);
+}
+
+static void bench_sim_read64k(uint32 n)
+{
+	for (uint32 i = 0; i < n; i++)
+		sim->read_memory(BENCH_DATA, &buf[0], 0x10000);
+}
+
+static void bench_memcache_hit(uint32 n)
+{
+	for (uint32 i = 0; i < n; i++)
+		memcache.read(BENCH_DATA + 0x10, &buf[0], 16, fetch_sim_memory, sim);
+}
+
+static void bench_memcache_miss(uint32 n)
+{
+	for (uint32 i = 0; i < n; i++)
+	{
+		memcache.flush();
+		memcache.read(BENCH_DATA + 0x10, &buf[0], 16, fetch_sim_memory, sim);
+	}
+}
+
+static void bench_chunked_read(uint32 n)
+{
+	for (uint32 i = 0; i < n; i++)
+		chunked_read(BENCH_DATA, &buf[0], 0x100000, fetch_sim_memory, sim, 0x10000);
+}
+
+static void bench_shadow_patch(uint32 n)
+{
+	for (uint32 i = 0; i < n; i++)
+	{
+		memcpy(&buf[0], &shadow_page[0], shadow_page.size());
+		bpt_shadow.patch(BENCH_DATA, &buf[0], shadow_page.size(), bpt_code);
+	}
+}
+
+static void bench_coalesce_reads(uint32 n)
+{
+	std::vector<bpt_range_t> ranges;
+
+	for (uint32 i = 0; i < n; i++)
+	{
+		ranges.clear();
+		coalesce_bpt_reads(bpt_eas, BPT_READ_GAP, MEMCACHE_MAX_READ, &ranges);
+	}
+
+	sink = uint32(ranges.size());
+}
+
+static void bench_bpt_table(uint32 n)
+{
+	for (uint32 i = 0; i < n; i++)
+	{
+		bpt_table.add(BENCH_DATA + 2);
+		bpt_table.remove(BENCH_DATA + 2);
+	}
+}
+
+static void bench_regcache_miss(uint32 n)
+{
+	for (uint32 i = 0; i < n; i++)
+	{
+		regcache.invalidate(BENCH_TID);
+		regcache.fetch(BENCH_TID, 7, fetch_sim_registers, NULL);
+	}
+}
+
+static void bench_regcache_hit(uint32 n)
+{
+	for (uint32 i = 0; i < n; i++)
+		regcache.fetch(BENCH_TID, 7, fetch_sim_registers, NULL);
+}
+
+static void bench_bswap128(uint32 n)
+{
+	for (uint32 i = 0; i < n; i++)
+		bswap128(&buf[0], &buf[0], 32);
+}
+
+static void bench_event_ring(uint32 n)
+{
+	debug_event_t ev;
+
+	memset(&ev, 0, sizeof(ev));
+
+	for (uint32 i = 0; i < n; i++)
+	{
+		event_ring.push(ev);
+		event_ring.pop(&ev);
+	}
+}
+
+static void bench_eventlist(uint32 n)
+{
+	debug_event_t ev;
+
+	memset(&ev, 0, sizeof(ev));
+
+	for (uint32 i = 0; i < n; i++)
+	{
+		eventlist.enqueue(ev, IN_BACK);
+		eventlist.retrieve(&ev);
+	}
+}
+
+static void bench_coalescer(uint32 n)
+{
+	debug_event_t ev;
+
+	memset(&ev, 0, sizeof(ev));
+
+	for (uint32 i = 0; i < n; i++)
+	{
+		ev.tid = i;
+		ev.eid = THREAD_START;
+		coalescer.add(ev);
+		ev.eid = THREAD_EXIT;
+		coalescer.add(ev);
+	}
+
+	coalescer.flush(noop_post);
+}
+
+static void bench_decode_step(uint32 n)
+{
+	ppc_step_t step;
+	uint32 flags = 0;
+
+	for (uint32 i = 0; i < n; i++)
+	{
+		ppc_decode_step(insns[i & (insns.size() - 1)], 0x10000 + i * 4, &step);
+		flags += step.flags;
+	}
+
+	sink = flags;
+}
+
+static void bench_insn_cache(uint32 n)
+{
+	uint32 flags = 0;
+
+	for (uint32 i = 0; i < n; i++)
+		flags += insn_cache.find(0x10000 + (i & 0xFF) * 4)->step.flags;
+
+	sink = flags;
+}
+
+static const cached_insn_t *fetch_cached_insn(ea_t ea, void *)
+{
+	return insn_cache.find(ea);
+}
+
+static void bench_range_exits(uint32 n)
+{
+	ppc_range_t range;
+	uint32 count = 0;
+
+	for (uint32 i = 0; i < n; i++)
+	{
+		ppc_range_exits(0x10000, 0x10100, false, fetch_cached_insn, NULL, &range);
+		count += (uint32)(range.exits.size() + range.stops.size());
+	}
+
+	sink = count;
+}
+
+static void bench_btrace_step(uint32 n)
+{
+	// a 3 instruction loop with a call every 16 rounds
+	for (uint32 i = 0; i < n; i++)
+	{
+		uint64 ea = 0x10200 + (i % 3) * 4;
+		uint64 next = ea + 4;
+
+		if (i % 3 == 2)
+			next = (i % 48) == 47 ? 0x20000 : 0x10200;
+
+		btrace.step(ea, next);
+	}
+}
+
+static void bench_memory_map(uint32 n)
+{
+	std::vector<mem_area_t> areas;
+	uint64 h = 0;
+
+	for (uint32 i = 0; i < n; i++)
+	{
+		memory_map.build(&areas);
+		h += memory_map_t::fingerprint(areas);
+	}
+
+	sink = uint32(h);
+}
+
+static void bench_thread_state(uint32 n)
+{
+	int states = 0;
+
+	for (uint32 i = 0; i < n; i++)
+		states += thread_table.state(i & 31);
+
+	sink = states;
+}
+
+// Reads going from one SPU to the other, served from the snapshots
+static void bench_spu_ls_switch(uint32 n)
+{
+	uint32 w = 0;
+
+	for (uint32 i = 0; i < n; i++)
+	{
+		spu_table.read(spu_table.base + (i & 1) * SPU_LS_STRIDE + (i & 0xff) * 16, &buf[0], 16, sim);
+		w += buf[0];
+	}
+
+	sink = w;
+}
+
+static void bench_sim_bpt(uint32 n)
+{
+	for (uint32 i = 0; i < n; i++)
+	{
+		sim->set_breakpoint(-1, BENCH_DATA + 0x800);
+		sim->clear_breakpoint(-1, BENCH_DATA + 0x800);
+	}
+}
+
+static void bench_sim_poll(uint32 n)
+{
+	sim->resume();
+
+	for (uint32 i = 0; i < n; i++)
+		sim->poll();
+
+	sim->stop();
+}
+
+static void bench_replay_read4(uint32 n)
+{
+	uint32 w;
+
+	for (uint32 i = 0; i < n; i++)
+		replay->read_memory(0x10200, &w, 4);
+}
+
+//--------------------------------------------------------------------------
+struct bench_t
+{
+	const char *name;
+	void (*run)(uint32 n);
+	uint32 batch;                       // operations timed together
+};
+
+static const bench_t benches[] =
+{
+	{ "sim.read_memory.4",        bench_sim_read4,      1000 },
+	{ "sim.read_memory.64k",      bench_sim_read64k,    10 },
+	{ "memcache.read.hit",        bench_memcache_hit,   1000 },
+	{ "memcache.read.miss",       bench_memcache_miss,  100 },
+	{ "chunked_read.1m",          bench_chunked_read,   1 },
+	{ "bpt_shadow.patch.4k",      bench_shadow_patch,   100 },
+	{ "coalesce_bpt_reads.1k",    bench_coalesce_reads, 10 },
+	{ "bpt_table.add_remove",     bench_bpt_table,      1000 },
+	{ "regcache.fetch.miss",      bench_regcache_miss,  100 },
+	{ "regcache.fetch.hit",       bench_regcache_hit,   1000 },
+	{ "bswap128.32",              bench_bswap128,       1000 },
+	{ "event_ring.push_pop",      bench_event_ring,     1000 },
+	{ "eventlist.enqueue_retrieve", bench_eventlist,    1000 },
+	{ "coalescer.start_exit",     bench_coalescer,      1000 },
+	{ "ppc_decode_step",          bench_decode_step,    10000 },
+	{ "insn_cache.find",          bench_insn_cache,     10000 },
+	{ "ppc_range_exits.64",       bench_range_exits,    100 },
+	{ "btrace_writer.step",       bench_btrace_step,    10000 },
+	{ "memory_map.build.64",      bench_memory_map,     10 },
+	{ "thread_table.state",       bench_thread_state,   10000 },
+	{ "spu_table.read.switch",    bench_spu_ls_switch,  10000 },
+	{ "sim.set_clear_breakpoint", bench_sim_bpt,        1000 },
+	{ "sim.poll",                 bench_sim_poll,       10 },
+	{ "replay.read_memory.4",     bench_replay_read4,   1000 },
+};
+
+//--------------------------------------------------------------------------
+// Behaviour checks, run before anything is timed
+static int check_failures;
+
+#define CHECK(cond) check_result((cond), #cond, __LINE__)
+
+static void check_result(bool ok, const char *expr, int line)
+{
+	if (ok)
+		return;
+
+	printf("bench.cpp(%d): check failed: %s\n", line, expr);
+	check_failures++;
+}
+
+static bool decodes_to(uint32 insn, uint32 ea, uint32 flags, uint32 target)
+{
+	ppc_step_t step;
+
+	ppc_decode_step(insn, ea, &step);
+
+	return step.flags == flags && ((flags & STEP_TARGET) == 0 || step.target == target);
+}
+
+static void check_decoder(void)
+{
+	// b, ba, bl, bla, both directions, up to the largest displacements
+	CHECK(decodes_to(0x48000100, 0x10000, STEP_TARGET, 0x10100));
+	CHECK(decodes_to(0x4BFFFFF0, 0x10000, STEP_TARGET, 0xFFF0));
+	CHECK(decodes_to(0x49FFFFFC, 0x10000, STEP_TARGET, 0x200FFFC));
+	CHECK(decodes_to(0x4A000000, 0x10000, STEP_TARGET, 0xFE010000));
+	CHECK(decodes_to(0x48000102, 0x10000, STEP_TARGET, 0x100));
+	CHECK(decodes_to(0x4BFFFFF2, 0x10000, STEP_TARGET, 0xFFFFFFF0));
+	CHECK(decodes_to(0x48000101, 0x10000, STEP_TARGET | STEP_CALL, 0x10100));
+	CHECK(decodes_to(0x4BFFFFF3, 0x10000, STEP_TARGET | STEP_CALL, 0xFFFFFFF0));
+
+	// bc, bca, bcl, bcla: conditional ones also fall through, BO 20 doesn't
+	CHECK(decodes_to(0x4180FFF8, 0x10000, STEP_TARGET | STEP_NEXT, 0xFFF8));
+	CHECK(decodes_to(0x41807FFC, 0x10000, STEP_TARGET | STEP_NEXT, 0x17FFC));
+	CHECK(decodes_to(0x41808000, 0x10000, STEP_TARGET | STEP_NEXT, 0x8000));
+	CHECK(decodes_to(0x42800010, 0x10000, STEP_TARGET, 0x10010));
+	CHECK(decodes_to(0x41820012, 0x10000, STEP_TARGET | STEP_NEXT, 0x10));
+	CHECK(decodes_to(0x4180FFF2, 0x10000, STEP_TARGET | STEP_NEXT, 0xFFFFFFF0));
+	CHECK(decodes_to(0x4180FFF9, 0x10000, STEP_TARGET | STEP_NEXT | STEP_CALL, 0xFFF8));
+	CHECK(decodes_to(0x4180FFF3, 0x10000, STEP_TARGET | STEP_NEXT | STEP_CALL, 0xFFFFFFF0));
+
+	// bclr, bclrl, bcctr, bcctrl
+	CHECK(decodes_to(0x4E800020, 0x10000, STEP_LR, 0));
+	CHECK(decodes_to(0x4D820020, 0x10000, STEP_LR | STEP_NEXT, 0));
+	CHECK(decodes_to(0x4E800021, 0x10000, STEP_LR | STEP_CALL, 0));
+	CHECK(decodes_to(0x4E800420, 0x10000, STEP_CTR, 0));
+	CHECK(decodes_to(0x4C820420, 0x10000, STEP_CTR | STEP_NEXT, 0));
+	CHECK(decodes_to(0x4E800421, 0x10000, STEP_CTR | STEP_CALL, 0));
+
+	// anything else falls through, isync included
+	CHECK(decodes_to(0x38630001, 0x10000, STEP_NEXT, 0x10004));
+	CHECK(decodes_to(0x4C00012C, 0x10000, STEP_NEXT, 0x10004));
+}
+
+static void check_bpt_shadow(void)
+{
+	static const uchar orig[BPT_SIZE] = { 0x38, 0x60, 0x00, 0x01 };
+	static const uchar code[BPT_SIZE] = { 0x60, 0x00, 0x00, 0x00 };
+	bpt_shadow_t shadow;
+	uint32 word;
+	uchar mem[12];
+
+	memcpy(&word, orig, BPT_SIZE);
+	shadow.set(0x1000, word);
+
+	// the trap is replaced, the bytes around it are left alone
+	memset(mem, 0xAA, sizeof(mem));
+	memcpy(mem + 4, bpt_code, BPT_SIZE);
+	shadow.patch(0xFFC, mem, sizeof(mem), bpt_code);
+	CHECK(memcmp(mem + 4, orig, BPT_SIZE) == 0);
+	CHECK(mem[3] == 0xAA && mem[8] == 0xAA);
+
+	// a buffer holding the end of the breakpoint only
+	memcpy(mem, bpt_code + 2, 2);
+	shadow.patch(0x1002, mem, 2, bpt_code);
+	CHECK(memcmp(mem, orig + 2, 2) == 0);
+
+	// bytes which aren't the trap any more belong to the target
+	memset(mem, 0xAA, sizeof(mem));
+	shadow.patch(0x1000, mem, BPT_SIZE, bpt_code);
+	CHECK(mem[0] == 0xAA && mem[3] == 0xAA);
+
+	// a write over the breakpoint keeps the trap and changes what it hides
+	memcpy(mem, code, BPT_SIZE);
+	shadow.absorb(0x1000, mem, BPT_SIZE, bpt_code);
+	CHECK(memcmp(mem, bpt_code, BPT_SIZE) == 0);
+	CHECK(shadow.find(0x1000, &word) && memcmp(&word, code, BPT_SIZE) == 0);
+
+	// a write straddling the start of the breakpoint
+	mem[0] = 0x11;
+	mem[1] = 0x22;
+	shadow.absorb(0xFFF, mem, 2, bpt_code);
+	CHECK(mem[0] == 0x11 && mem[1] == bpt_code[0]);
+	CHECK(shadow.find(0x1000, &word) && ((uchar *)&word)[0] == 0x22 && ((uchar *)&word)[1] == code[1]);
+}
+
+// A write over a breakpoint on the simulated target survives the removal
+// of the breakpoint, which puts back the word saved when it was set
+static void check_bpt_write_back(void)
+{
+	static const uint32 orig = 0x38600001;          // li r3, 1
+	static const uint32 code = 0x38600002;          // li r3, 2
+	sim_backend_t target;
+	bpt_shadow_t shadow;
+	uint32 word;
+	uchar mem[BPT_SIZE];
+
+	target.open();
+	target.map_memory(0x200000, 0x1000);
+	target.write_words(0x200000, &orig, 1);
+
+	// set as update_bpts does, the original word read first
+	CHECK(target.read_memory(0x200000, &word, BPT_SIZE));
+	CHECK(target.set_breakpoint(uint64(-1), 0x200000));
+	shadow.set(0x200000, word);
+	CHECK(!shadow.find_written(0x200000, &word));
+
+	// patched as write_memory does, the trap stays
+	word = bswap32(code);
+	memcpy(mem, &word, BPT_SIZE);
+	shadow.absorb(0x200000, mem, BPT_SIZE, bpt_code);
+	CHECK(target.write_memory(0x200000, mem, BPT_SIZE));
+	CHECK(target.read_memory(0x200000, mem, BPT_SIZE) && memcmp(mem, bpt_code, BPT_SIZE) == 0);
+
+	// deleted as del_soft_bpts does, the patch is written again
+	CHECK(target.clear_breakpoint(uint64(-1), 0x200000));
+	CHECK(target.read_memory(0x200000, mem, BPT_SIZE) && bswap32(*(uint32 *)mem) == orig);
+	CHECK(shadow.find_written(0x200000, &word) && target.write_memory(0x200000, &word, BPT_SIZE));
+	shadow.erase(0x200000);
+	CHECK(target.read_memory(0x200000, mem, BPT_SIZE) && bswap32(*(uint32 *)mem) == code);
+}
+
+typedef std::map<ea_t, std::vector<uint8> > stored_t;
+
+static bool store_range(ea_t ea, const void *buffer, uint32 size, void *ud)
+{
+	std::vector<uint8> &data = (*(stored_t *)ud)[ea];
+
+	data.assign((const uint8 *)buffer, (const uint8 *)buffer + size);
+	return true;
+}
+
+static void check_write_combiner(void)
+{
+	static const uint8 a[4] = { 1, 2, 3, 4 };
+	static const uint8 b[4] = { 5, 6, 7, 8 };
+	static const uint8 c[2] = { 9, 10 };
+	write_combiner_t wc;
+	stored_t stored;
+
+	// adjacent writes merge, a newer one replaces the bytes it overlaps
+	wc.add(0x100, a, 4);
+	wc.add(0x104, b, 4);
+	wc.add(0x103, c, 2);
+	CHECK(wc.size() == 8);
+
+	// a distant one stays apart
+	wc.add(0x10A, a, 1);
+	CHECK(wc.size() == 9);
+
+	CHECK(wc.flush(store_range, &stored));
+	CHECK(stored.size() == 2 && stored[0x100].size() == 8 && stored[0x10A].size() == 1);
+
+	static const uint8 merged[8] = { 1, 2, 3, 9, 10, 6, 7, 8 };
+	CHECK(memcmp(&stored[0x100][0], merged, 8) == 0);
+	CHECK(wc.empty() && wc.size() == 0);
+
+	// two ranges joined by a write filling the gap between them
+	stored.clear();
+	wc.add(0x200, a, 4);
+	wc.add(0x206, b, 4);
+	wc.add(0x203, c, 2);
+	wc.add(0x205, c, 1);
+	CHECK(wc.flush(store_range, &stored));
+	CHECK(stored.size() == 1 && stored[0x200].size() == 10);
+	CHECK(wc.transfers == 3);
+}
+
+static void check_event_ring(void)
+{
+	event_ring_t<4> ring;
+	debug_event_t ev;
+	uint32 next = 0;
+	uint32 expected = 0;
+	bool ordered = true;
+
+	memset(&ev, 0, sizeof(ev));
+
+	// several times around the ring
+	for (uint32 i = 0; i < 10; i++)
+	{
+		for (uint32 j = 0; j < 3; j++)
+		{
+			ev.tid = next++;
+			ring.push(ev);
+		}
+
+		while (ring.pop(&ev))
+			ordered &= ev.tid == thid_t(expected++);
+	}
+
+	CHECK(ordered && expected == next && ring.empty());
+
+	// a full ring spills, the events pushed later still come after
+	for (uint32 i = 0; i < 6; i++)
+	{
+		ev.tid = next++;
+		ring.push(ev);
+	}
+
+	CHECK(ring.take_overflows() == 2);
+
+	ring.pop(&ev);
+	ordered &= ev.tid == thid_t(expected++);
+
+	ev.tid = next++;
+	ring.push(ev);
+	CHECK(ring.take_overflows() == 1);
+
+	while (ring.pop(&ev))
+		ordered &= ev.tid == thid_t(expected++);
+
+	CHECK(ordered && expected == next && ring.empty());
+}
+
+static bool run_checks(void)
+{
+	check_decoder();
+	check_bpt_shadow();
+	check_bpt_write_back();
+	check_write_combiner();
+	check_event_ring();
+
+	return check_failures == 0;
+}
+
+//--------------------------------------------------------------------------
+static void setup(uint32 rounds)
+{
+	sim = new sim_backend_t;
+	sim->open();
+	sim->map_memory(BENCH_DATA, BENCH_DATA_SIZE);
+
+	uint32 pid;
+	sim->load_process("/app_home/sim.self", &pid);
+
+	// breakpoints every 64 bytes of the first page, the buffer patched
+	// holds their traps
+	for (ea_t ea = BENCH_DATA; ea < BENCH_DATA + 0x1000; ea += 0x40)
+	{
+		bpt_shadow.set(ea, 0x60000000);
+		memcpy(&shadow_page[ea - BENCH_DATA], bpt_code, BPT_SIZE);
+	}
+
+	// 1024 breakpoints in clusters
+	for (uint32 i = 0; i < 1024; i++)
+	{
+		bpt_eas.push_back(BENCH_DATA + (i / 16) * 0x1000 + (i % 16) * 0x10);
+		bpt_table.add(bpt_eas.back());
+	}
+
+	for (int i = 0; i < TREG_COUNT; i++)
+	{
+		reg_ids[i] = i;
+		reg_classes[i] = i < TREG_FPR0 ? 1 : i < TREG_VR0 ? 2 : 4;
+	}
+
+	regcache.init(reg_ids, reg_classes, TREG_COUNT);
+
+	// bc, b, bclr, bcctr and plain instructions
+	static const uint32 forms[] = { 0x4180fff8, 0x4bfffff0, 0x4e800020, 0x4e800420, 0x38630001, 0x7c0802a6, 0x80010010, 0x4c00012c };
+
+	for (uint32 i = 0; i < 256; i++)
+	{
+		insns.push_back(forms[i % qnumber(forms)]);
+		insn_cache.add(0x10000 + i * 4, bswap32(insns.back()));
+	}
+
+	memcache.read(BENCH_DATA + 0x10, &buf[0], 16, fetch_sim_memory, sim);
+
+	btrace.open("deci3bench.bt", BENCH_TID, 0x10200);
+
+	// 32 modules of 2 segments and 32 stacks inside one big area
+	for (uint32 i = 0; i < 32; i++)
+	{
+		target_module_t &mod = memory_map.modules[i];
+		target_segment_t seg = { 0x01000000 + i * 0x20000, 0x8000, 0x10000, 1 };
+
+		mod.id = i;
+		mod.name = "module";
+		mod.segments.push_back(seg);
+		seg.base += 0x10000;
+		mod.segments.push_back(seg);
+
+		target_thread_t t;
+		t.tid = i;
+		t.state = TSTATE_RUNNABLE;
+		t.priority = 0;
+		t.stack_addr = 0xD0000000 + i * 0x10000;
+		t.stack_size = 0x10000;
+		thread_table.update(t);
+	}
+
+	memory_map.threads = &thread_table;
+
+	// the SPU thread group of the demo process
+	std::vector<uint32> groups, added, removed;
+	target_spu_group_t group;
+
+	spu_table.base = SPU_LS_BASE;
+	sim->get_spu_groups(&groups);
+
+	for (size_t i = 0; i < groups.size(); i++)
+	{
+		if (sim->get_spu_group_info(groups[i], &group))
+			spu_table.update_group(group, &added, &removed);
+	}
+
+	target_memory_area_t vm = { 0, 0xFFFF0000 };
+	memory_map.vm.push_back(vm);
+
+	// a session of reads to serve from the replay log
+	const char *path = "deci3bench.rr";
+	record_backend_t *rec = new record_backend_t(new sim_backend_t, path);
+	uint32 w;
+
+	rec->open();
+	rec->load_process("/app_home/sim.self", &pid);
+
+	for (uint32 i = 0; i < rounds * 1000; i++)
+		rec->read_memory(0x10200, &w, 4);
+
+	rec->close();
+	delete rec;
+
+	replay = new replay_backend_t(path);
+	replay->open();
+	replay->load_process("/app_home/sim.self", &pid);
+}
+
+//--------------------------------------------------------------------------
+struct result_t
+{
+	double median;                      // ns per operation
+	double p90;
+};
+
+static result_t measure(const bench_t &b, uint32 rounds)
+{
+	std::vector<double> samples;
+
+	// warm up
+	b.run(b.batch);
+
+	for (uint32 r = 0; r < rounds; r++)
+	{
+		uint64 start = host_clock();
+		b.run(b.batch);
+		samples.push_back(double(host_clock() - start) / b.batch);
+	}
+
+	std::sort(samples.begin(), samples.end());
+
+	result_t res;
+	res.median = samples[samples.size() / 2];
+	res.p90 = samples[samples.size() * 9 / 10];
+	return res;
+}
+
+static bool load_results(const char *path, std::map<std::string, result_t> *results)
+{
+	FILE *fp = fopen(path, "r");
+
+	if (fp == NULL)
+		return false;
+
+	char name[128];
+	result_t res;
+
+	while (fscanf(fp, "%127s %lf %lf", name, &res.median, &res.p90) == 3)
+		(*results)[name] = res;
+
+	fclose(fp);
+	return true;
+}
+
+//--------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+	uint32 scale = 1;
+	const char *filter = NULL;
+	const char *output = NULL;
+	const char *baseline = NULL;
+	double tolerance = 25;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (i + 1 < argc && strcmp(argv[i], "-s") == 0)
+			scale = qmax(atoi(argv[++i]), 1);
+		else if (i + 1 < argc && strcmp(argv[i], "-f") == 0)
+			filter = argv[++i];
+		else if (i + 1 < argc && strcmp(argv[i], "-o") == 0)
+			output = argv[++i];
+		else if (i + 1 < argc && strcmp(argv[i], "-c") == 0)
+			baseline = argv[++i];
+		else if (i + 1 < argc && strcmp(argv[i], "-t") == 0)
+			tolerance = atof(argv[++i]);
+		else
+		{
+			printf("usage: %s [-s scale] [-f filter] [-o results] [-c baseline [-t percent]]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	if (!run_checks())
+	{
+		printf("%d check(s) failed\n", check_failures);
+		return 3;
+	}
+
+	std::map<std::string, result_t> base;
+
+	if (baseline != NULL && !load_results(baseline, &base))
+	{
+		printf("Can't read %s\n", baseline);
+		return 2;
+	}
+
+	FILE *out = NULL;
+
+	if (output != NULL && (out = fopen(output, "w")) == NULL)
+	{
+		printf("Can't create %s\n", output);
+		return 2;
+	}
+
+	uint32 rounds = BENCH_ROUNDS * scale;
+	int regressions = 0;
+
+	setup(rounds + 1);
+
+	printf("%-28s %12s %12s %10s\n", "operation", "median ns", "p90 ns", "baseline");
+
+	for (size_t i = 0; i < qnumber(benches); i++)
+	{
+		const bench_t &b = benches[i];
+
+		if (filter != NULL && strstr(b.name, filter) == NULL)
+			continue;
+
+		result_t res = measure(b, rounds);
+
+		printf("%-28s %12.1f %12.1f", b.name, res.median, res.p90);
+
+		std::map<std::string, result_t>::const_iterator it = base.find(b.name);
+
+		if (it != base.end())
+		{
+			double change = (res.median / it->second.median - 1) * 100;
+			bool slower = change > tolerance;
+
+			printf(" %+9.1f%%%s", change, slower ? "  REGRESSION" : "");
+
+			if (slower)
+				regressions++;
+		}
+
+		printf("\n");
+
+		if (out != NULL)
+			fprintf(out, "%s %.1f %.1f\n", b.name, res.median, res.p90);
+	}
+
+	if (out != NULL)
+		fclose(out);
+
+	replay->close();
+	remove("deci3bench.rr");
+
+	btrace.close();
+	remove("deci3bench.bt");
+
+	if (regressions != 0)
+		printf("%d operation(s) more than %.0f%% slower than %s\n", regressions, tolerance, baseline);
+
+	return regressions != 0 ? 1 : 0;
+}
@@ -0,0 +1,161 @@
+// Copyright (C) 2014 oct0xor
+//
+// This program is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License 2.0 for more details.
+//
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http ://www.gnu.org/licenses/
+
+#include <algorithm>
+#include "bpts.h"
+
+//--------------------------------------------------------------------------
+void coalesce_bpt_reads(const std::vector<ea_t> &eas, ea_t max_gap, size_t max_size, std::vector<bpt_range_t> *ranges)
+{
+	for (size_t i = 0; i < eas.size(); i++)
+	{
+		ea_t ea = eas[i];
+
+		if (!ranges->empty())
+		{
+			bpt_range_t &last = ranges->back();
+
+			if (ea <= last.end + max_gap && size_t(ea + BPT_SIZE - last.start) <= max_size)
+			{
+				last.end = qmax(last.end, ea + BPT_SIZE);
+				last.count++;
+				continue;
+			}
+		}
+
+		bpt_range_t r;
+		r.start = ea;
+		r.end = ea + BPT_SIZE;
+		r.first = i;
+		r.count = 1;
+		ranges->push_back(r);
+	}
+}
+
+//--------------------------------------------------------------------------
+bool bpt_shadow_t::find(ea_t ea, uint32 *orig) const
+{
+	shadow_map_t::const_iterator it = words.find(ea);
+
+	if (it == words.end())
+		return false;
+
+	*orig = it->second;
+	return true;
+}
+
+bool bpt_shadow_t::find_written(ea_t ea, uint32 *orig) const
+{
+	return written.count(ea) != 0 && find(ea, orig);
+}
+
+//--------------------------------------------------------------------------
+void bpt_shadow_t::patch(ea_t ea, void *buffer, size_t size, const uchar *bpt_code) const
+{
+	if (size == 0 || words.empty())
+		return;
+
+	ea_t end = ea + size;
+	shadow_map_t::const_iterator it = words.lower_bound(ea >= BPT_SIZE - 1 ? ea - (BPT_SIZE - 1) : 0);
+
+	for (; it != words.end() && it->first < end; ++it)
+	{
+		ea_t bpt_ea = it->first;
+		ea_t start = qmax(bpt_ea, ea);
+		ea_t stop = qmin(bpt_ea + BPT_SIZE, end);
+
+		if (start >= stop)
+			continue;
+
+		uchar *dst = (uchar *)buffer + (start - ea);
+		size_t off = size_t(start - bpt_ea);
+		size_t len = size_t(stop - start);
+
+		// only the bytes still holding our trap are ours to restore
+		if (memcmp(dst, bpt_code + off, len) != 0)
+			continue;
+
+		memcpy(dst, (const uchar *)&it->second + off, len);
+	}
+}
+
+//--------------------------------------------------------------------------
+void bpt_shadow_t::absorb(ea_t ea, void *buffer, size_t size, const uchar *bpt_code)
+{
+	if (size == 0 || words.empty())
+		return;
+
+	ea_t end = ea + size;
+	shadow_map_t::iterator it = words.lower_bound(ea >= BPT_SIZE - 1 ? ea - (BPT_SIZE - 1) : 0);
+
+	for (; it != words.end() && it->first < end; ++it)
+	{
+		ea_t bpt_ea = it->first;
+		ea_t start = qmax(bpt_ea, ea);
+		ea_t stop = qmin(bpt_ea + BPT_SIZE, end);
+
+		if (start >= stop)
+			continue;
+
+		uchar *src = (uchar *)buffer + (start - ea);
+		size_t off = size_t(start - bpt_ea);
+		size_t len = size_t(stop - start);
+
+		memcpy((uchar *)&it->second + off, src, len);
+		memcpy(src, bpt_code + off, len);
+		written.insert(bpt_ea);
+	}
+}
+
+//--------------------------------------------------------------------------
+bool bpt_table_t::add(ea_t ea)
+{
+	if (!index.insert(ea).second)
+		return false;
+
+	sorted.insert(std::lower_bound(sorted.begin(), sorted.end(), ea), ea);
+	return true;
+}
+
+bool bpt_table_t::remove(ea_t ea)
+{
+	if (index.erase(ea) == 0)
+		return false;
+
+	sorted.erase(std::lower_bound(sorted.begin(), sorted.end(), ea));
+	return true;
+}
+
+//--------------------------------------------------------------------------
+void bpt_table_t::diff(const uint64 *target, size_t count, std::vector<ea_t> *stale, std::vector<ea_t> *missing) const
+{
+	std::unordered_set<ea_t> seen;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		ea_t ea = ea_t(target[i]);
+
+		if (!seen.insert(ea).second)
+			continue;
+
+		if (!contains(ea))
+			stale->push_back(ea);
+	}
+
+	for (size_t i = 0; i < sorted.size(); i++)
+	{
+		if (seen.count(sorted[i]) == 0)
+			missing->push_back(sorted[i]);
+	}
+}
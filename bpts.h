@@ -0,0 +1,93 @@
+#ifndef __BPTS__
+#define __BPTS__
+
+//
+//      Host side breakpoint bookkeeping
+//
+
+#include <map>
+#include <vector>
+#include <unordered_set>
+#include <pro.h>
+
+#define BPT_SIZE 4
+
+// Breakpoints closer than this share a single read of their original words
+#define BPT_READ_GAP 0x200
+
+// A run of breakpoints read together: [start, end) covers the addresses
+// 'eas[first .. first+count-1]' of the list passed to coalesce_bpt_reads
+struct bpt_range_t
+{
+	ea_t start;
+	ea_t end;
+	size_t first;
+	size_t count;
+};
+
+// Group the sorted breakpoint addresses 'eas' into ranges no longer than
+// 'max_size' bytes, starting a new range when the gap exceeds 'max_gap'
+void coalesce_bpt_reads(const std::vector<ea_t> &eas, ea_t max_gap, size_t max_size, std::vector<bpt_range_t> *ranges);
+
+// Original instruction words hidden under trap instructions, sorted by
+// address so that a memory read only visits the breakpoints it overlaps.
+// Words are kept in target byte order, exactly as read from memory.
+class bpt_shadow_t
+{
+	typedef std::map<ea_t, uint32> shadow_map_t;
+	shadow_map_t words;
+	std::unordered_set<ea_t> written;   // changed by absorb() since set()
+
+public:
+	void set(ea_t ea, uint32 orig) { words[ea] = orig; written.erase(ea); }
+	void erase(ea_t ea) { words.erase(ea); written.erase(ea); }
+	void clear(void) { words.clear(); written.clear(); }
+	size_t size(void) const { return words.size(); }
+
+	// Retrieve the original word at 'ea'
+	bool find(ea_t ea, uint32 *orig) const;
+
+	// Retrieve the original word at 'ea' if a write changed it since the
+	// breakpoint was set. The target still holds the word it saved then,
+	// which it puts back when the breakpoint is cleared.
+	bool find_written(ea_t ea, uint32 *orig) const;
+
+	// Replace the trap instructions found in 'buffer', which holds target
+	// memory read from [ea, ea+size), with the original instructions.
+	// Breakpoints straddling the buffer edges are patched partially.
+	void patch(ea_t ea, void *buffer, size_t size, const uchar *bpt_code) const;
+
+	// A write of 'buffer' to [ea, ea+size) is about to reach the target:
+	// keep the bytes landing on our breakpoints as their original words and
+	// put the trap instructions back into 'buffer' so they stay armed.
+	void absorb(ea_t ea, void *buffer, size_t size, const uchar *bpt_code);
+};
+
+// Software breakpoints installed in the target, the authoritative copy.
+// Lookups go through the hash set, listings and range scans through the
+// sorted array, so the target list is only needed to reconcile.
+class bpt_table_t
+{
+	std::unordered_set<ea_t> index;
+	std::vector<ea_t> sorted;
+
+public:
+	// Returns false if 'ea' was already present
+	bool add(ea_t ea);
+
+	// Returns false if 'ea' was not present
+	bool remove(ea_t ea);
+
+	bool contains(ea_t ea) const { return index.count(ea) != 0; }
+	void clear(void) { index.clear(); sorted.clear(); }
+	size_t size(void) const { return sorted.size(); }
+
+	// All breakpoints in ascending order
+	const std::vector<ea_t> &list(void) const { return sorted; }
+
+	// Compare with the breakpoints reported by the target: 'stale' receives
+	// the ones only the target has, 'missing' the ones only we have.
+	void diff(const uint64 *target, size_t count, std::vector<ea_t> *stale, std::vector<ea_t> *missing) const;
+};
+
+#endif
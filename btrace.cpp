@@ -0,0 +1,420 @@
+// Copyright (C) 2014 oct0xor
+//
+// This program is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License 2.0 for more details.
+//
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http ://www.gnu.org/licenses/
+
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <kernwin.hpp>
+#include "btrace.h"
+
+// Buffered records are written out past this size
+#define BTRACE_FLUSH_SIZE 0x10000
+
+//--------------------------------------------------------------------------
+bool btrace_writer_t::open(const char *path, uint64 tid, uint64 start)
+{
+	close();
+
+	fp = fopen(path, "wb");
+
+	if (fp == NULL)
+		return false;
+
+	btrace_header_t hdr;
+	hdr.magic = BTRACE_MAGIC;
+	hdr.version = BTRACE_VERSION;
+	hdr.reserved = 0;
+	hdr.tid = tid;
+	hdr.start = start;
+
+	buf.data.assign((const uint8 *)&hdr, (const uint8 *)&hdr + sizeof(hdr));
+
+	target = start;
+	run = 0;
+	count = 0;
+	delta = 0;
+	repeat = 0;
+	insns = 0;
+	branches = 0;
+	size = 0;
+	write_error = false;
+
+	return true;
+}
+
+void btrace_writer_t::step(uint64 ea, uint64 next)
+{
+	insns++;
+	run++;
+
+	if (next == ea + 4)
+		return;
+
+	int64 d = int64(next - target);
+
+	branches++;
+
+	// a loop going round the same way makes a single record
+	if (repeat != 0 && run == count && d == delta)
+	{
+		repeat++;
+	}
+	else
+	{
+		if (repeat != 0)
+			put_record();
+
+		count = run;
+		delta = d;
+		repeat = 1;
+	}
+
+	target = next;
+	run = 0;
+
+	if (buf.data.size() >= BTRACE_FLUSH_SIZE)
+		flush();
+}
+
+void btrace_writer_t::put_record(void)
+{
+	buf.u(count);
+	buf.s(delta);
+	buf.u(repeat);
+}
+
+bool btrace_writer_t::flush(void)
+{
+	if (buf.data.empty())
+		return true;
+
+	if (fwrite(&buf.data[0], 1, buf.data.size(), fp) != buf.data.size())
+		write_error = true;
+
+	size += buf.data.size();
+	buf.data.clear();
+
+	return !write_error;
+}
+
+bool btrace_writer_t::close(void)
+{
+	if (fp == NULL)
+		return true;
+
+	if (repeat != 0)
+		put_record();
+
+	repeat = 0;
+
+	buf.u(0);
+	buf.u(run);
+
+	bool ok = flush();
+
+	ok = fclose(fp) == 0 && ok;
+	fp = NULL;
+
+	return ok;
+}
+
+//--------------------------------------------------------------------------
+bool btrace_reader_t::open(const char *path)
+{
+	FILE *fp = fopen(path, "rb");
+
+	if (fp == NULL)
+		return false;
+
+	fseek(fp, 0, SEEK_END);
+	long size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+
+	data.resize(size > 0 ? size_t(size) : 0);
+
+	bool ok = data.size() >= sizeof(header) && fread(&data[0], 1, data.size(), fp) == data.size();
+
+	fclose(fp);
+
+	if (!ok)
+		return false;
+
+	memcpy(&header, &data[0], sizeof(header));
+
+	if (header.magic != BTRACE_MAGIC || header.version != BTRACE_VERSION)
+		return false;
+
+	in = rr_reader_t(&data[sizeof(header)], data.size() - sizeof(header));
+	pc = header.start;
+	target = header.start;
+	left = 0;
+	count = 0;
+	delta = 0;
+	repeat = 0;
+	tail = false;
+
+	return true;
+}
+
+bool btrace_reader_t::next(uint64 *ea)
+{
+	while (left == 0)
+	{
+		if (tail)
+			return false;
+
+		if (repeat != 0)
+		{
+			repeat--;
+			left = count;
+			continue;
+		}
+
+		count = in.u();
+
+		if (!in.ok())
+			return false;
+
+		if (count == 0)
+		{
+			left = in.u();
+			tail = true;
+
+			if (!in.ok())
+				return false;
+
+			continue;
+		}
+
+		delta = in.s();
+		repeat = in.u();
+
+		if (!in.ok() || repeat == 0)
+			return false;
+
+		repeat--;
+		left = count;
+	}
+
+	*ea = pc;
+	left--;
+
+	// the last instruction of a run is the branch taken
+	if (left == 0 && !tail)
+	{
+		target += delta;
+		pc = target;
+	}
+	else
+	{
+		pc += 4;
+	}
+
+	return true;
+}
+
+//--------------------------------------------------------------------------
+branch_tracer_t::branch_tracer_t(target_backend_t *_backend, insn_fetch_t *_fetch, void *ud, const bpt_table_t *_user_bpts)
+	: backend(_backend), fetch(_fetch), fetch_ud(ud), user_bpts(_user_bpts),
+	  hw_step(true), timeout(2000), poll_interval(2), pc(0), error(0)
+{
+}
+
+void branch_tracer_t::on_event(const target_event_t &ev, void *ud)
+{
+	((branch_tracer_t *)ud)->received.push_back(ev);
+}
+
+// Poll until thread 'tid' stopped after its step, or another event came.
+// Returns 1 if the thread stepped to 'next', 0 otherwise, the other events
+// go to 'events' either way.
+int branch_tracer_t::wait(uint64 tid, uint64 *next)
+{
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+	bool stepped = false;
+	bool stopping = false;
+
+	while (!stepped && events.empty())
+	{
+		backend->poll();
+
+		for (size_t i = 0; i < received.size(); i++)
+		{
+			const target_event_t &ev = received[i];
+
+			bool ours = ev.tid == tid && (ev.type == TEV_STEP ||
+				(ev.type == TEV_TRAP && std::find(planted.begin(), planted.end(), ev.pc) != planted.end()));
+
+			if (ours && !stepped)
+			{
+				*next = ev.pc;
+				stepped = true;
+			}
+			else
+			{
+				events.push_back(ev);
+			}
+		}
+
+		if (!received.empty())
+		{
+			received.clear();
+			continue;
+		}
+
+		// the thread is blocked, the stop event ends the trace
+		if (!stopping && std::chrono::steady_clock::now() > deadline)
+		{
+			backend->stop();
+			stopping = true;
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(poll_interval));
+	}
+
+	return stepped ? 1 : 0;
+}
+
+// Run the instruction of thread 'tid' at 'ea', returns what wait returns
+// or -1 if a request failed
+int branch_tracer_t::step(uint64 tid, uint64 ea, uint64 *next)
+{
+	if (hw_step)
+	{
+		if (backend->step_thread(tid))
+			return wait(tid, next);
+
+		if (backend->error() != TARGET_E_UNSUPPORTED)
+			return fail();
+
+		hw_step = false;
+	}
+
+	const cached_insn_t *insn = fetch(ea_t(ea), fetch_ud);
+
+	if (insn == NULL)
+		return fail();
+
+	const ppc_step_t &step = insn->step;
+	uint64 dest[4];
+	int n = 0;
+
+	if (step.flags & STEP_NEXT)
+		dest[n++] = ea + 4;
+
+	if (step.flags & STEP_TARGET)
+		dest[n++] = step.target;
+
+	if (step.flags & (STEP_LR | STEP_CTR))
+	{
+		static const uint32 ids[] = { TREG_LR, TREG_CTR };
+		uint8 slots[qnumber(ids) * TREG_SLOT_SIZE];
+		uint64 lr, ctr;
+
+		if (!backend->get_registers(tid, qnumber(ids), ids, slots))
+			return fail();
+
+		memcpy(&lr, slots, sizeof(lr));
+		memcpy(&ctr, slots + TREG_SLOT_SIZE, sizeof(ctr));
+
+		if (step.flags & STEP_LR)
+			dest[n++] = uint32(bswap64(lr));
+
+		if (step.flags & STEP_CTR)
+			dest[n++] = uint32(bswap64(ctr));
+	}
+
+	bool ok = true;
+
+	planted.clear();
+
+	for (int i = 0; i < n && ok; i++)
+	{
+		if (user_bpts->contains(ea_t(dest[i])) || std::find(planted.begin(), planted.end(), dest[i]) != planted.end())
+			continue;
+
+		ok = backend->set_breakpoint(tid, ea_t(dest[i]));
+
+		if (ok)
+			planted.push_back(dest[i]);
+	}
+
+	int result = -1;
+
+	if (ok && backend->resume())
+		result = wait(tid, next);
+	else
+		error = backend->error();
+
+	for (size_t i = 0; i < planted.size(); i++)
+		backend->clear_breakpoint(tid, ea_t(planted[i]));
+
+	planted.clear();
+
+	return result;
+}
+
+//--------------------------------------------------------------------------
+int branch_tracer_t::run(uint64 tid, uint64 start, uint64 stop_ea, uint64 max_insns, btrace_writer_t *out,
+                         target_event_handler_t *handler, void *handler_ud)
+{
+	int reason = BTRACE_LIMIT;
+
+	pc = start;
+	events.clear();
+	error = 0;
+
+	backend->set_event_handler(on_event, this);
+
+	for (uint64 i = 0; i < max_insns; i++)
+	{
+		if (i != 0 && pc == stop_ea)
+		{
+			reason = BTRACE_STOP_EA;
+			break;
+		}
+
+		if (i != 0 && user_bpts->contains(ea_t(pc)))
+		{
+			reason = BTRACE_BPT;
+			break;
+		}
+
+		uint64 next;
+		int stepped = step(tid, pc, &next);
+
+		if (stepped < 0)
+		{
+			reason = BTRACE_ERROR;
+			break;
+		}
+
+		if (stepped > 0)
+		{
+			out->step(pc, next);
+			pc = next;
+		}
+
+		if (!events.empty())
+		{
+			reason = BTRACE_EVENT;
+			break;
+		}
+	}
+
+	backend->set_event_handler(handler, handler_ud);
+
+	return reason;
+}
@@ -0,0 +1,150 @@
+#ifndef __BTRACE__
+#define __BTRACE__
+
+//
+//      Branch tracing.
+//      branch_tracer_t steps one thread in a tight loop, without going
+//      through IDA, and logs the taken branches to a compact file from
+//      which the executed instructions can be listed again.
+//
+
+#include <stdio.h>
+#include <vector>
+#include <string>
+#include "backend.h"
+#include "ppcstep.h"
+#include "bpts.h"
+#include "replay.h"
+
+#define BTRACE_MAGIC   0x54423344       // "D3BT"
+#define BTRACE_VERSION 1
+
+// File layout: btrace_header_t followed by records, LEB128 varints as in
+// the session logs. A record stands for 'repeat' runs of 'count' instructions
+// each ending with a branch taken to the previous target plus 'delta':
+//   count (not 0), delta (zigzag), repeat
+// The last record has a count of 0, followed by the number of instructions
+// run after the last taken branch.
+#pragma pack(push, 1)
+
+struct btrace_header_t
+{
+	uint32 magic;
+	uint16 version;
+	uint16 reserved;
+	uint64 tid;
+	uint64 start;                       // PC of the first instruction
+};
+
+#pragma pack(pop)
+
+//--------------------------------------------------------------------------
+class btrace_writer_t
+{
+	FILE *fp;
+	rr_writer_t buf;
+	uint64 target;                      // target of the last taken branch
+	uint64 run;                         // instructions run since then
+	uint64 count;                       // record being repeated
+	int64 delta;
+	uint64 repeat;
+	bool write_error;
+
+	void put_record(void);
+	bool flush(void);
+
+public:
+	// Instructions and taken branches logged, bytes written
+	uint64 insns;
+	uint64 branches;
+	uint64 size;
+
+	btrace_writer_t() : fp(NULL), write_error(false), insns(0), branches(0), size(0) {}
+	~btrace_writer_t() { close(); }
+
+	bool open(const char *path, uint64 tid, uint64 start);
+
+	// Thread went from the instruction at 'ea' to 'next'
+	void step(uint64 ea, uint64 next);
+
+	// Write the last record, false if the file could not be written
+	bool close(void);
+};
+
+// Expands a trace back to the instructions it ran
+class btrace_reader_t
+{
+	std::vector<uint8> data;
+	rr_reader_t in;
+	uint64 pc;
+	uint64 target;
+	uint64 left;                        // instructions left in the current run
+	uint64 count;
+	int64 delta;
+	uint64 repeat;                      // runs left after the current one
+	bool tail;
+
+public:
+	btrace_header_t header;
+
+	bool open(const char *path);
+
+	// Next instruction run, false at the end of the trace
+	bool next(uint64 *ea);
+
+	// The trace ended without its last record
+	bool truncated(void) const { return !in.ok(); }
+};
+
+//--------------------------------------------------------------------------
+// Why a trace ended
+enum
+{
+	BTRACE_LIMIT,                       // the instruction count was reached
+	BTRACE_STOP_EA,                     // the thread reached the stop address
+	BTRACE_BPT,                         // the thread reached a breakpoint of the user
+	BTRACE_EVENT,                       // another event came from the target
+	BTRACE_ERROR,                       // a request failed, see error
+};
+
+class branch_tracer_t
+{
+	target_backend_t *backend;
+	insn_fetch_t *fetch;
+	void *fetch_ud;
+	const bpt_table_t *user_bpts;
+	std::vector<target_event_t> received;
+	std::vector<uint64> planted;
+
+	static void on_event(const target_event_t &ev, void *ud);
+	int wait(uint64 tid, uint64 *next);
+	int step(uint64 tid, uint64 ea, uint64 *next);
+	int fail(void) { error = backend->error(); return -1; }
+
+public:
+	// Step the thread with step_thread, otherwise with breakpoints on the
+	// successors of each instruction, never planted over 'user_bpts'
+	bool hw_step;
+
+	// Stop the thread if a step takes longer than this many ms
+	uint32 timeout;
+
+	// Poll the target every this many ms while a step runs
+	uint32 poll_interval;
+
+	// Where the thread is, the events which ended the trace (BTRACE_EVENT)
+	// for the debugger, and the error code of the failed request (BTRACE_ERROR)
+	uint64 pc;
+	std::vector<target_event_t> events;
+	int error;
+
+	branch_tracer_t(target_backend_t *_backend, insn_fetch_t *_fetch, void *ud, const bpt_table_t *_user_bpts);
+
+	// Step thread 'tid', stopped at 'start', until it ran 'max_insns'
+	// instructions or reached 'stop_ea'. The events go to the tracer in the
+	// meantime, to 'handler' again when it returns. Returns BTRACE_...
+	int run(uint64 tid, uint64 start, uint64 stop_ea, uint64 max_insns, btrace_writer_t *out,
+	        target_event_handler_t *handler, void *handler_ud);
+};
+
+#endif
@@ -0,0 +1,74 @@
+// Copyright (C) 2014 oct0xor
+//
+// This program is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License 2.0 for more details.
+//
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http ://www.gnu.org/licenses/
+
+
+#include "coalesce.h"
+
+//--------------------------------------------------------------------------
+bool event_coalescer_t::add(const debug_event_t &ev, uint32 module)
+{
+	held_event_t h;
+
+	h.ev = ev;
+	h.module = module;
+
+	switch (ev.eid)
+	{
+		case THREAD_START:
+		case LIBRARY_LOAD:
+			held.push_back(h);
+			return true;
+
+		case THREAD_EXIT:
+			for (std::deque<held_event_t>::reverse_iterator it = held.rbegin(); it != held.rend(); ++it)
+			{
+				if (it->ev.eid == THREAD_START && it->ev.tid == ev.tid)
+				{
+					held.erase(--it.base());
+					threads++;
+					return true;
+				}
+			}
+			held.push_back(h);
+			return true;
+
+		case LIBRARY_UNLOAD:
+			for (std::deque<held_event_t>::reverse_iterator it = held.rbegin(); it != held.rend(); ++it)
+			{
+				if (it->ev.eid == LIBRARY_LOAD && it->module == module)
+				{
+					held.erase(--it.base());
+					modules++;
+					return true;
+				}
+			}
+			held.push_back(h);
+			return true;
+
+		default:
+			break;
+	}
+
+	return false;
+}
+
+//--------------------------------------------------------------------------
+void event_coalescer_t::flush(void (*post)(const debug_event_t &ev))
+{
+	while (!held.empty())
+	{
+		post(held.front().ev);
+		held.pop_front();
+	}
+}
@@ -0,0 +1,44 @@
+#ifndef __COALESCE__
+#define __COALESCE__
+
+//
+//      Coalescing of bursty thread and module events.
+//      Thread and module events are held back until the next stop, a
+//      thread that starts and exits in between (or a module loaded and
+//      unloaded again) is never reported.
+//
+
+#include <deque>
+#include <pro.h>
+#include <idd.hpp>
+
+class event_coalescer_t
+{
+	struct held_event_t
+	{
+		debug_event_t ev;
+		uint32 module;                  // target id of the module of a library event
+	};
+
+	std::deque<held_event_t> held;
+
+public:
+	uint32 threads;                 // thread start/exit pairs cancelled
+	uint32 modules;                 // module load/unload pairs cancelled
+
+	event_coalescer_t() : threads(0), modules(0) {}
+
+	// Take 'ev' if it can be coalesced (it is then held back or cancelled
+	// out). Returns false for the events which must be delivered now.
+	// An unload cancels the load of the same 'module'.
+	bool add(const debug_event_t &ev, uint32 module = 0);
+
+	// Hand the held events to 'post' in their original order
+	void flush(void (*post)(const debug_event_t &ev));
+
+	bool empty(void) const { return held.empty(); }
+	void clear(void) { held.clear(); threads = modules = 0; }
+	void reset_stats(void) { threads = modules = 0; }
+};
+
+#endif
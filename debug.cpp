@@ -12,17 +12,16 @@
 // A copy of the GPL 2.0 should have been included with the program.
 // If not, see http ://www.gnu.org/licenses/
 
-#define _WINSOCKAPI_
-
-#include <windows.h>
-#include <winsock2.h>
-#include <ws2tcpip.h>
-
 #include <iostream>
 #include <algorithm>
 #include <vector>
 #include <string>
 #include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <atomic>
 
 #include <ida.hpp>
 #include <area.hpp>
@@ -33,7 +32,20 @@
 #include <dbg.hpp>
 
 #include "debmod.h"
-#include "include\ps3tmapi.h"
+#include "memcache.h"
+#include "bpts.h"
+#include "regcache.h"
+#include "coalesce.h"
+#include "evtrace.h"
+#include "tmstats.h"
+#include "backend.h"
+#include "sim_backend.h"
+#include "replay.h"
+#include "ppcstep.h"
+#include "btrace.h"
+#include "memmap.h"
+#include "threads.h"
+#include "spu.h"
 
 #ifdef _DEBUG
 #define debug_printf msg
@@ -46,24 +58,92 @@
 #define PROCESSOR_NAME "ppc"
 
 static error_t idaapi idc_threadlst(idc_value_t *argv, idc_value_t *res);
+static error_t idaapi idc_memcache(idc_value_t *argv, idc_value_t *res);
+static error_t idaapi idc_bpsync(idc_value_t *argv, idc_value_t *res);
+static error_t idaapi idc_dabrsync(idc_value_t *argv, idc_value_t *res);
+static error_t idaapi idc_evtrace(idc_value_t *argv, idc_value_t *res);
+static error_t idaapi idc_tmstats(idc_value_t *argv, idc_value_t *res);
+static error_t idaapi idc_stepstats(idc_value_t *argv, idc_value_t *res);
+static error_t idaapi idc_rangestep(idc_value_t *argv, idc_value_t *res);
+static error_t idaapi idc_branchtrace(idc_value_t *argv, idc_value_t *res);
+static error_t idaapi idc_tracereplay(idc_value_t *argv, idc_value_t *res);
+static error_t idaapi idc_spuregs(idc_value_t *argv, idc_value_t *res);
 void get_threads_info(void);
 void clear_all_bp(uint32 tid);
+void reconcile_bpts(void);
 uint32 read_pc_register(uint32 tid);
 uint32 read_lr_register(uint32 tid);
 uint32 read_ctr_register(uint32 tid);
+void take_thread_snapshot(void);
 int do_step(uint32 tid, uint32 dbg_notification);
+static bool range_continue(const target_event_t &tev);
+static bool resume_process(void);
+bool flush_pending_writes(void);
+static bool store_target_memory(ea_t ea, const void *buffer, uint32 size, void *ud);
+static void set_dabr(uint64 value);
+static void apply_pending_dabr(void);
 
 static const char idc_threadlst_args[] = {0};
-
-std::vector<SNPS3TargetInfo*> Targets;
-std::string TargetName;
-HTARGET TargetID;
+static const char idc_memcache_args[] = {0};
+static const char idc_bpsync_args[] = {0};
+static const char idc_dabrsync_args[] = {0};
+static const char idc_evtrace_args[] = { VT_STR2, 0 };
+static const char idc_tmstats_args[] = { VT_LONG, 0 };
+static const char idc_stepstats_args[] = { VT_LONG, 0 };
+static const char idc_rangestep_args[] = { VT_LONG, VT_LONG, VT_LONG, 0 };
+static const char idc_branchtrace_args[] = { VT_STR2, VT_LONG, VT_LONG, 0 };
+static const char idc_tracereplay_args[] = { VT_STR2, 0 };
+static const char idc_spuregs_args[] = { VT_LONG, 0 };
+
+target_backend_t *backend;
 uint32 ProcessID;
 
-bool LaunchTargetPicker = true;
-bool AlwaysDC = false;
-bool ForceDC = true;
-bool WasOriginallyConnected = false;
+// Debug the in-process simulated target instead of a devkit
+bool UseSimulator = false;
+
+// Log every backend request and event of the session to this file,
+// or serve them from such a log instead of talking to a target
+const char *RecordSession = NULL;
+const char *ReplaySession = NULL;
+
+// Large reads go in one request, if it fails they are retried in chunks
+// of ReadChunkSize bytes to return the part which could be read
+uint32 ReadChunkSize = 0x10000;
+
+// Fetch PC/LR/SP/CTR of every thread (up to SnapshotMaxThreads) as soon as the process stops
+bool EagerThreadSnapshot = false;
+uint32 SnapshotMaxThreads = 64;
+
+// Watchpoints changed while the process runs are programmed at the next stop,
+// unless this is set: the process is then stopped just to update DABR
+bool ForceImmediateDABR = false;
+
+// Target Manager callbacks are serviced by a background thread every PumpInterval ms
+uint32 PumpInterval = 2;
+
+// Hold thread and module events until the next stop, dropping the threads
+// and modules which come and go in between
+bool CoalesceEvents = false;
+
+// Number of target events kept in the event trace (see the evtrace IDC function)
+uint32 EventTraceSize = 4096;
+
+// Report the areas known to be mapped to IDA (module segments, stacks,
+// local stores, virtual memory areas) instead of the whole address space
+bool RealMemoryMap = true;
+
+// Show the threads of the SPU thread groups as threads of the process,
+// with the local store of each one at SpuLsBase + n * SPU_LS_STRIDE
+bool SpuThreads = true;
+uint64 SpuLsBase = SPU_LS_BASE;
+
+// Step threads with the single-step facility of the target when it has one,
+// instead of planting breakpoints on the successors and resuming the process
+bool HardwareStep = true;
+
+// Stop waiting for the step off a breakpoint after this many ms, the
+// breakpoint is put back and the process resumed anyway
+uint32 StepOverTimeout = 1000;
 
 static bool attaching = false; 
 static bool singlestep = false;
@@ -71,16 +151,86 @@ static bool continue_from_bp = false;
 static bool dabr_is_set = false;
 uint32 dabr_addr;
 uint8 dabr_type;
+static bool process_stopped = false;  // only true while we know the process is stopped
+static bool dabr_pending = false;
+static uint64 dabr_value;             // last DABR value requested
 
-eventlist_t events;
-SNPS3_DBG_EVENT_DATA target_event;
+// How steps are carried out, see do_step
+enum
+{
+	STEP_PATH_TRAP,                   // breakpoints on the successors, process resumed
+	STEP_PATH_HW,                     // the target steps the thread alone
+	STEP_PATH_FALLBACK,               // hardware step refused, breakpoints planted
+	STEP_PATH_RANGE,                  // breakpoints on the exits of a range, see range_step
+	STEP_PATH_COUNT
+};
 
+static const char *const step_path_names[STEP_PATH_COUNT] = { "trap", "hardware", "fallback", "range" };
+
+static bool hw_step_available = true; // cleared once the target refuses a hardware step
+static uint32 hw_step_tid = 0;        // thread to step alone on the next resume
+static uint32 step_counts[STEP_PATH_COUNT];
+
+// Range armed by the rangestep IDC function for the next step
+static uint32 range_start = 0;
+static uint32 range_end = 0;
+static bool range_over_calls = false;
+
+// Range being stepped by thread range_tid
+static uint32 range_tid = 0;
+static uint32 range_lo;
+static uint32 range_hi;
+static std::vector<uint32> range_stops; // branches through LR or CTR in the range
+static std::vector<uint32> range_hops;  // in-range successors of the stop being run
+static uint32 range_lifted = 0;         // stop whose trap was lifted to run it
+static uint32 range_resumes;            // resumes done without leaving a range
+
+// Branch trace armed by the branchtrace IDC function for the next step,
+// and the thread to trace on the next resume
+static std::string trace_path;
+static uint64 trace_max_insns;
+static uint32 trace_stop_ea;
+static uint32 trace_tid = 0;
+
+// Events for get_debug_event, in the order they happened: those decoded from
+// the target callbacks and those generated by the IDA thread itself.
+// The producers are serialized by dispatch_lock so there is a single one.
+#define TARGET_EVENT_RING_SIZE 1024
+static event_ring_t<TARGET_EVENT_RING_SIZE> target_events;
+
+// Type of the last target event, used to drop repeated notifications
+static std::atomic<uint32> last_target_event(0);
+
+// Producer side, protected by dispatch_lock like the callbacks
+static event_coalescer_t coalescer;
+static event_trace_t event_trace;
+
+// Callbacks run on whichever thread polls the backend: the pump or the IDA thread
+// (see Kick), dispatch_lock keeps them away from the IDA side debugger state
+static std::recursive_mutex dispatch_lock;
+static std::mutex event_lock;                // pairs with event_cv
+static std::condition_variable event_cv;     // signaled when an event is queued
+static std::thread pump_thread;
+static std::mutex pump_lock;
+static std::condition_variable pump_cv;
+static bool pump_quit = false;
+
+std::vector<target_process_t> process_list;
 std::unordered_map<int, std::string> process_names;
 std::unordered_map<int, std::string> modules;
-std::unordered_map<int, int> main_bpts_map;
+bpt_shadow_t bpt_shadow;
 
 std::vector<uint32> step_bpts;
-std::vector<uint32> main_bpts;
+bpt_table_t main_bpts;
+insn_cache_t insn_cache;
+memory_map_t memory_map;
+thread_table_t thread_table;
+spu_table_t spu_table;
+
+mem_cache_t memcache;
+write_combiner_t pending_writes;
+reg_cache_t regcache;
+thread_snapshot_t thread_snapshot;
 
 static const unsigned char bpt_code[] = {0x7f, 0xe0, 0x00, 0x08};
 
@@ -89,7 +239,13 @@ static const unsigned char bpt_code[] = {0x7f, 0xe0, 0x00, 0x08};
 
 #define RC_GENERAL 1
 #define RC_FLOAT   2
-//#define RC_VECTOR  3
+#define RC_VECTOR  4
+
+#define R_PC  TREG_PC
+#define R_CR  TREG_CR
+#define R_LR  TREG_LR
+#define R_CTR TREG_CTR
+#define R_V0  TREG_VR0
 
 struct regval
 {
@@ -103,7 +259,7 @@ const char* register_classes[] =
 {
   "General registers",
   "Floating point registers",
-  /*"Velocity Engine/VMX/AltiVec", // 128-bit Vector Registers*/
+  "Velocity Engine/VMX/AltiVec", // 128-bit Vector Registers
   NULL
 };
 
@@ -175,11 +331,6 @@ static const char *const CReg[] =
 	NULL,
 };
 
-static const char *const vmx_format[] =
-{
-  "VMX 128 bit",
-};
-
 //--------------------------------------------------------------------------
 register_info_t registers[] =
 {
@@ -255,989 +406,836 @@ register_info_t registers[] =
   { "f30",    NULL,							  RC_FLOAT,    dt_qword,  NULL,   0 },
   { "f31",    NULL,							  RC_FLOAT,    dt_qword,  NULL,   0 },
 
-  /*{ "v0",	  REGISTER_CUSTFMT,				  RC_VECTOR,   dt_byte16, vmx_format,   0 },
-  { "v1",	  REGISTER_CUSTFMT,				  RC_VECTOR,   dt_byte16, vmx_format,   0 },
-  { "v2",	  REGISTER_CUSTFMT,				  RC_VECTOR,   dt_byte16, vmx_format,   0 },
-  { "v3",	  REGISTER_CUSTFMT,				  RC_VECTOR,   dt_byte16, vmx_format,   0 },
-  { "v4",	  REGISTER_CUSTFMT,				  RC_VECTOR,   dt_byte16, vmx_format,   0 },
-  { "v5",	  REGISTER_CUSTFMT,				  RC_VECTOR,   dt_byte16, vmx_format,   0 },
-  { "v6",	  REGISTER_CUSTFMT,				  RC_VECTOR,   dt_byte16, vmx_format,   0 },
-  { "v7",	  REGISTER_CUSTFMT,				  RC_VECTOR,   dt_byte16, vmx_format,   0 },
-  { "v8",	  REGISTER_CUSTFMT,				  RC_VECTOR,   dt_byte16, vmx_format,   0 },
-  { "v9",	  REGISTER_CUSTFMT,				  RC_VECTOR,   dt_byte16, vmx_format,   0 },
-  { "v10",	  REGISTER_CUSTFMT,				  RC_VECTOR,   dt_byte16, vmx_format,   0 },
-  { "v11",	  REGISTER_CUSTFMT,				  RC_VECTOR,   dt_byte16, vmx_format,   0 },
-  { "v12",	  REGISTER_CUSTFMT,				  RC_VECTOR,   dt_byte16, vmx_format,   0 },
-  { "v13",	  REGISTER_CUSTFMT,				  RC_VECTOR,   dt_byte16, vmx_format,   0 },
-  { "v14",	  REGISTER_CUSTFMT,				  RC_VECTOR,   dt_byte16, vmx_format,   0 },
-  { "v15",	  REGISTER_CUSTFMT,				  RC_VECTOR,   dt_byte16, vmx_format,   0 },
-  { "v16",	  REGISTER_CUSTFMT,				  RC_VECTOR,   dt_byte16, vmx_format,   0 },
-  { "v17",	  REGISTER_CUSTFMT,				  RC_VECTOR,   dt_byte16, vmx_format,   0 },
-  { "v18",	  REGISTER_CUSTFMT,				  RC_VECTOR,   dt_byte16, vmx_format,   0 },
-  { "v19",	  REGISTER_CUSTFMT,				  RC_VECTOR,   dt_byte16, vmx_format,   0 },
-  { "v20",	  REGISTER_CUSTFMT,				  RC_VECTOR,   dt_byte16, vmx_format,   0 },
-  { "v21",	  REGISTER_CUSTFMT,				  RC_VECTOR,   dt_byte16, vmx_format,   0 },
-  { "v22",	  REGISTER_CUSTFMT,				  RC_VECTOR,   dt_byte16, vmx_format,   0 },
-  { "v23",	  REGISTER_CUSTFMT,				  RC_VECTOR,   dt_byte16, vmx_format,   0 },
-  { "v24",	  REGISTER_CUSTFMT,				  RC_VECTOR,   dt_byte16, vmx_format,   0 },
-  { "v25",	  REGISTER_CUSTFMT,				  RC_VECTOR,   dt_byte16, vmx_format,   0 },
-  { "v26",	  REGISTER_CUSTFMT,				  RC_VECTOR,   dt_byte16, vmx_format,   0 },
-  { "v27",	  REGISTER_CUSTFMT,				  RC_VECTOR,   dt_byte16, vmx_format,   0 },
-  { "v28",	  REGISTER_CUSTFMT,				  RC_VECTOR,   dt_byte16, vmx_format,   0 },
-  { "v29",	  REGISTER_CUSTFMT,				  RC_VECTOR,   dt_byte16, vmx_format,   0 },
-  { "v30",	  REGISTER_CUSTFMT,				  RC_VECTOR,   dt_byte16, vmx_format,   0 },
-  { "v31",	  REGISTER_CUSTFMT,				  RC_VECTOR,   dt_byte16, vmx_format,   0 }*/
+  { "v0",     NULL,							  RC_VECTOR,   dt_byte16, NULL,   0 },
+  { "v1",     NULL,							  RC_VECTOR,   dt_byte16, NULL,   0 },
+  { "v2",     NULL,							  RC_VECTOR,   dt_byte16, NULL,   0 },
+  { "v3",     NULL,							  RC_VECTOR,   dt_byte16, NULL,   0 },
+  { "v4",     NULL,							  RC_VECTOR,   dt_byte16, NULL,   0 },
+  { "v5",     NULL,							  RC_VECTOR,   dt_byte16, NULL,   0 },
+  { "v6",     NULL,							  RC_VECTOR,   dt_byte16, NULL,   0 },
+  { "v7",     NULL,							  RC_VECTOR,   dt_byte16, NULL,   0 },
+  { "v8",     NULL,							  RC_VECTOR,   dt_byte16, NULL,   0 },
+  { "v9",     NULL,							  RC_VECTOR,   dt_byte16, NULL,   0 },
+  { "v10",    NULL,							  RC_VECTOR,   dt_byte16, NULL,   0 },
+  { "v11",    NULL,							  RC_VECTOR,   dt_byte16, NULL,   0 },
+  { "v12",    NULL,							  RC_VECTOR,   dt_byte16, NULL,   0 },
+  { "v13",    NULL,							  RC_VECTOR,   dt_byte16, NULL,   0 },
+  { "v14",    NULL,							  RC_VECTOR,   dt_byte16, NULL,   0 },
+  { "v15",    NULL,							  RC_VECTOR,   dt_byte16, NULL,   0 },
+  { "v16",    NULL,							  RC_VECTOR,   dt_byte16, NULL,   0 },
+  { "v17",    NULL,							  RC_VECTOR,   dt_byte16, NULL,   0 },
+  { "v18",    NULL,							  RC_VECTOR,   dt_byte16, NULL,   0 },
+  { "v19",    NULL,							  RC_VECTOR,   dt_byte16, NULL,   0 },
+  { "v20",    NULL,							  RC_VECTOR,   dt_byte16, NULL,   0 },
+  { "v21",    NULL,							  RC_VECTOR,   dt_byte16, NULL,   0 },
+  { "v22",    NULL,							  RC_VECTOR,   dt_byte16, NULL,   0 },
+  { "v23",    NULL,							  RC_VECTOR,   dt_byte16, NULL,   0 },
+  { "v24",    NULL,							  RC_VECTOR,   dt_byte16, NULL,   0 },
+  { "v25",    NULL,							  RC_VECTOR,   dt_byte16, NULL,   0 },
+  { "v26",    NULL,							  RC_VECTOR,   dt_byte16, NULL,   0 },
+  { "v27",    NULL,							  RC_VECTOR,   dt_byte16, NULL,   0 },
+  { "v28",    NULL,							  RC_VECTOR,   dt_byte16, NULL,   0 },
+  { "v29",    NULL,							  RC_VECTOR,   dt_byte16, NULL,   0 },
+  { "v30",    NULL,							  RC_VECTOR,   dt_byte16, NULL,   0 },
+  { "v31",    NULL,							  RC_VECTOR,   dt_byte16, NULL,   0 },
+  { "VSCR",   NULL,							  RC_VECTOR,   dt_dword,  NULL,   0 },
+  { "VRSAVE", NULL,							  RC_VECTOR,   dt_dword,  NULL,   0 },
 };
 
-uint32 registers_id[68] = {
-	SNPS3_gpr_0,
-	SNPS3_gpr_1,
-	SNPS3_gpr_2,	
-	SNPS3_gpr_3,	
-	SNPS3_gpr_4,	
-	SNPS3_gpr_5,	
-	SNPS3_gpr_6,	
-	SNPS3_gpr_7,	
-	SNPS3_gpr_8,	
-	SNPS3_gpr_9,	
-	SNPS3_gpr_10,
-	SNPS3_gpr_11,
-	SNPS3_gpr_12,
-	SNPS3_gpr_13,
-	SNPS3_gpr_14,
-	SNPS3_gpr_15,
-	SNPS3_gpr_16,
-	SNPS3_gpr_17,
-	SNPS3_gpr_18,
-	SNPS3_gpr_19,
-	SNPS3_gpr_20,
-	SNPS3_gpr_21,
-	SNPS3_gpr_22,
-	SNPS3_gpr_23,
-	SNPS3_gpr_24,
-	SNPS3_gpr_25,
-	SNPS3_gpr_26,
-	SNPS3_gpr_27,
-	SNPS3_gpr_28,
-	SNPS3_gpr_29,
-	SNPS3_gpr_30,
-	SNPS3_gpr_31,
-
-	SNPS3_pc,
-	SNPS3_cr,
-	SNPS3_lr,
-	SNPS3_ctr,
-	//SNPS3_xer		// "XER"
-	//SNPS3_fpscr	// "fpscr"
-	//SNPS3_vscr	// "vscr"
-	//SNPS3_vrsave  // "vrsave"
-	//SNPS3_msr		// "msr"
-
-	SNPS3_fpr_0,
-	SNPS3_fpr_1,
-	SNPS3_fpr_2,
-	SNPS3_fpr_3,
-	SNPS3_fpr_4,
-	SNPS3_fpr_5,
-	SNPS3_fpr_6,
-	SNPS3_fpr_7,
-	SNPS3_fpr_8,
-	SNPS3_fpr_9,
-	SNPS3_fpr_10,
-	SNPS3_fpr_11,
-	SNPS3_fpr_12,
-	SNPS3_fpr_13,
-	SNPS3_fpr_14,
-	SNPS3_fpr_15,
-	SNPS3_fpr_16,
-	SNPS3_fpr_17,
-	SNPS3_fpr_18,
-	SNPS3_fpr_19,
-	SNPS3_fpr_20,
-	SNPS3_fpr_21,
-	SNPS3_fpr_22,
-	SNPS3_fpr_23,
-	SNPS3_fpr_24,
-	SNPS3_fpr_25,
-	SNPS3_fpr_26,
-	SNPS3_fpr_27,
-	SNPS3_fpr_28,
-	SNPS3_fpr_29,
-	SNPS3_fpr_30,
-	SNPS3_fpr_31,
-
-	/*SNPS3_vmx_0,
-	SNPS3_vmx_1,
-	SNPS3_vmx_2,
-	SNPS3_vmx_3,
-	SNPS3_vmx_4,
-	SNPS3_vmx_5,
-	SNPS3_vmx_6,
-	SNPS3_vmx_7,
-	SNPS3_vmx_8,
-	SNPS3_vmx_9,
-	SNPS3_vmx_10,
-	SNPS3_vmx_11,
-	SNPS3_vmx_12,
-	SNPS3_vmx_13,
-	SNPS3_vmx_14,
-	SNPS3_vmx_15,
-	SNPS3_vmx_16,
-	SNPS3_vmx_17,
-	SNPS3_vmx_18,
-	SNPS3_vmx_19,
-	SNPS3_vmx_20,
-	SNPS3_vmx_21,
-	SNPS3_vmx_22,
-	SNPS3_vmx_23,
-	SNPS3_vmx_24,
-	SNPS3_vmx_25,
-	SNPS3_vmx_26,
-	SNPS3_vmx_27,
-	SNPS3_vmx_28,
-	SNPS3_vmx_29,
-	SNPS3_vmx_30,
-	SNPS3_vmx_31*/
-};
+// backend register number of every entry, the table follows the TREG_ order
+static uint32 registers_id[qnumber(registers)];
 
-//-------------------------------------------------------------------------
-static inline uint32 bswap32(uint32 x)
-{
-	return ( (x << 24) & 0xff000000 ) |
-           ( (x <<  8) & 0x00ff0000 ) |
-           ( (x >>  8) & 0x0000ff00 ) |
-           ( (x >> 24) & 0x000000ff );
-}
+CASSERT(qnumber(registers) == TREG_COUNT);
+CASSERT(TREG_SLOT_SIZE == REGCACHE_SLOT_SIZE);
+
+// register class of every entry of registers_id, for the register cache
+static int registers_class[qnumber(registers)];
 
-static inline uint64 bswap64(uint64 x)
+//--------------------------------------------------------------------------
+void Kick()
 {
-	return ( (x << 56) & 0xff00000000000000ULL ) |
-           ( (x << 40) & 0x00ff000000000000ULL ) |
-           ( (x << 24) & 0x0000ff0000000000ULL ) |
-           ( (x <<  8) & 0x000000ff00000000ULL ) |
-           ( (x >>  8) & 0x00000000ff000000ULL ) |
-           ( (x >> 24) & 0x0000000000ff0000ULL ) |
-           ( (x >> 40) & 0x000000000000ff00ULL ) |
-           ( (x >> 56) & 0x00000000000000ffULL );
+	std::lock_guard<std::recursive_mutex> guard(dispatch_lock);
+
+	backend->poll();
 }
 
-//-------------------------------------------------------------------------
-bool ConnectToActiveTarget()
+//--------------------------------------------------------------------------
+// Queue an event decoded from a target callback for get_debug_event
+static void queue_event(const debug_event_t &ev)
 {
-	char* pszUsage = NULL;
-	SNRESULT snr;
-	// Connect to the target.
-	if (SN_FAILED(snr = SNPS3Connect(TargetID, NULL)))
-	{
-		if (snr == SN_E_TARGET_IN_USE && ForceDC)
-		{
-			if (SN_FAILED( snr = SNPS3ForceDisconnect(TargetID) ))
-			{
-				debug_printf("Unable to force disconnect %s\n", CUTF8ToWChar(pszUsage).c_str());
-				return false;
-			}
-			else
-			{
-				snr = SNPS3Connect(TargetID, NULL);
-			}
-		}
+	target_events.push(ev);
 
-		if (SN_FAILED(snr))
-		{
-			debug_printf("Failed to connect to target\n");
-			return false;
-		}
-	}
-	else
+	// the lock only orders the wakeup with a consumer about to sleep
 	{
-		WasOriginallyConnected = (snr == SN_S_NO_ACTION);
+		std::lock_guard<std::mutex> lock(event_lock);
 	}
 
-	msg("Connected to target\n");
-	return true;
+	event_cv.notify_one();
 }
 
-//-------------------------------------------------------------------------
-int __stdcall EnumCallBack(HTARGET hTarget)
+// Release the events held by the coalescer, followed by a summary of
+// what was dropped
+static void flush_coalesced_events(void)
 {
-	SNPS3TargetInfo ti;
-	std::auto_ptr<SNPS3TargetInfo> pti(new SNPS3TargetInfo);
+	coalescer.flush(queue_event);
 
-	if (pti.get())
-	{
-		ti.hTarget = hTarget;
-		ti.nFlags = SN_TI_TARGETID;
+	if (coalescer.threads == 0 && coalescer.modules == 0)
+		return;
 
-		if (SN_S_OK == SNPS3GetTargetInfo(&ti))
-		{
-			// Store target parameters.
-			pti->hTarget = hTarget;
-			pti->pszName = _strdup(ti.pszName);
-			pti->pszHomeDir = _strdup(ti.pszHomeDir);
-			pti->pszFSDir = _strdup(ti.pszFSDir);
-
-			// Store this target.
-			Targets.push_back(pti.release());
-		}
-		else
-		{
-			// Terminate enumeration.
-			return 1;
-		}
-	}
+	debug_event_t ev;
+	ev.eid     = INFORMATION;
+	ev.pid     = ProcessID;
+	ev.tid     = NO_THREAD;
+	ev.ea      = BADADDR;
+	ev.handled = true;
 
-	// Carry on with enumeration.
-	return 0;
-}
+	qsnprintf(ev.info, sizeof(ev.info), "Coalesced %u short-lived threads and %u module load/unload pairs", coalescer.threads, coalescer.modules);
 
-void SetTargetName(std::string targetName)
-{ 
-	TargetName = targetName; 
-}
+	queue_event(ev);
 
-void SetTargetId(HTARGET hTargetId) 
-{ 
-	TargetID = hTargetId; 
+	coalescer.reset_stats();
 }
 
-bool FindFirstConnectedTarget(void)
+// 'module' is the target id of the module of a library event
+static void post_event(const debug_event_t &ev, uint32 module = 0)
 {
-	ECONNECTSTATUS nStatus = (ECONNECTSTATUS) -1;
-	char*  pszUsage = 0;
+	if (CoalesceEvents && coalescer.add(ev, module))
+		return;
 
-	std::vector<SNPS3TargetInfo*>::iterator iter = Targets.begin();
+	// any other event is delivered at once, after the held ones
+	flush_coalesced_events();
 
-	while (iter != Targets.end())
-	{
-		SNRESULT snr = SNPS3GetConnectStatus((*iter)->hTarget,	&nStatus, &pszUsage);
+	queue_event(ev);
+}
 
-		if (SN_SUCCEEDED( snr ))
-		{
-			if (nStatus == CS_CONNECTED)
-			{
-				SNPS3TargetInfo ti;
+static bool retrieve_event(debug_event_t *ev)
+{
+	uint32 spilled = target_events.take_overflows();
 
-				ti.hTarget = (*iter)->hTarget;
-				ti.nFlags = SN_TI_TARGETID;
+	if (spilled != 0)
+		debug_printf("Event queue full, %u events spilled\n", spilled);
 
-				if (SN_S_OK == SNPS3GetTargetInfo(&ti))
-				{
-					// Store target parameters.
-					SetTargetId(ti.hTarget);
-					SetTargetName(ti.pszName);
+	return target_events.pop(ev);
+}
 
-					return true;
-				}
-			}
-		}
-		iter++;
-	}
+// Wait up to 'timeout' ms for an event to be queued
+static bool wait_for_event(uint32 timeout)
+{
+	std::unique_lock<std::mutex> lock(event_lock);
 
-	return false;
+	return event_cv.wait_for(lock, std::chrono::milliseconds(timeout), [] { return !target_events.empty(); });
 }
 
-bool FindFirstAvailableTarget(void)
+//--------------------------------------------------------------------------
+// Event pump: delivers Target Manager callbacks while IDA is busy elsewhere
+static void event_pump(void)
 {
-	uint   nStatus = -1;
-	char*  pszUsage = 0;
-
-	std::vector<SNPS3TargetInfo*>::iterator iter = Targets.begin();
+	std::unique_lock<std::mutex> lock(pump_lock);
 
-	while (iter != Targets.end())
+	while (!pump_quit)
 	{
-		SNRESULT snr = SNPS3Connect((*iter)->hTarget, NULL);
+		lock.unlock();
 
-		if (SN_SUCCEEDED( snr ))
 		{
-			SNPS3TargetInfo ti;
+			std::lock_guard<std::recursive_mutex> guard(dispatch_lock);
 
-			ti.hTarget = (*iter)->hTarget;
-			ti.nFlags = SN_TI_TARGETID;
-
-			if (SN_S_OK == SNPS3GetTargetInfo(&ti))
-			{
-				// Store target parameters.
-				SetTargetId(ti.hTarget);
-				SetTargetName(ti.pszName);
-				return true;
-			}
+			// while attaching the events are held until IDA has seen the initial state
+			if (attaching == false)
+				Kick();
 		}
 
-		iter++;
-	}
+		lock.lock();
 
-	return false;
+		pump_cv.wait_for(lock, std::chrono::milliseconds(PumpInterval), [] { return pump_quit; });
+	}
 }
 
-bool GetHostnames(const char* input, std::string& ipOut, std::string& dnsNameOut)
+static void start_event_pump(void)
 {
-	WSADATA wsaData;
-	int iResult;
-
-	// Initialize Winsock
-	iResult = WSAStartup(MAKEWORD(2, 2), &wsaData);
-	if (iResult != 0) {
-		return false;
-	}
-
-	sockaddr_in remotemachine;
-	char hostname[NI_MAXHOST];
-
-	remotemachine.sin_family = AF_INET;
-	remotemachine.sin_addr.s_addr = inet_addr(input);
-
-	// IP->Hostname
-	DWORD dwRetVal = getnameinfo((SOCKADDR *)&remotemachine, 
-		sizeof(sockaddr), 
-		hostname, 
-		NI_MAXHOST, 
-		NULL, 
-		0, 
-		NI_NAMEREQD);
+	if (pump_thread.joinable())
+		return;
 
-	if (dwRetVal == 0)
-	{
-		dnsNameOut = hostname;
-		return true;
-	}
+	pump_quit = false;
+	pump_thread = std::thread(event_pump);
+}
 
-	// Hostname -> IP
-	struct hostent *remoteHost;
-	remoteHost = gethostbyname(input);
+static void stop_event_pump(void)
+{
+	if (!pump_thread.joinable())
+		return;
 
-	int i = 0;
-	struct in_addr addr = { 0 };
-	if (remoteHost && remoteHost->h_addrtype == AF_INET)
 	{
-		if (remoteHost->h_addr_list[0] != 0)
-		{
-			addr.s_addr = *(u_long *) remoteHost->h_addr_list[0];
-			ipOut = inet_ntoa(addr);
-			return true;
-		}
+		std::lock_guard<std::mutex> lock(pump_lock);
+		pump_quit = true;
 	}
 
-	WSACleanup();
-	return false;
+	pump_cv.notify_one();
+	pump_thread.join();
 }
 
-bool GetTargetFromAddress(const char *pszIPAddr, HTARGET &hTarget)
+//--------------------------------------------------------------------------
+// The breakpoint at 'ea' was just cleared and the target put back the word
+// it saved when the breakpoint was set: redo the writes made over it since
+static void restore_written_bpt(ea_t ea)
 {
-	TMAPI_TCPIP_CONNECT_PROP oConnection;
-	std::vector<SNPS3TargetInfo*>::iterator iter = Targets.begin();
+	uint32 word;
 
-	while (iter != Targets.end())
-	{
-		if (SN_SUCCEEDED( SNPS3GetConnectionInfo((*iter)->hTarget, &oConnection) ))
-		{
-			if (wcscmp(UTF8ToWChar(std::string(pszIPAddr)).c_str(), CUTF8ToWChar(oConnection.szIPAddress)) == 0)
-			{
-				hTarget = (*iter)->hTarget;
-				return true;
-			}
-		}
+	if (!bpt_shadow.find_written(ea, &word))
+		return;
 
-		++iter;
-	}
+	if (store_target_memory(ea, &word, BPT_SIZE, NULL))
+		bpt_shadow.set(ea, word);
 
-	// If we didn't find a match there, do a DNS lookup
-	std::string ipAddress;
-	std::string dnsName;
-	if (!GetHostnames(pszIPAddr, ipAddress, dnsName))
-		return false;
+	memcache.invalidate(ea, BPT_SIZE);
+	insn_cache.invalidate(ea, BPT_SIZE);
+}
+
+//--------------------------------------------------------------------------
+// Remove the step breakpoint at 'addr', unless a breakpoint of IDA is there too
+static void clear_step_bpt(uint64 tid, uint32 addr)
+{
+	std::vector<uint32>::iterator it = std::find(step_bpts.begin(), step_bpts.end(), addr);
+
+	if (it != step_bpts.end())
+		step_bpts.erase(it);
 
-	// Now iterate again
-	iter = Targets.begin();
+	if (main_bpts.contains(addr))
+		return;
 
-	while (iter != Targets.end())
+	if (!backend->clear_breakpoint(tid, addr))
 	{
-		if (SN_SUCCEEDED( SNPS3GetConnectionInfo((*iter)->hTarget, &oConnection) ))
-		{
-			if (wcscmp(UTF8ToWChar(ipAddress).c_str(), CUTF8ToWChar(oConnection.szIPAddress)) == 0
-				|| wcscmp(UTF8ToWChar(dnsName).c_str(), CUTF8ToWChar(oConnection.szIPAddress)) == 0)
-			{
-				hTarget = (*iter)->hTarget;
-				return true;
-			}
-		}
+		msg("ClearBreakPoint Error: %d\n", backend->error());
+
+	} else {
 
-		++iter;
+		restore_written_bpt(addr);
+		debug_printf("step bpt cleared\n");
 	}
 
-	return false;
+	bpt_shadow.erase(addr);
 }
 
-bool SetUpTarget(void)
+//--------------------------------------------------------------------------
+// A step is over: report it and remove the breakpoints planted for it
+static void step_done(const target_event_t &tev)
 {
-	SNRESULT snr;
-
-	// Enumerate available targets.
-	if (SN_FAILED( snr = SNPS3EnumerateTargets(EnumCallBack) ))
-	{
-		debug_printf("Failed to enumerate targets\n");
-		return false;
-	}
-
-	// Attempt to get the target name from an environment variable...
+	debug_event_t ev;
 
-	if (LaunchTargetPicker)
-	{
-		debug_printf("Launching target picker...\n");
-		if (SN_FAILED(snr = SNPS3PickTarget(NULL, &TargetID)))
-		{
-			debug_printf("Failed to pick target\n");
-			return false;
-		}
+	ev.eid     = STEP;
+	ev.pid     = ProcessID;
+	ev.tid     = tev.tid;
+	ev.ea      = tev.pc;
+	ev.handled = true;
+	ev.exc.code = 0;
+	ev.exc.can_cont = true;
+	ev.exc.ea = BADADDR;
 
-		SNPS3TargetInfo targetInfo = {};
-		targetInfo.hTarget = TargetID;
-		targetInfo.nFlags = SN_TI_TARGETID;
+	post_event(ev);
 
-		if (SN_FAILED( snr = SNPS3GetTargetInfo(&targetInfo) ))
-		{
-			debug_printf("Failed to get target info\n");
-			return false;
-		}
+	while (!step_bpts.empty())
+		clear_step_bpt(tev.tid, step_bpts.back());
 
-		TargetName = std::string(targetInfo.pszName);
-	}
+	range_tid = 0;
+	range_stops.clear();
+	range_hops.clear();
+	range_lifted = 0;
 
-	if (TargetName.empty())
+	if (continue_from_bp == true)
 	{
-		wchar_t* pEnv = _wgetenv(L"PS3TARGET");
-		if (pEnv)
-			TargetName = WCharToUTF8(pEnv);
+		continue_from_bp = false;
+	} else {
+		singlestep = false;
 	}
+}
+
+//--------------------------------------------------------------------------
+// Tell IDA about the SPU threads which came and went, queued behind the
+// attach events while attaching
+static void post_spu_threads(const std::vector<uint32> &added, const std::vector<uint32> &removed, bool queue)
+{
+	debug_event_t ev;
 
-	if (Targets.size() == 1 && TargetName.empty())
+	for (size_t i = 0; i < removed.size(); i++)
 	{
-		TargetName = Targets[0]->pszName;
+		ev.eid     = THREAD_EXIT;
+		ev.pid     = ProcessID;
+		ev.tid     = removed[i];
+		ev.ea      = BADADDR;
+		ev.handled = true;
+		ev.exit_code = 0;
+
+		if (queue)
+			queue_event(ev);
+		else
+			post_event(ev);
 	}
 
-	// If no target has been selected then use the default target
-	if (TargetName.empty())
+	for (size_t i = 0; i < added.size(); i++)
 	{
-		if (SN_S_OK == SNPS3GetDefaultTarget(&TargetID))
-		{
-			SNPS3TargetInfo targetInfo = {};
-			targetInfo.hTarget = TargetID;
-			targetInfo.nFlags = SN_TI_TARGETID;
+		const spu_thread_t *t = spu_table.find(added[i]);
 
-			if (SN_FAILED( snr = SNPS3GetTargetInfo(&targetInfo) ))
-			{
-				debug_printf("Failed to get target info\n");
-				return false;
-			}
+		ev.eid     = THREAD_START;
+		ev.pid     = ProcessID;
+		ev.tid     = added[i];
+		ev.ea      = t != NULL ? (ea_t)spu_table.window(*t) : BADADDR;
+		ev.handled = true;
 
-			TargetName = std::string(targetInfo.pszName);
-		}
-	}
-	
-	// If no target has been selected then use the first one connected or the first one available.
-	if (TargetName.empty())
-	{
-		if (!FindFirstConnectedTarget())
-		{
-			FindFirstAvailableTarget();
-		}
-	}
-	// Retrieve the target ID from the name or failing that IP.
-	if (SN_FAILED(snr = SNPS3GetTargetFromName(TargetName.c_str(), &TargetID)))
-	{
-		if (!GetTargetFromAddress(TargetName.c_str(), TargetID))
-		{
-			debug_printf("Failed to find target! Please ensure target name/ip/hostname is correct\n");
-			return false;
-		}
+		if (queue)
+			queue_event(ev);
+		else
+			post_event(ev);
 	}
 
-	return true;
-}
-
-//--------------------------------------------------------------------------
-void Kick()
-{
-	SNRESULT snr = SN_S_OK;
-	int Kicks = 0;
-
-	do
-	{
-		snr = SNPS3Kick();
-		++Kicks;
-	
-	} while (snr == SN_S_OK);
+	if (!added.empty() || !removed.empty())
+		memory_map.stale = true;
 }
 
 //--------------------------------------------------------------------------
-//  Process target specific events (see TargetEventCallback).
-static void ProcessTargetSpecificEvent(uint uDataLen, byte *pData)
+//  Process the events received from the target, called from Kick.
+static void on_target_event(const target_event_t &tev, void *ud)
 {
-	SNPS3_DBG_EVENT_HDR *pDbgHeader = (SNPS3_DBG_EVENT_HDR *)pData;
-	SNPS3_DBG_EVENT_DATA *pDbgData = (SNPS3_DBG_EVENT_DATA *)(pData + sizeof(SNPS3_DBG_EVENT_HDR));
 	debug_event_t ev;
-	SNRESULT snr = SN_S_OK;
 
-	switch (pDbgData->uEventType)
+	event_trace.add(tev.type, tev.tid, tev.pc, (uint32)tev.arg, tev.timebase);
+
+	switch (tev.type)
 	{
-	case SNPS3_DBG_EVENT_PROCESS_CREATE:
+	case TEV_PROCESS_CREATE:
 		{
-			debug_printf("SNPS3_DBG_EVENT_PROCESS_CREATE\n");
+			debug_printf("TEV_PROCESS_CREATE\n");
 		}
 		break;
 
-	case SNPS3_DBG_EVENT_PROCESS_EXIT:
+	case TEV_PROCESS_EXIT:
 		{
-			debug_printf("SNPS3_DBG_EVENT_PROCESS_EXIT\n");
+			debug_printf("TEV_PROCESS_EXIT\n");
 
 			ev.eid     = PROCESS_EXIT;
 			ev.pid     = ProcessID;
 			ev.tid     = NO_THREAD;
 			ev.ea      = BADADDR;
 			ev.handled = true;
-			ev.exit_code = bswap64(pDbgData->ppu_process_exit.uExitCode);
+			ev.exit_code = tev.arg;
 
-			events.enqueue(ev, IN_BACK);
+			post_event(ev);
+
+			insn_cache.clear();
+			memory_map.clear();
+			thread_table.clear();
+			spu_table.clear();
 
 		}
 		break;
 
-	case SNPS3_DBG_EVENT_PPU_EXP_TRAP:
+	case TEV_TRAP:
 		{
-			debug_printf("-> SNPS3_DBG_EVENT_PPU_EXP_TRAP <-\n");
+			debug_printf("-> TEV_TRAP <-\n");
 
-			debug_printf("ThreadID = 0x%llX, PC = 0x%llX\n", bswap64(pDbgData->ppu_exc_trap.uPPUThreadID), bswap64(pDbgData->ppu_exc_trap.uPC));
+			debug_printf("ThreadID = 0x%llX, PC = 0x%llX\n", tev.tid, tev.pc);
 
-			if (target_event.uEventType == SNPS3_DBG_EVENT_PPU_EXP_TRAP)
+			if (last_target_event == TEV_TRAP)
 				break;
 
-			if (singlestep == true || continue_from_bp == true) {
-
-				uint32 addr;
-				std::vector<uint32>::iterator it;
-
-				ev.eid     = STEP;
-				ev.pid     = ProcessID;
-				ev.tid     = bswap64(pDbgData->ppu_exc_trap.uPPUThreadID);
-				ev.ea      = bswap64(pDbgData->ppu_exc_trap.uPC);
-				ev.handled = true;
-				ev.exc.code = 0;
-				ev.exc.can_cont = true;
-				ev.exc.ea = BADADDR;
-
-				events.enqueue(ev, IN_BACK);
-
-				while (!step_bpts.empty())
-				{
-					addr = step_bpts.back();
-					step_bpts.pop_back();
-
-					it = std::find(main_bpts.begin(), main_bpts.end(), addr);
-					if (it == main_bpts.end()) {
-
-						main_bpts_map.erase(addr);
-
-						if (SN_FAILED( snr = SNPS3ClearBreakPoint(TargetID, PS3_UI_CPU, ProcessID, bswap64(pDbgData->ppu_exc_trap.uPPUThreadID), addr)))
-						{
-							msg("SNPS3ClearBreakPoint Error: %d\n", snr);
-
-						} else {
-
-							debug_printf("step bpt cleared\n");
-						}
-					}
+			if (range_tid != 0 && tev.tid == range_tid && range_continue(tev))
+			{
+				// running again, its next trap is not a repeat of this one
+				last_target_event = 0;
+				return;
+			}
 
-				}
+			if (singlestep == true || continue_from_bp == true) {
 
-				if (continue_from_bp == true)
-				{
-					continue_from_bp = false;
-				} else {
-					singlestep = false;
-				}
+				step_done(tev);
 
 			} else {
 
 				ev.eid     = BREAKPOINT;
 				ev.pid     = ProcessID;
-				ev.tid     = bswap64(pDbgData->ppu_exc_trap.uPPUThreadID);
-				ev.ea      = bswap64(pDbgData->ppu_exc_trap.uPC);
+				ev.tid     = tev.tid;
+				ev.ea      = tev.pc;
 				ev.handled = true;
 				ev.bpt.hea = BADADDR;
 				ev.bpt.kea = BADADDR;
 				ev.exc.ea  = BADADDR;
 
-				events.enqueue(ev, IN_BACK);
+				post_event(ev);
 
 			}
 		}
 		break;
 
-	case SNPS3_DBG_EVENT_PPU_EXP_PREV_INT:
+	case TEV_PRIV_INSTR:
 		{
-			debug_printf("SNPS3_DBG_EVENT_PPU_EXP_PREV_INT\n");
-			debug_printf("ThreadID = 0x%llX, PC = 0x%llX\n", bswap64(pDbgData->ppu_exc_prev_int.uPPUThreadID), bswap64(pDbgData->ppu_exc_prev_int.uPC));
+			debug_printf("TEV_PRIV_INSTR\n");
+			debug_printf("ThreadID = 0x%llX, PC = 0x%llX\n", tev.tid, tev.pc);
 
 			ev.eid     = EXCEPTION;
 			ev.pid     = ProcessID;
-			ev.tid     = bswap64(pDbgData->ppu_exc_prev_int.uPPUThreadID);
+			ev.tid     = tev.tid;
 			ev.ea      = BADADDR;
 			ev.handled = true;
 			ev.exc.code = 0;
 			ev.exc.can_cont = false;
-			ev.exc.ea = bswap64(pDbgData->ppu_exc_prev_int.uPC);
+			ev.exc.ea = tev.pc;
 			qstrncpy(ev.exc.info, "privilege instruction", sizeof(ev.exc.info));
 
-			events.enqueue(ev, IN_BACK);
+			post_event(ev);
 
 		}
 		break;
 
-	case SNPS3_DBG_EVENT_PPU_EXP_ALIGNMENT:
+	case TEV_ALIGNMENT:
 		{
-			debug_printf("SNPS3_DBG_EVENT_PPU_EXP_ALIGNMENT\n");
-			debug_printf("ThreadID = 0x%llX, PC = 0x%llX\n", bswap64(pDbgData->ppu_exc_alignment.uPPUThreadID), bswap64(pDbgData->ppu_exc_alignment.uPC));
+			debug_printf("TEV_ALIGNMENT\n");
+			debug_printf("ThreadID = 0x%llX, PC = 0x%llX\n", tev.tid, tev.pc);
 
 			ev.eid     = EXCEPTION;
 			ev.pid     = ProcessID;
-			ev.tid     = bswap64(pDbgData->ppu_exc_alignment.uPPUThreadID);
+			ev.tid     = tev.tid;
 			ev.ea      = BADADDR;
 			ev.handled = true;
 			ev.exc.code = 0;
 			ev.exc.can_cont = false;
-			ev.exc.ea = bswap64(pDbgData->ppu_exc_alignment.uPC);
+			ev.exc.ea = tev.pc;
 			qstrncpy(ev.exc.info, "alignment interrupt", sizeof(ev.exc.info));
 			
-			events.enqueue(ev, IN_BACK);
+			post_event(ev);
 
 		}
 		break;
 
-	case SNPS3_DBG_EVENT_PPU_EXP_ILL_INST:
+	case TEV_ILLEGAL_INSTR:
 		{
-			debug_printf("SNPS3_DBG_EVENT_PPU_EXP_ILL_INST\n");
-			debug_printf("ThreadID = 0x%llX, PC = 0x%llX\n", bswap64(pDbgData->ppu_exc_ill_inst.uPPUThreadID), bswap64(pDbgData->ppu_exc_ill_inst.uPC));
-			debug_printf("DSISR = 0x%llX\n", bswap64(pDbgData->ppu_exc_ill_inst.uDSISR));
+			debug_printf("TEV_ILLEGAL_INSTR\n");
+			debug_printf("ThreadID = 0x%llX, PC = 0x%llX\n", tev.tid, tev.pc);
 
 			ev.eid     = EXCEPTION;
 			ev.pid     = ProcessID;
-			ev.tid     = bswap64(pDbgData->ppu_exc_ill_inst.uPPUThreadID);
+			ev.tid     = tev.tid;
 			ev.ea      = BADADDR;
 			ev.handled = true;
 			ev.exc.code = 0;
 			ev.exc.can_cont = false;
-			ev.exc.ea = bswap64(pDbgData->ppu_exc_ill_inst.uPC);
+			ev.exc.ea = tev.pc;
 			qstrncpy(ev.exc.info, "illegal instruction", sizeof(ev.exc.info));
 			
-			events.enqueue(ev, IN_BACK);
+			post_event(ev);
 
 		}
 		break;
 
-	case SNPS3_DBG_EVENT_PPU_EXP_TEXT_HTAB_MISS:
+	case TEV_TEXT_HTAB_MISS:
 		{
-			debug_printf("SNPS3_DBG_EVENT_PPU_EXP_TEXT_HTAB_MISS\n");
-			debug_printf("ThreadID = 0x%llX, PC = 0x%llX\n", bswap64(pDbgData->ppu_exc_text_htab_miss.uPPUThreadID), bswap64(pDbgData->ppu_exc_text_htab_miss.uPC));
+			debug_printf("TEV_TEXT_HTAB_MISS\n");
+			debug_printf("ThreadID = 0x%llX, PC = 0x%llX\n", tev.tid, tev.pc);
 			
 			ev.eid     = EXCEPTION;
 			ev.pid     = ProcessID;
-			ev.tid     = bswap64(pDbgData->ppu_exc_text_htab_miss.uPPUThreadID);
+			ev.tid     = tev.tid;
 			ev.ea      = BADADDR;
 			ev.handled = true;
 			ev.exc.code = 0;
 			ev.exc.can_cont = false;
-			ev.exc.ea = bswap64(pDbgData->ppu_exc_text_htab_miss.uPC);
+			ev.exc.ea = tev.pc;
 			qstrncpy(ev.exc.info, "instruction storage interrupt", sizeof(ev.exc.info));
 			
-			events.enqueue(ev, IN_BACK);
+			post_event(ev);
 
 		}
 		break;
 
-	case SNPS3_DBG_EVENT_PPU_EXP_TEXT_SLB_MISS:
+	case TEV_TEXT_SLB_MISS:
 		{
-			debug_printf("SNPS3_DBG_EVENT_PPU_EXP_TEXT_SLB_MISS\n");
-			debug_printf("ThreadID = 0x%llX, PC = 0x%llX\n", bswap64(pDbgData->ppu_exc_text_slb_miss.uPPUThreadID), bswap64(pDbgData->ppu_exc_text_slb_miss.uPC));
+			debug_printf("TEV_TEXT_SLB_MISS\n");
+			debug_printf("ThreadID = 0x%llX, PC = 0x%llX\n", tev.tid, tev.pc);
 			
 			ev.eid     = EXCEPTION;
 			ev.pid     = ProcessID;
-			ev.tid     = bswap64(pDbgData->ppu_exc_text_slb_miss.uPPUThreadID);
+			ev.tid     = tev.tid;
 			ev.ea      = BADADDR;
 			ev.handled = true;
 			ev.exc.code = 0;
 			ev.exc.can_cont = false;
-			ev.exc.ea = bswap64(pDbgData->ppu_exc_text_slb_miss.uPC);
+			ev.exc.ea = tev.pc;
 			qstrncpy(ev.exc.info, "instruction segment interrupt", sizeof(ev.exc.info));
 			
-			events.enqueue(ev, IN_BACK);
+			post_event(ev);
 
 		}
 		break;
 
-	case SNPS3_DBG_EVENT_PPU_EXP_DATA_HTAB_MISS:
+	case TEV_DATA_HTAB_MISS:
 		{
-			debug_printf("SNPS3_DBG_EVENT_PPU_EXP_DATA_HTAB_MISS\n");
-			debug_printf("ThreadID = 0x%llX, PC = 0x%llX\n", bswap64(pDbgData->ppu_exc_data_htab_miss.uPPUThreadID), bswap64(pDbgData->ppu_exc_data_htab_miss.uPC));
+			debug_printf("TEV_DATA_HTAB_MISS\n");
+			debug_printf("ThreadID = 0x%llX, PC = 0x%llX\n", tev.tid, tev.pc);
 
 			ev.eid     = EXCEPTION;
 			ev.pid     = ProcessID;
-			ev.tid     = bswap64(pDbgData->ppu_exc_data_htab_miss.uPPUThreadID);
+			ev.tid     = tev.tid;
 			ev.ea      = BADADDR;
 			ev.handled = true;
 			ev.exc.code = 0;
 			ev.exc.can_cont = false;
-			ev.exc.ea = bswap64(pDbgData->ppu_exc_data_htab_miss.uPC);
+			ev.exc.ea = tev.pc;
 			qstrncpy(ev.exc.info, "data storage interrupt", sizeof(ev.exc.info));
 			
-			events.enqueue(ev, IN_BACK);
+			post_event(ev);
 
 		}
 		break;
 
-	case SNPS3_DBG_EVENT_PPU_EXP_FLOAT:
+	case TEV_FLOAT:
 		{
-			debug_printf("SNPS3_DBG_EVENT_PPU_EXP_FLOAT\n");
-			debug_printf("ThreadID = 0x%llX, PC = 0x%llX\n", bswap64(pDbgData->ppu_exc_float.uPPUThreadID), bswap64(pDbgData->ppu_exc_float.uPC));
+			debug_printf("TEV_FLOAT\n");
+			debug_printf("ThreadID = 0x%llX, PC = 0x%llX\n", tev.tid, tev.pc);
 
 			ev.eid     = EXCEPTION;
 			ev.pid     = ProcessID;
-			ev.tid     = bswap64(pDbgData->ppu_exc_float.uPPUThreadID);
+			ev.tid     = tev.tid;
 			ev.ea      = BADADDR;
 			ev.handled = true;
 			ev.exc.code = 0;
 			ev.exc.can_cont = true;
-			ev.exc.ea = bswap64(pDbgData->ppu_exc_float.uPC);
+			ev.exc.ea = tev.pc;
 			qstrncpy(ev.exc.info, "floating point enabled exception", sizeof(ev.exc.info));
 			
-			events.enqueue(ev, IN_BACK);
+			post_event(ev);
 
 		}
 		break;
 
-	case SNPS3_DBG_EVENT_PPU_EXP_DATA_SLB_MISS:
+	case TEV_DATA_SLB_MISS:
 		{
-			debug_printf("SNPS3_DBG_EVENT_PPU_EXP_DATA_SLB_MISS\n");
-			debug_printf("ThreadID = 0x%llX, PC = 0x%llX\n", bswap64(pDbgData->ppu_exc_data_slb_miss.uPPUThreadID), bswap64(pDbgData->ppu_exc_data_slb_miss.uPC));
+			debug_printf("TEV_DATA_SLB_MISS\n");
+			debug_printf("ThreadID = 0x%llX, PC = 0x%llX\n", tev.tid, tev.pc);
 
 			ev.eid     = EXCEPTION;
 			ev.pid     = ProcessID;
-			ev.tid     = bswap64(pDbgData->ppu_exc_data_slb_miss.uPPUThreadID);
+			ev.tid     = tev.tid;
 			ev.ea      = BADADDR;
 			ev.handled = true;
 			ev.exc.code = 0;
 			ev.exc.can_cont = false;
-			ev.exc.ea = bswap64(pDbgData->ppu_exc_data_slb_miss.uPC);
+			ev.exc.ea = tev.pc;
 			qstrncpy(ev.exc.info, "data segment interrupt", sizeof(ev.exc.info));
 			
-			events.enqueue(ev, IN_BACK);
+			post_event(ev);
 
 		}
 		break;
 
-	case SNPS3_DBG_EVENT_PPU_EXP_DABR_MATCH:
+	case TEV_DABR_MATCH:
 		{
-			debug_printf("-> SNPS3_DBG_EVENT_PPU_EXP_DABR_MATCH <-\n");
+			debug_printf("-> TEV_DABR_MATCH <-\n");
 
-			debug_printf("ThreadID = 0x%llX, PC = 0x%llX\n", bswap64(pDbgData->ppu_exc_dabr_match.uPPUThreadID), bswap64(pDbgData->ppu_exc_dabr_match.uPC));
+			debug_printf("ThreadID = 0x%llX, PC = 0x%llX\n", tev.tid, tev.pc);
 
-			if (target_event.uEventType == SNPS3_DBG_EVENT_PPU_EXP_DABR_MATCH)
+			if (last_target_event == TEV_DABR_MATCH)
 				break;
 			
 			ev.eid     = BREAKPOINT;
 			ev.pid     = ProcessID;
-			ev.tid     = bswap64(pDbgData->ppu_exc_dabr_match.uPPUThreadID);
-			ev.ea      = bswap64(pDbgData->ppu_exc_dabr_match.uPC);
+			ev.tid     = tev.tid;
+			ev.ea      = tev.pc;
 			ev.handled = true;
 			ev.bpt.hea = dabr_addr;
 			ev.bpt.kea = BADADDR;
 			ev.exc.ea  = BADADDR;
 			
-			events.enqueue(ev, IN_BACK);
+			post_event(ev);
 		}
 		break;
 
 	//! Notification that a PPU thread was stopped by DBGP_STOP_PPU_THREAD.
-	case SNPS3_DBG_EVENT_PPU_EXP_STOP:
+	case TEV_STOP:
 		{
-			debug_printf("SNPS3_DBG_EVENT_PPU_EXP_STOP\n");
+			debug_printf("TEV_STOP\n");
 
-			debug_printf("ThreadID = 0x%llX, PC = 0x%llX\n", bswap64(pDbgData->ppu_exc_stop.uPPUThreadID), bswap64(pDbgData->ppu_exc_stop.uPC));
+			debug_printf("ThreadID = 0x%llX, PC = 0x%llX\n", tev.tid, tev.pc);
 
-			//suspend_thread(bswap64(pDbgData->ppu_exc_stop.uPPUThreadID));
+			//suspend_thread(tev.tid);
 
 		}
 		break;
 
 	//! Notification that a primary PPU thread was stopped at entry point after process was created.
-	case SNPS3_DBG_EVENT_PPU_EXP_STOP_INIT:
+	case TEV_STOP_INIT:
 		{
-			debug_printf("SNPS3_DBG_EVENT_PPU_EXP_STOP_INIT\n");
-			//pDbgData->ppu_exc_stop_init;
+			debug_printf("TEV_STOP_INIT\n");
 		}
 		break;
 
 	//! Notification that a memory access trap interrupt occurred.
-	case SNPS3_DBG_EVENT_PPU_EXC_DATA_MAT:
+	case TEV_DATA_MAT:
 		{
-			debug_printf("SNPS3_DBG_EVENT_PPU_EXC_DATA_MAT\n");
-			//pDbgData->ppu_exc_data_mat;
+			debug_printf("TEV_DATA_MAT\n");
 		}
 		break;
 
-	case SNPS3_DBG_EVENT_PPU_THREAD_CREATE:
+	case TEV_THREAD_CREATE:
 		{
-			debug_printf("SNPS3_DBG_EVENT_PPU_THREAD_CREATE\n");
+			debug_printf("TEV_THREAD_CREATE\n");
 
-			debug_printf("ThreadID = 0x%llX\n", bswap64(pDbgData->ppu_thread_create.uPPUThreadID));
+			debug_printf("ThreadID = 0x%llX\n", tev.tid);
 
 			ev.eid     = THREAD_START;
 			ev.pid     = ProcessID;
-			ev.tid     = bswap64(pDbgData->ppu_thread_create.uPPUThreadID);
+			ev.tid     = tev.tid;
 			ev.ea      = BADADDR;
 			ev.handled = true;
 
-			events.enqueue(ev, IN_BACK);
+			post_event(ev);
+
+			// its info is fetched when the thread is first asked about
+			thread_table.add(tev.tid);
+
+			// and its stack has been mapped
+			memory_map.vm_stale = true;
 
 		}
 		break;
 
-	case SNPS3_DBG_EVENT_PPU_THREAD_EXIT:
+	case TEV_THREAD_EXIT:
 		{
-			debug_printf("SNPS3_DBG_EVENT_PPU_THREAD_EXIT\n");
+			debug_printf("TEV_THREAD_EXIT\n");
 
-			debug_printf("ThreadID = 0x%llX\n", bswap64(pDbgData->ppu_thread_exit.uPPUThreadID));
+			debug_printf("ThreadID = 0x%llX\n", tev.tid);
 
 			ev.eid     = THREAD_EXIT;
 			ev.pid     = ProcessID;
-			ev.tid     = bswap64(pDbgData->ppu_thread_exit.uPPUThreadID);
+			ev.tid     = tev.tid;
 			ev.ea      = BADADDR;
 			ev.handled = true;
 			ev.exit_code = 0;
 
-			events.enqueue(ev, IN_BACK);
+			post_event(ev);
+
+			if (thread_table.remove(tev.tid))
+				memory_map.stale = true;
+
+			memory_map.vm_stale = true;
 
 		}
 		break;
 
-	case SNPS3_DBG_EVENT_PRX_LOAD:
+	case TEV_MODULE_LOAD:
 		{
-			debug_printf("SNPS3_DBG_EVENT_PRX_LOAD\n");
-
-			debug_printf("ThreadID = 0x%llX, ModuleID = 0x%X\n", bswap64(pDbgData->prx_load.uPPUThreadID), bswap32(pDbgData->prx_load.uPRXID));
+			debug_printf("TEV_MODULE_LOAD\n");
 
-			uint64 ModuleInfoSize = 1024;
-			SNPS3MODULEINFO *ModuleInfo;
+			debug_printf("ThreadID = 0x%llX, ModuleID = 0x%X\n", tev.tid, (uint32)tev.arg);
 
-			ModuleInfo = (SNPS3MODULEINFO *)malloc(ModuleInfoSize);
+			target_module_t mod;
 
-			SNPS3GetModuleInfo(TargetID, ProcessID, bswap32(pDbgData->prx_load.uPRXID), &ModuleInfoSize, ModuleInfo);
+			if (!backend->get_module_info((uint32)tev.arg, &mod))
+			{
+				msg("GetModuleInfo Error: %d\n", backend->error());
+				break;
+			}
 
 			ev.eid     = LIBRARY_LOAD;
 			ev.pid     = ProcessID;
-			ev.tid     = bswap64(pDbgData->prx_load.uPPUThreadID);
+			ev.tid     = tev.tid;
 			ev.ea      = BADADDR;
 			ev.handled = true;
 			
-			_snprintf(ev.modinfo.name, MAXSTR, "%s - %s", ModuleInfo->Hdr.aElfName, ModuleInfo->Hdr.aName);
+			qstrncpy(ev.modinfo.name, mod.name.c_str(), sizeof(ev.modinfo.name));
 			
-			ev.modinfo.base = ModuleInfo->Segments->uBase;
-			ev.modinfo.size = ModuleInfo->Segments->uMemSize;
+			ev.modinfo.base = mod.segments.empty() ? BADADDR : (ea_t)mod.segments[0].base;
+			ev.modinfo.size = mod.segments.empty() ? 0 : (asize_t)mod.segments[0].mem_size;
 			ev.modinfo.rebase_to = BADADDR;
 			
-			events.enqueue(ev, IN_BACK);
+			post_event(ev, (uint32)tev.arg);
 
-			modules[bswap32(pDbgData->prx_load.uPRXID)] = ev.modinfo.name;
+			modules[(uint32)tev.arg] = ev.modinfo.name;
 
-			free(ModuleInfo);
+			memory_map.modules[(uint32)tev.arg] = mod;
+			memory_map.stale = true;
+			memory_map.vm_stale = true;
 		}
 		break;
 
-	case SNPS3_DBG_EVENT_PRX_UNLOAD:
+	case TEV_MODULE_UNLOAD:
 		{
-			debug_printf("SNPS3_DBG_EVENT_PRX_UNLOAD\n");
+			debug_printf("TEV_MODULE_UNLOAD\n");
 
-			debug_printf("ThreadID = 0x%llX, ModuleID = 0x%X\n", bswap64(pDbgData->prx_unload.uPPUThreadID), bswap32(pDbgData->prx_unload.uPRXID));
+			debug_printf("ThreadID = 0x%llX, ModuleID = 0x%X\n", tev.tid, (uint32)tev.arg);
 
 			ev.eid     = LIBRARY_UNLOAD;
 			ev.pid     = ProcessID;
-			ev.tid     = bswap64(pDbgData->prx_unload.uPPUThreadID);
+			ev.tid     = tev.tid;
 			ev.ea      = BADADDR;
 			ev.handled = true;
 			
-			qstrncpy(ev.info, modules[bswap32(pDbgData->prx_unload.uPRXID)].c_str(), sizeof(ev.info));
+			qstrncpy(ev.info, modules[(uint32)tev.arg].c_str(), sizeof(ev.info));
+
+			post_event(ev, (uint32)tev.arg);
 
-			events.enqueue(ev, IN_BACK);
+			modules.erase((uint32)tev.arg);
+			memory_map.modules.erase((uint32)tev.arg);
+			memory_map.stale = true;
+			memory_map.vm_stale = true;
 
-			modules.erase(bswap32(pDbgData->prx_unload.uPRXID));
+			// another module may be loaded at the same place
+			insn_cache.clear();
 		}
 		break;
 
-	}
-}
+	case TEV_STEP:
+		{
+			debug_printf("TEV_STEP\n");
 
-//--------------------------------------------------------------------------
-//  Prints details of received target events.
-static void ProcessTargetEvent(HTARGET hTarget, uint uDataLen, byte *pData)
-{
-	uint uDataRemaining = uDataLen;
+			debug_printf("ThreadID = 0x%llX, PC = 0x%llX\n", tev.tid, tev.pc);
 
-	while (uDataRemaining)
-	{
-		SN_EVENT_TARGET_HDR *pHeader = (SN_EVENT_TARGET_HDR *)pData;
+			if (singlestep == true || continue_from_bp == true)
+				step_done(tev);
+		}
+		break;
 
-		switch (pHeader->uEvent)
+	case TEV_SPU_THREAD_START:
 		{
-		case SN_TGT_EVENT_TARGET_SPECIFIC:
+			debug_printf("TEV_SPU_THREAD_START\n");
+
+			debug_printf("SPU ThreadID = 0x%llX, GroupID = 0x%X\n", tev.tid, (uint32)tev.arg);
+
+			if (!SpuThreads)
+				break;
+
+			target_spu_group_t info;
+
+			if (!backend->get_spu_group_info((uint32)tev.arg, &info))
 			{
-				ProcessTargetSpecificEvent(pHeader->uSize, pData + sizeof(SN_EVENT_TARGET_HDR));
+				msg("SPUThreadGroupInfo Error: %d\n", backend->error());
+				break;
+			}
+
+			// the first thread of a group to start brings in the others
+			std::vector<uint32> added, removed;
+			spu_table.update_group(info, &added, &removed);
+
+			post_spu_threads(added, removed, false);
+		}
+		break;
+
+	case TEV_SPU_THREAD_STOP:
+		{
+			debug_printf("TEV_SPU_THREAD_STOP\n");
+
+			debug_printf("SPU ThreadID = 0x%llX, NPC = 0x%llX, Reason = 0x%X\n", tev.tid, tev.pc, (uint32)tev.arg);
 
-				memcpy(&target_event, pData + sizeof(SN_EVENT_TARGET_HDR) + sizeof(SNPS3_DBG_EVENT_HDR), 0x20);
+			const spu_thread_t *t = spu_table.find((uint32)tev.tid);
 
+			if (t == NULL)
 				break;
+
+			uint32 status = (uint32)tev.arg;
+			ea_t ea = (ea_t)(spu_table.window(*t) + (tev.pc & (SPU_LS_SIZE - 4)));
+
+			ev.pid     = ProcessID;
+			ev.tid     = tev.tid;
+			ev.handled = true;
+
+			// exits and signals to the PPU are how SPU threads work, only
+			// faults and breakpoints are worth stopping for
+			if (spu_stop_abnormal(status))
+			{
+				ev.eid     = EXCEPTION;
+				ev.ea      = BADADDR;
+				ev.exc.code = status;
+				ev.exc.can_cont = true;
+				ev.exc.ea = ea;
+				qsnprintf(ev.exc.info, sizeof(ev.exc.info), "SPU thread stopped (status 0x%X)", status);
 			}
+			else
+			{
+				uint32 code = SPU_STOP_CODE(status);
+
+				ev.eid     = INFORMATION;
+				ev.ea      = ea;
+
+				if ((status & SPU_STATUS_STOP_SIGNAL) && (code == SPU_STOP_GROUP_EXIT || code == SPU_STOP_THREAD_EXIT))
+					qsnprintf(ev.info, sizeof(ev.info), "SPU thread 0x%X exited", (uint32)tev.tid);
+				else
+					qsnprintf(ev.info, sizeof(ev.info), "SPU thread 0x%X stopped (status 0x%X)", (uint32)tev.tid, status);
+			}
+
+			post_event(ev);
+
 		}
+		break;
 
-		uDataRemaining -= pHeader->uSize;
-		pData += pHeader->uSize;
-	}
-}
+	case TEV_SPU_GROUP_DESTROY:
+		{
+			debug_printf("TEV_SPU_GROUP_DESTROY\n");
 
-//--------------------------------------------------------------------------
-//  Process target event notifications.
-static void __stdcall TargetEventCallback(HTARGET hTarget, uint uEventType, uint /*uEvent*/, 
-						 SNRESULT snr, uint uDataLen, byte *pData, void* /*pUser*/)
-{
-	if (SN_FAILED( snr ))
-		return;
+			debug_printf("GroupID = 0x%X\n", (uint32)tev.arg);
 
-	switch (uEventType)
-	{
-	case SN_EVENT_TARGET:
-		ProcessTargetEvent(hTarget, uDataLen, pData);
+			std::vector<uint32> added, removed;
+			spu_table.remove_group((uint32)tev.arg, &removed);
+
+			post_spu_threads(added, removed, false);
+		}
 		break;
+
 	}
+
+	last_target_event = tev.type;
 }
 
 //--------------------------------------------------------------------------
 // Initialize debugger
 static bool idaapi init_debugger(const char *hostname, int port_num, const char *password)
 {
-	SNRESULT snr = SN_S_OK;
+	if (ReplaySession != NULL)
+		backend = new replay_backend_t(ReplaySession);
+	else
+		backend = UseSimulator ? new sim_backend_t : create_tmapi_backend();
 
-	if (SN_FAILED( snr = SNPS3InitTargetComms() ))
-	{
-		msg("Failed to initialize PS3TM SDK\n");
-		return false;
-	}
+	if (RecordSession != NULL && ReplaySession == NULL)
+		backend = new record_backend_t(backend, RecordSession);
 
-	if (!SetUpTarget() || !ConnectToActiveTarget())
+	if (!backend->open())
 	{
-		msg("Error connecting to target %s!\n", UTF8ToWChar(TargetName).c_str());
+		delete backend;
+		backend = NULL;
 		return false;
 	}
 
-	SNPS3RegisterTargetEventHandler(TargetID, TargetEventCallback, NULL);
+	backend->set_event_handler(on_target_event, NULL);
 
-	set_idc_func_ex("threadlst", idc_threadlst, idc_threadlst_args, 0);
+	memory_map.threads = &thread_table;
+	memory_map.spus = &spu_table;
+	spu_table.base = SpuLsBase;
+
+	event_trace.init(EventTraceSize);
+
+	hw_step_available = true;
+	hw_step_tid = 0;
+	range_start = range_end = 0;
+	range_tid = 0;
+	trace_path.clear();
+	trace_tid = 0;
+
+	start_event_pump();
+
+	for (int i = 0; i < qnumber(registers); i++)
+	{
+		registers_id[i] = i;
+		registers_class[i] = registers[i].register_class;
+	}
+
+	regcache.init(registers_id, registers_class, qnumber(registers));
+
+	set_idc_func_ex("threadlst", idc_threadlst, idc_threadlst_args, 0);
+	set_idc_func_ex("memcache", idc_memcache, idc_memcache_args, 0);
+	set_idc_func_ex("bpsync", idc_bpsync, idc_bpsync_args, 0);
+	set_idc_func_ex("dabrsync", idc_dabrsync, idc_dabrsync_args, 0);
+	set_idc_func_ex("evtrace", idc_evtrace, idc_evtrace_args, 0);
+	set_idc_func_ex("tmstats", idc_tmstats, idc_tmstats_args, 0);
+	set_idc_func_ex("stepstats", idc_stepstats, idc_stepstats_args, 0);
+	set_idc_func_ex("rangestep", idc_rangestep, idc_rangestep_args, 0);
+	set_idc_func_ex("branchtrace", idc_branchtrace, idc_branchtrace_args, 0);
+	set_idc_func_ex("tracereplay", idc_tracereplay, idc_tracereplay_args, 0);
+	set_idc_func_ex("spuregs", idc_spuregs, idc_spuregs_args, 0);
 
 	return true;
 }
@@ -1246,20 +1244,27 @@ static bool idaapi init_debugger(const char *hostname, int port_num, const char
 // Terminate debugger
 static bool idaapi term_debugger(void)
 {
-	// Do post stuff like disconnecting from target
-	if (AlwaysDC || (!WasOriginallyConnected))
-	{
-		if (TargetID != 0xffffffff)
-		{
-			SNPS3Disconnect(TargetID);
-			debug_printf("Disconnect\n");
-		}
-	}
+	stop_event_pump();
+
+	flush_pending_writes();
 
-	SNPS3CloseTargetComms();
-	//SNPS3Exit();
+	backend->close();
+	delete backend;
+	backend = NULL;
 
 	set_idc_func_ex("threadlst", NULL, idc_threadlst_args, 0);
+	set_idc_func_ex("memcache", NULL, idc_memcache_args, 0);
+	set_idc_func_ex("bpsync", NULL, idc_bpsync_args, 0);
+	set_idc_func_ex("dabrsync", NULL, idc_dabrsync_args, 0);
+	set_idc_func_ex("evtrace", NULL, idc_evtrace_args, 0);
+	set_idc_func_ex("tmstats", NULL, idc_tmstats_args, 0);
+	set_idc_func_ex("stepstats", NULL, idc_stepstats_args, 0);
+	set_idc_func_ex("rangestep", NULL, idc_rangestep_args, 0);
+	set_idc_func_ex("branchtrace", NULL, idc_branchtrace_args, 0);
+	set_idc_func_ex("tracereplay", NULL, idc_tracereplay_args, 0);
+	set_idc_func_ex("spuregs", NULL, idc_spuregs_args, 0);
+
+	memcache.flush();
 
 	return true;
 }
@@ -1267,125 +1272,373 @@ static bool idaapi term_debugger(void)
 //--------------------------------------------------------------------------
 int idaapi process_get_info(int n, process_info_t *info)
 {
-	uint32 NumProcesses;
-	uint32* ProcessesList;
-	SNPS3PROCESSINFO* ProcessesInfo;
-	uint32 ProcessesInfoSize;
-	SNRESULT snr = SN_S_OK;
-	char* p;
+	std::lock_guard<std::recursive_mutex> guard(dispatch_lock);
 
-	if (SN_FAILED( snr = SNPS3ProcessList(TargetID, &NumProcesses, NULL)))
+	// the list is fetched once per enumeration
+	if (n == 0)
 	{
-		debug_printf("SNPS3ProcessList Error: %d\n", snr);
-		return 0;
+		process_list.clear();
+
+		if (!backend->get_processes(&process_list))
+		{
+			debug_printf("ProcessList Error: %d\n", backend->error());
+			return 0;
+		}
 	}
 
-	if (n > int(NumProcesses - 1))
+	if (n >= int(process_list.size()))
 		return 0;
 
-	ProcessesList = (uint32 *)malloc(NumProcesses * sizeof(uint32));
+	const target_process_t &p = process_list[n];
+
+	info->pid = p.pid;
+	qstrncpy(info->name, p.path.c_str(), sizeof(info->name));
+
+	process_names[p.pid] = p.path.substr(p.path.rfind('/') + 1);
 
-	if (SN_FAILED( snr = SNPS3ProcessList(TargetID, &NumProcesses, ProcessesList)))
+	return 1;
+}
+
+static const char *get_state_name(uint32 State)
+{
+	switch ( State )
 	{
-		debug_printf("SNPS3ProcessList Error: %d\n", snr);
-		return 0;
+		case TSTATE_IDLE:			return "IDLE";
+		case TSTATE_RUNNABLE:        return "RUNNABLE";
+		case TSTATE_ONPROC:			return "ONPROC";
+		case TSTATE_SLEEP:			return "SLEEP";
+		case TSTATE_SUSPENDED:       return "SUSPENDED";
+		case TSTATE_SLEEP_SUSPENDED: return "SLEEP_SUSPENDED";
+		case TSTATE_STOP:			return "STOP";
+		case TSTATE_ZOMBIE:			return "ZOMBIE";
+		case TSTATE_DELETED:			return "DELETED";
+		default:						return "???";
 	}
+}
+
+static error_t idaapi idc_threadlst(idc_value_t *argv, idc_value_t *res)
+{
+	std::lock_guard<std::recursive_mutex> guard(dispatch_lock);
+
+	get_threads_info();
+	return eOk;
+}
+
+static error_t idaapi idc_memcache(idc_value_t *argv, idc_value_t *res)
+{
+	std::lock_guard<std::recursive_mutex> guard(dispatch_lock);
+
+	msg("Memory cache: %u hits, %u misses, %u pages cached\n", memcache.hits, memcache.misses, (uint32)memcache.size());
+	msg("Write combiner: %u writes, %u transfers, %u bytes pending\n", pending_writes.writes, pending_writes.transfers, (uint32)pending_writes.size());
+	msg("Instruction cache: %u hits, %u misses, %u instructions decoded\n", insn_cache.hits, insn_cache.misses, (uint32)insn_cache.size());
+	msg("SPU snapshots: %u reads, %u local stores and %u register sets fetched\n", spu_table.reads, spu_table.ls_fetches, spu_table.reg_fetches);
+	return eOk;
+}
+
+static error_t idaapi idc_bpsync(idc_value_t *argv, idc_value_t *res)
+{
+	std::lock_guard<std::recursive_mutex> guard(dispatch_lock);
 
-	snr = SNPS3ProcessInfo(TargetID, ProcessesList[n], &ProcessesInfoSize, NULL);
+	reconcile_bpts();
+	return eOk;
+}
 
-	ProcessesInfo = (SNPS3PROCESSINFO *)malloc(ProcessesInfoSize);
+// Program a deferred watchpoint right away, stopping the process if needed
+static error_t idaapi idc_dabrsync(idc_value_t *argv, idc_value_t *res)
+{
+	std::lock_guard<std::recursive_mutex> guard(dispatch_lock);
 
-	if (SN_FAILED( snr = SNPS3ProcessInfo(TargetID, ProcessesList[n], &ProcessesInfoSize, ProcessesInfo)))
+	if (dabr_pending)
 	{
-		debug_printf("SNPS3ProcessInfo Error: %d\n", snr);
-		return 0;
+		bool force = ForceImmediateDABR;
+
+		ForceImmediateDABR = true;
+		set_dabr(dabr_value);
+		ForceImmediateDABR = force;
 	}
 
-	info->pid = ProcessesList[n];
-	qstrncpy(info->name, ProcessesInfo->Hdr.szPath, sizeof(info->name));
+	return eOk;
+}
+
+// Save the event trace to a file, an empty name just clears it
+static error_t idaapi idc_evtrace(idc_value_t *argv, idc_value_t *res)
+{
+	std::lock_guard<std::recursive_mutex> guard(dispatch_lock);
 
-	p = strrchr(ProcessesInfo->Hdr.szPath, '/');
-	process_names[ProcessesList[n]] = p + 1;
+	const char *path = argv[0].c_str();
 
-	free(ProcessesInfo);
+	if (path[0] != '\0')
+	{
+		int count = event_trace.save(path);
 
-	free(ProcessesList);
+		if (count < 0)
+			msg("Can't write event trace to %s\n", path);
+		else
+			msg("%d events written to %s\n", count, path);
 
-	return 1;
+		res->set_long(count);
+	}
+
+	event_trace.clear();
+
+	return eOk;
 }
 
-static const char *get_state_name(uint32 State)
+// Print the TMAPI call statistics, reset them if the argument is not 0
+static error_t idaapi idc_tmstats(idc_value_t *argv, idc_value_t *res)
 {
-	switch ( State )
+	std::vector<tmapi_stat_record_t> stats;
+
+	std::lock_guard<std::recursive_mutex> guard(dispatch_lock);
+
+	tmapi_stats.get(&stats);
+
+	msg("%-32s %10s %12s %10s %8s %8s %8s %10s\n", "TMAPI call", "calls", "bytes", "avg us", "p50", "p90", "p99", "max us");
+
+	for (size_t i = 0; i < stats.size(); i++)
 	{
-		case SNPS3_PPU_IDLE:			return "IDLE";
-		case SNPS3_PPU_RUNNABLE:        return "RUNNABLE";
-		case SNPS3_PPU_ONPROC:			return "ONPROC";
-		case SNPS3_PPU_SLEEP:			return "SLEEP";
-		case SNPS3_PPU_SUSPENDED:       return "SUSPENDED";
-		case SNPS3_PPU_SLEEP_SUSPENDED: return "SLEEP_SUSPENDED";
-		case SNPS3_PPU_STOP:			return "STOP";
-		case SNPS3_PPU_ZOMBIE:			return "ZOMBIE";
-		case SNPS3_PPU_DELETED:			return "DELETED";
-		default:						return "???";
+		const tmapi_stat_record_t &r = stats[i];
+
+		msg("%-32s %10llu %12llu %10llu %8u %8u %8u %10llu\n", r.name, r.calls, r.bytes, r.total_us / r.calls, r.p50_us, r.p90_us, r.p99_us, r.max_us);
 	}
+
+	msg("%llu event polls (SNPS3Kick), not counted above\n", tmapi_stats.get_kicks());
+
+	if (argv[0].num != 0)
+		tmapi_stats.reset();
+
+	return eOk;
 }
 
-static error_t idaapi idc_threadlst(idc_value_t *argv, idc_value_t *res)
+// Print how many steps took each path, reset the counts if the argument is not 0
+static error_t idaapi idc_stepstats(idc_value_t *argv, idc_value_t *res)
 {
-	get_threads_info();
+	std::lock_guard<std::recursive_mutex> guard(dispatch_lock);
+
+	for (int i = 0; i < STEP_PATH_COUNT; i++)
+		msg("%-10s %u steps\n", step_path_names[i], step_counts[i]);
+
+	msg("Hardware step %s\n", !HardwareStep ? "disabled" : hw_step_available ? "available" : "not supported by the target");
+	msg("%u resumes inside stepped ranges\n", range_resumes);
+
+	if (argv[0].num != 0)
+	{
+		memset(step_counts, 0, sizeof(step_counts));
+		range_resumes = 0;
+	}
+
 	return eOk;
 }
 
-void get_threads_info(void)
+// Have the next step run until the PC leaves [start, end), stepping over
+// the calls if the third argument is not 0. An empty range disarms it.
+static error_t idaapi idc_rangestep(idc_value_t *argv, idc_value_t *res)
 {
-	uint32 NumPPUThreads;
-	uint32 NumSPUThreadGroups;
-	uint64 *PPUThreadIDs;
-	uint64 *SPUThreadGroupIDs;
-	uint32 ThreadInfoSize = 1024;
-	SNPS3_PPU_THREAD_INFO *ThreadInfo;
-	SNRESULT snr = SN_S_OK;
-	debug_event_t ev;
+	std::lock_guard<std::recursive_mutex> guard(dispatch_lock);
+
+	range_start = (uint32)argv[0].num;
+	range_end = (uint32)argv[1].num;
+	range_over_calls = argv[2].num != 0;
 
-	SNPS3ThreadList(TargetID, ProcessID, &NumPPUThreads, NULL, &NumSPUThreadGroups, NULL);
+	if (range_end > range_start)
+		msg("Next step runs until the PC leaves 0x%X..0x%X\n", range_start, range_end);
 
-	PPUThreadIDs = (uint64 *)malloc(NumPPUThreads * sizeof(uint64));
-	SPUThreadGroupIDs = (uint64 *)malloc(NumSPUThreadGroups * sizeof(uint64));
+	return eOk;
+}
 
-	SNPS3ThreadList(TargetID, ProcessID, &NumPPUThreads, PPUThreadIDs, &NumSPUThreadGroups, SPUThreadGroupIDs);
+// Have the next step trace up to 'count' instructions of the thread to the
+// file, or until it reaches the third argument if not 0. An empty name disarms it.
+static error_t idaapi idc_branchtrace(idc_value_t *argv, idc_value_t *res)
+{
+	std::lock_guard<std::recursive_mutex> guard(dispatch_lock);
 
-	ThreadInfo = (SNPS3_PPU_THREAD_INFO *)malloc(ThreadInfoSize);
+	trace_path = argv[0].c_str();
+	trace_max_insns = (uint64)argv[1].num;
+	trace_stop_ea = argv[2].num != 0 ? (uint32)argv[2].num : BADADDR;
 
-	//debug_printf(" === PPU THREAD INFO === \n");
+	if (!trace_path.empty())
+		msg("Next step traces up to %llu instructions to %s\n", trace_max_insns, trace_path.c_str());
+
+	return eOk;
+}
+
+// Add the instructions of a branch trace to the trace of IDA
+static error_t idaapi idc_tracereplay(idc_value_t *argv, idc_value_t *res)
+{
+	btrace_reader_t trace;
+	uint64 ea;
+	uint32 count = 0;
+
+	if (!trace.open(argv[0].c_str()))
+	{
+		msg("%s is not a branch trace\n", argv[0].c_str());
+		res->num = -1;
+		return eOk;
+	}
+
+	while (trace.next(&ea))
+	{
+		if (!add_tev(tev_insn, (thid_t)trace.header.tid, (ea_t)ea))
+			break;
+
+		count++;
+	}
+
+	if (trace.truncated())
+		msg("%s is truncated\n", argv[0].c_str());
+
+	msg("%u instructions of thread 0x%llX added to the trace\n", count, trace.header.tid);
 
-	for(uint32 i=0;i<NumPPUThreads;i++) {
+	res->num = count;
+	return eOk;
+}
+
+static error_t idaapi idc_spuregs(idc_value_t *argv, idc_value_t *res)
+{
+	std::lock_guard<std::recursive_mutex> guard(dispatch_lock);
 
-		ThreadInfoSize = 1024;
+	uint32 tid = (uint32)argv[0].num;
+	const spu_thread_t *t = spu_table.find(tid);
+
+	res->num = 0;
+
+	if (t == NULL)
+	{
+		msg("0x%X is not an SPU thread\n", tid);
+		return eOk;
+	}
 
-		if (SN_FAILED( snr = SNPS3ThreadInfo(TargetID, PS3_UI_CPU, ProcessID, PPUThreadIDs[i], &ThreadInfoSize, (byte *)ThreadInfo)))
+	const uint8 *regs = spu_table.registers(tid, backend);
+
+	if (regs == NULL)
+	{
+		msg("SPU ThreadGetRegisters Error: %d\n", backend->error());
+		return eOk;
+	}
+
+	msg("SPU thread 0x%X, NPC: 0x%05X, FPSCR: 0x%08X, Status: 0x%08X\n", tid, spu_word(regs, SREG_NPC), spu_word(regs, SREG_FPSCR), spu_word(regs, SREG_STATUS));
+
+	for (int r = 0; r < 128; r++)
+	{
+		const uint8 *p = regs + (SREG_GPR0 + r) * TREG_SLOT_SIZE;
+
+		msg("  r%-3d %02X%02X%02X%02X %02X%02X%02X%02X %02X%02X%02X%02X %02X%02X%02X%02X\n", r,
+			p[0], p[1], p[2], p[3], p[4], p[5], p[6], p[7], p[8], p[9], p[10], p[11], p[12], p[13], p[14], p[15]);
+	}
+
+	res->num = 1;
+	return eOk;
+}
+
+static const char *get_group_state_name(uint32 State)
+{
+	switch ( State )
+	{
+		case SGSTATE_NOT_CONFIGURED:    return "NOT_CONFIGURED";
+		case SGSTATE_CONFIGURED:        return "CONFIGURED";
+		case SGSTATE_READY:             return "READY";
+		case SGSTATE_WAITING:           return "WAITING";
+		case SGSTATE_SUSPENDED:         return "SUSPENDED";
+		case SGSTATE_WAITING_SUSPENDED: return "WAITING_SUSPENDED";
+		case SGSTATE_RUNNING:           return "RUNNING";
+		case SGSTATE_STOPPED:           return "STOPPED";
+		default:                        return "???";
+	}
+}
+
+// List the SPU thread groups, the group ids came with the thread list
+static void get_spu_threads_info(void)
+{
+	std::vector<uint32> ids;
+	std::vector<uint32> added, removed;
+	target_spu_group_t info;
+
+	if (!SpuThreads)
+		return;
+
+	if (!backend->get_spu_groups(&ids))
+	{
+		msg("SPUThreadGroupList Error: %d\n", backend->error());
+		return;
+	}
+
+	spu_table.sync(ids, &removed);
+
+	for (uint32 i = 0; i < ids.size(); i++)
+	{
+		if (!backend->get_spu_group_info(ids[i], &info))
+		{
+			msg("SPUThreadGroupInfo Error: %d\n", backend->error());
+			continue;
+		}
+
+		spu_table.update_group(info, &added, &removed);
+
+		msg("[%d] SPU ThreadGroupID: 0x%X, State: %s, Name: %s\n", i, info.id, get_group_state_name(info.state), info.name.c_str());
+
+		for (size_t j = 0; j < info.threads.size(); j++)
+		{
+			const spu_thread_t *t = spu_table.find(info.threads[j]);
+
+			if (t != NULL)
+				msg("     SPU ThreadID: 0x%X, LS: 0x%llX\n", t->tid, spu_table.window(*t));
+		}
+	}
+
+	post_spu_threads(added, removed, attaching);
+}
+
+void get_threads_info(void)
+{
+	std::vector<uint64> tids;
+	target_thread_t info;
+	debug_event_t ev;
+
+	if (!backend->get_threads(&tids))
+	{
+		msg("ThreadList Error: %d\n", backend->error());
+		return;
+	}
+
+	std::vector<uint64> added;
+	thread_table.sync(tids, &added);
+	memory_map.stale = true;
+
+	//debug_printf(" === PPU THREAD INFO === \n");
+
+	for(uint32 i=0;i<tids.size();i++) {
+
+		if (!backend->get_thread_info(tids[i], &info))
 		{
-			msg("SNPS3ThreadInfo Error: %d\n", snr);
+			msg("ThreadInfo Error: %d\n", backend->error());
 
 		} else {
 
-			msg("[%d] ThreadID: 0x%llX, State: %s, Name: %s\n", i, ThreadInfo->uThreadID, get_state_name(ThreadInfo->uState), (const char*)(ThreadInfo + 1));
+			msg("[%d] ThreadID: 0x%llX, State: %s, Name: %s\n", i, info.tid, get_state_name(info.state), info.name.c_str());
+
+			thread_table.update(info);
+
+			int snap = thread_snapshot.find(info.tid);
+			if (snap >= 0)
+			{
+				msg("     PC: 0x%llX, LR: 0x%llX, SP: 0x%llX, CTR: 0x%llX\n", thread_snapshot.pc[snap], thread_snapshot.lr[snap], thread_snapshot.sp[snap], thread_snapshot.ctr[snap]);
+			}
 
 			if (attaching == true) 
 			{
 				ev.eid     = THREAD_START;
 				ev.pid     = ProcessID;
-				ev.tid     = ThreadInfo->uThreadID;
-				ev.ea      = read_pc_register((uint32)ThreadInfo->uThreadID);
+				ev.tid     = info.tid;
+				ev.ea      = read_pc_register((uint32)info.tid);
 				ev.handled = true;
 
-				events.enqueue(ev, IN_BACK);
+				queue_event(ev);
 
-				clear_all_bp(ThreadInfo->uThreadID);
+				clear_all_bp(info.tid);
 
-				if (ThreadInfo->uState == SNPS3_PPU_STOP)
+				if (info.state == TSTATE_STOP)
 				{
-					//suspend_thread(ThreadInfo->uThreadID);
+					//suspend_thread(info.tid);
 				}
 			}
 		}
@@ -1393,67 +1646,63 @@ void get_threads_info(void)
 
 	//debug_printf(" === END === \n");
 
-	free(ThreadInfo);
-
-	free(PPUThreadIDs);
-	free(SPUThreadGroupIDs);
+	get_spu_threads_info();
 }
 
+// State of thread 'tid' from the thread table, the target is only asked
+// about the threads the table does not know
 int get_thread_state(uint32 tid)
 {
-	SNRESULT snr = SN_S_OK;
-	uint32 ThreadInfoSize = 1024;
-	SNPS3_PPU_THREAD_INFO *ThreadInfo;
-	int state;
+	int state = thread_table.state(tid);
+
+	if (state >= 0)
+		return state;
 
-	ThreadInfo = (SNPS3_PPU_THREAD_INFO *)malloc(ThreadInfoSize);
+	target_thread_t info;
 
-	if (SN_FAILED( snr = SNPS3ThreadInfo(TargetID, PS3_UI_CPU, ProcessID, tid, &ThreadInfoSize, (byte *)ThreadInfo)))
+	if (!backend->get_thread_info(tid, &info))
 	{
-		msg("SNPS3ThreadInfo Error: %d\n", snr);
-		state = -1;
+		msg("ThreadInfo Error: %d\n", backend->error());
+		return -1;
+	}
 
-	} else {
+	// a new state alone leaves the memory map as it is, a new stack doesn't
+	const target_thread_t *known = thread_table.find(tid);
 
-		msg("ThreadID: 0x%llX, State: %s, Name: %s\n", ThreadInfo->uThreadID, get_state_name(ThreadInfo->uState), (const char*)(ThreadInfo + 1));
-		state = ThreadInfo->uState;
-	}
+	if (known == NULL || known->stack_addr != info.stack_addr || known->stack_size != info.stack_size)
+		memory_map.stale = true;
 
-	free(ThreadInfo);
+	thread_table.update(info);
 
-	return state;
+	return info.state;
 }
 
 void get_modules_info(void)
 {
-	uint32 NumModules;
-	uint32 *ModuleIDs;
-	uint64 ModuleInfoSize = 1024;
-	SNPS3MODULEINFO *ModuleInfo;
-	SNRESULT snr = SN_S_OK;
+	std::vector<uint32> ids;
+	target_module_t mod;
 	debug_event_t ev;
 
-	SNPS3GetModuleList(TargetID, ProcessID, &NumModules, NULL);
-
-	ModuleIDs = (uint32 *)malloc(NumModules * sizeof(uint32));
-
-	SNPS3GetModuleList(TargetID, ProcessID, &NumModules, ModuleIDs);
-
-	ModuleInfo = (SNPS3MODULEINFO *)malloc(ModuleInfoSize);
+	if (!backend->get_modules(&ids))
+	{
+		msg("GetModuleList Error: %d\n", backend->error());
+		return;
+	}
 
 	//debug_printf(" === MODULE INFO === \n");
 
-	for(uint32 i=0;i<NumModules;i++) {
+	for(uint32 i=0;i<ids.size();i++) {
 
-		ModuleInfoSize = 1024;
-
-		if (SN_FAILED( snr = SNPS3GetModuleInfo(TargetID, ProcessID, ModuleIDs[i], &ModuleInfoSize, ModuleInfo)))
+		if (!backend->get_module_info(ids[i], &mod))
 		{
-			msg("SNPS3GetModuleInfo Error: %d\n", snr);
+			msg("GetModuleInfo Error: %d\n", backend->error());
 
 		} else {
 
-			//debug_printf("[%d] ModuleID: 0x%X, %s, %s, Version: 0x%X, Attribute: 0x%X, StartEntry: 0x%X, StopEntry: 0x%X, Segments: %d\n", i, ModuleIDs[i], ModuleInfo->Hdr.aElfName, ModuleInfo->Hdr.aName, *(uint16 *)ModuleInfo->Hdr.aVersion, ModuleInfo->Hdr.uAttribute, ModuleInfo->Hdr.uStartEntry, ModuleInfo->Hdr.uStopEntry, ModuleInfo->Hdr.uNumSegments);
+			//debug_printf("[%d] ModuleID: 0x%X, %s, Segments: %d\n", i, ids[i], mod.name.c_str(), (int)mod.segments.size());
+
+			memory_map.modules[ids[i]] = mod;
+			memory_map.stale = true;
 
 			if (attaching == true)
 			{
@@ -1463,105 +1712,96 @@ void get_modules_info(void)
 				ev.ea      = BADADDR;
 				ev.handled = true;
 
-				_snprintf(ev.modinfo.name, MAXSTR, "%s - %s", ModuleInfo->Hdr.aElfName, ModuleInfo->Hdr.aName);
+				qstrncpy(ev.modinfo.name, mod.name.c_str(), sizeof(ev.modinfo.name));
 
-				ev.modinfo.base = ModuleInfo->Segments->uBase;
-				ev.modinfo.size = ModuleInfo->Segments->uMemSize;
+				ev.modinfo.base = mod.segments.empty() ? BADADDR : (ea_t)mod.segments[0].base;
+				ev.modinfo.size = mod.segments.empty() ? 0 : (asize_t)mod.segments[0].mem_size;
 				ev.modinfo.rebase_to = BADADDR;
 
-				events.enqueue(ev, IN_BACK);
+				queue_event(ev);
 
-				modules[ModuleIDs[i]] = ev.modinfo.name;
+				modules[ids[i]] = ev.modinfo.name;
 			}
 
-			for(uint32 j=0;j<ModuleInfo->Hdr.uNumSegments;j++) {
+			for(uint32 j=0;j<mod.segments.size();j++) {
 
-				//debug_printf("\t %lld: Base: 0x%llX, FileSize: 0x%llX, MemSize: 0x%llX, ElfType: 0x%llX\n", ModuleInfo->Segments[j].uIndex, ModuleInfo->Segments[j].uBase, ModuleInfo->Segments[j].uFileSize, ModuleInfo->Segments[j].uMemSize, ModuleInfo->Segments[j].uElfType);
+				//debug_printf("\t %d: Base: 0x%llX, FileSize: 0x%llX, MemSize: 0x%llX, ElfType: 0x%X\n", j, mod.segments[j].base, mod.segments[j].file_size, mod.segments[j].mem_size, mod.segments[j].elf_type);
 
 			}
 		}
 	}
 
 	//debug_printf(" === END === \n");
-
-	free(ModuleInfo);
-
-	free(ModuleIDs);
 }
 
 void clear_all_bp(uint32 tid)
 {
-	uint32 BPCount;
-	uint64 *BPAddress;
-
-	SNPS3GetBreakPoints(TargetID, PS3_UI_CPU, ProcessID, tid, &BPCount, NULL);
-
-	if (BPCount != 0)
-	{
-		BPAddress = (uint64 *)malloc(BPCount * sizeof(uint64));
-
-		SNPS3GetBreakPoints(TargetID, PS3_UI_CPU, ProcessID, tid, &BPCount, BPAddress);
+	std::vector<uint64> list;
 
-		for(uint32 i=0;i<BPCount;i++) {
-
-			SNPS3ClearBreakPoint(TargetID, PS3_UI_CPU, ProcessID, tid, BPAddress[i]);
+	if (!backend->get_breakpoints(tid, &list))
+		return;
 
-		}
+	for(uint32 i=0;i<list.size();i++) {
 
-		SNPS3GetBreakPoints(TargetID, PS3_UI_CPU, ProcessID, tid, &BPCount, NULL);
+		backend->clear_breakpoint(tid, (ea_t)list[i]);
 
-		free(BPAddress);
 	}
 }
 
 void bp_list(void)
 {
-	uint32 BPCount;
-	uint64 *BPAddress;
-
-	SNPS3GetBreakPoints(TargetID, PS3_UI_CPU, ProcessID, -1, &BPCount, NULL);
-
-	if (BPCount != 0)
-	{
-		BPAddress = (uint64 *)malloc(BPCount * sizeof(uint64));
-
-		SNPS3GetBreakPoints(TargetID, PS3_UI_CPU, ProcessID, -1, &BPCount, BPAddress);
+	const std::vector<ea_t> &list = main_bpts.list();
 
-		for(uint32 i=0;i<BPCount;i++) {
+	for(size_t i=0;i<list.size();i++) {
 
-			msg("0x%llX\n", BPAddress[i]);
+		msg("0x%llX\n", (uint64)list[i]);
 
-		}
-
-		free(BPAddress);
 	}
 }
 
-int addr_has_bp(uint32 ea)
+// Bring the target breakpoints in line with main_bpts: remove the ones we
+// don't know about and re-install the ones the target lost
+void reconcile_bpts(void)
 {
-	uint32 BPCount;
-	uint64 *BPAddress;
+	std::vector<uint64> BPAddress;
+	std::vector<ea_t> stale;
+	std::vector<ea_t> missing;
+
+	if (!backend->get_breakpoints(-1, &BPAddress))
+	{
+		msg("GetBreakPoints Error: %d\n", backend->error());
+		return;
+	}
 
-	SNPS3GetBreakPoints(TargetID, PS3_UI_CPU, ProcessID, -1, &BPCount, NULL);
+	main_bpts.diff(BPAddress.empty() ? NULL : &BPAddress[0], BPAddress.size(), &stale, &missing);
 
-	if (BPCount != 0)
+	for (size_t i = 0; i < stale.size(); i++)
 	{
-		BPAddress = (uint64 *)malloc(BPCount * sizeof(uint64));
+		// breakpoints planted for a step are ours too
+		if (std::find(step_bpts.begin(), step_bpts.end(), stale[i]) != step_bpts.end())
+			continue;
 
-		SNPS3GetBreakPoints(TargetID, PS3_UI_CPU, ProcessID, -1, &BPCount, BPAddress);
+		backend->clear_breakpoint(-1, stale[i]);
+		bpt_shadow.erase(stale[i]);
+		memcache.invalidate(stale[i], BPT_SIZE);
+	}
 
-		for(uint32 i=0;i<BPCount;i++) {
+	for (size_t i = 0; i < missing.size(); i++)
+	{
+		uint32 orig_inst;
 
-			if (ea == BPAddress[i])
-			{
-				return 1;
-			}
+		if (!bpt_shadow.find(missing[i], &orig_inst)
+		 && backend->read_memory(missing[i], &orig_inst, BPT_SIZE)
+		 && orig_inst != *(uint32*)bpt_code)
+		{
+			bpt_shadow.set(missing[i], orig_inst);
 		}
 
-		free(BPAddress);
+		backend->set_breakpoint(-1, missing[i]);
+		memcache.invalidate(missing[i], BPT_SIZE);
 	}
 
-	return 0;
+	debug_printf("reconcile_bpts: %d removed, %d restored\n", (int)stale.size(), (int)missing.size());
 }
 
 //--------------------------------------------------------------------------
@@ -1573,21 +1813,16 @@ static int idaapi deci3_start_process(const char *path,
                               const char *input_path,
                               uint32 input_file_crc32)
 {
-	SNRESULT snr = SN_S_OK;
 	//uint64 tid;
 
 	debug_printf("start_process\n");
 	debug_printf("path: %s\n", path);
 
-	//SNPS3Reset(TargetID, SNPS3TM_RESETP_QUICK_RESET);
-
-	SNPS3Reset(TargetID, SNPS3TM_BOOTP_DEFAULT);
+	std::lock_guard<std::recursive_mutex> guard(dispatch_lock);
 
-	//SNPS3ResetEx(TargetID, SNPS3TM_BOOTP_DEBUG_MODE, SNPS3TM_BOOTP_SYSTEM_MODE, 0, (uint64) -1, 0, 0);
-
-	if (SN_FAILED( snr = SNPS3ProcessLoad(TargetID, SNPS3_DEF_PROCESS_PRI, path, 0, NULL, 0, NULL, &ProcessID, NULL, SNPS3_LOAD_FLAG_ENABLE_DEBUGGING | SNPS3_LOAD_FLAG_USE_ELF_PRIORITY | SNPS3_LOAD_FLAG_USE_ELF_STACKSIZE)))
+	if (!backend->load_process(path, &ProcessID))
 	{
-		msg("SNPS3ProcessLoad Error: %d\n", snr);
+		msg("ProcessLoad Error: %d\n", backend->error());
 		return 0;
 	}
 
@@ -1614,10 +1849,15 @@ static int idaapi deci3_start_process(const char *path,
 // Attach to an existing running process
 int idaapi deci3_attach_process(pid_t pid, int event_id)
 {
+	std::lock_guard<std::recursive_mutex> guard(dispatch_lock);
+
 	//block the process until all generated events are processed
 	attaching = true;
+	process_stopped = false;
+	dabr_pending = false;
+	coalescer.clear();
 
-	SNPS3ProcessAttach(TargetID, PS3_UI_CPU, pid);
+	backend->attach(pid);
 	ProcessID = pid;
 
 	debug_event_t ev;
@@ -1632,11 +1872,17 @@ int idaapi deci3_attach_process(pid_t pid, int event_id)
     ev.modinfo.size = 0;
     ev.modinfo.rebase_to = BADADDR;
 
-	events.enqueue(ev, IN_BACK);
+	queue_event(ev);
 
+	memory_map.clear();
+	thread_table.clear();
+	spu_table.clear();
 	get_threads_info();
 	get_modules_info();
-	clear_all_bp(-1);
+	main_bpts.clear();
+	bpt_shadow.clear();
+	insn_cache.clear();
+	reconcile_bpts();
 
     ev.eid     = PROCESS_ATTACH;
     ev.pid     = ProcessID;
@@ -1649,7 +1895,7 @@ int idaapi deci3_attach_process(pid_t pid, int event_id)
     ev.modinfo.size = 0;
     ev.modinfo.rebase_to = BADADDR;
 
-    events.enqueue(ev, IN_BACK);
+	queue_event(ev);
 
 	process_names.clear();
 
@@ -1659,13 +1905,19 @@ int idaapi deci3_attach_process(pid_t pid, int event_id)
 //--------------------------------------------------------------------------
 int idaapi deci3_detach_process(void)
 {
-	// TMAPI cant detach
+	std::lock_guard<std::recursive_mutex> guard(dispatch_lock);
+
+	// the target can't detach
+
+	// the writes must reach the process before it is left alone
+	if (!flush_pending_writes())
+		return 0;
 
 	debug_event_t ev;
     ev.eid     = PROCESS_DETACH;
     ev.pid     = ProcessID;
 
-    events.enqueue(ev, IN_BACK);
+	queue_event(ev);
 
     return 1;
 }
@@ -1678,13 +1930,18 @@ void idaapi rebase_if_required_to(ea_t new_base)
 //--------------------------------------------------------------------------
 int idaapi prepare_to_pause_process(void)
 {
-	SNPS3ProcessStop(TargetID, ProcessID);
+	std::lock_guard<std::recursive_mutex> guard(dispatch_lock);
+
+	backend->stop();
+	flush_coalesced_events();
+	process_stopped = true;
+	apply_pending_dabr();
 
 	debug_event_t ev;
 	ev.eid     = PROCESS_SUSPEND;
 	ev.pid     = ProcessID;
 
-    events.enqueue(ev, IN_BACK);
+	queue_event(ev);
 
 	return 1;
 }
@@ -1695,6 +1952,10 @@ int idaapi deci3_exit_process(void)
 	//SNPS3ProcessKill
 	//SNPS3TerminateGameProcess
 
+	std::lock_guard<std::recursive_mutex> guard(dispatch_lock);
+
+	flush_pending_writes();
+
     debug_event_t ev;
     ev.eid     = PROCESS_EXIT;
     ev.pid     = ProcessID;
@@ -1703,7 +1964,7 @@ int idaapi deci3_exit_process(void)
 	ev.exit_code = 0;
     ev.handled = true;
 
-    events.enqueue(ev, IN_BACK);
+	queue_event(ev);
 
 	return 1;
 }
@@ -1744,52 +2005,109 @@ gdecode_t idaapi get_debug_event(debug_event_t *event, int ida_is_idle)
 	if ( event == NULL )
 		return GDE_NO_EVENT;
 
-	while ( true )
+	// events are delivered by the pump thread, there is nothing to poll:
+	// when IDA has nothing else to do, sleep until one arrives
+	if (ida_is_idle)
+		wait_for_event(TIMEOUT);
+
+	std::lock_guard<std::recursive_mutex> guard(dispatch_lock);
+
+	if ( !retrieve_event(event) )
 	{
-		if ( events.retrieve(event) )
+		if (attaching == false)
 		{
+			last_target_event = 0;
+		}
 
-#ifdef _DEBUG
+		return GDE_NO_EVENT;
+	}
 
-			if (event->eid == BREAKPOINT && event->bpt.hea != BADADDR)
-			{
-				debug_printf("get_debug_event: BREAKPOINT (HW)\n");
+	// the target might have run since the pages were cached
+	memcache.flush();
+	regcache.flush();
 
-			} else {
+	// no step is being planted, the decoded instructions can go if too many
+	insn_cache.trim();
 
-				debug_printf("get_debug_event: %s\n", get_event_name(event->eid));
-			}
+	if (event->eid == BREAKPOINT || event->eid == STEP || event->eid == EXCEPTION || event->eid == PROCESS_SUSPEND || event->eid == PROCESS_ATTACH)
+	{
+		process_stopped = true;
+		apply_pending_dabr();
+	}
 
-#endif
+	// the threads may have changed state while the process ran, each one
+	// is asked again when IDA wants it
+	if (attaching == false)
+	{
+		if (event->eid == BREAKPOINT || event->eid == STEP || event->eid == EXCEPTION || event->eid == PROCESS_SUSPEND)
+		{
+			thread_table.forget_states();
 
-			if (event->eid == PROCESS_ATTACH)
-			{
-				attaching = false;
-			}
+			if (EagerThreadSnapshot)
+				take_thread_snapshot();
+		}
+	}
 
-			if (attaching == false) 
-			{
-				memset(&target_event, 0, 0x20);
+#ifdef _DEBUG
 
-				Kick();
-			}
+	if (event->eid == BREAKPOINT && event->bpt.hea != BADADDR)
+	{
+		debug_printf("get_debug_event: BREAKPOINT (HW)\n");
 
-			return GDE_ONE_EVENT;
-		}
+	} else {
 
-		if (events.empty())
-			break;
+		debug_printf("get_debug_event: %s\n", get_event_name(event->eid));
+	}
 
-	};
+#endif
 
-	if (attaching == false)
+	if (event->eid == PROCESS_ATTACH)
 	{
-		memset(&target_event, 0, 0x20);
+		attaching = false;
+	}
+
+	if (attaching == false) 
+	{
+		last_target_event = 0;
 
 		Kick();
 	}
 
-	return GDE_NO_EVENT;
+	return GDE_ONE_EVENT;
+}
+
+//--------------------------------------------------------------------------
+// Step thread 'tid' off the breakpoint it stopped on, lifted by the caller,
+// and wait until the step is over (step_done clears continue_from_bp) so
+// that the breakpoint can be put back before the thread gets there again.
+// A target may report the step long after it was requested.
+static void step_over_bpt(uint32 tid)
+{
+	do_step(tid, 0);
+
+	last_target_event = 0;
+	continue_from_bp = true;
+
+	resume_process();
+	process_stopped = false;
+
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(StepOverTimeout);
+
+	for (;;)
+	{
+		Kick();
+
+		if (!continue_from_bp)
+			break;
+
+		if (std::chrono::steady_clock::now() > deadline)
+		{
+			msg("Thread 0x%X did not step off the breakpoint in %u ms\n", tid, StepOverTimeout);
+			break;
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(PumpInterval));
+	}
 }
 
 //--------------------------------------------------------------------------
@@ -1799,6 +2117,8 @@ int idaapi continue_after_event(const debug_event_t *event)
 	if ( event == NULL )
 		return false;
 
+	std::lock_guard<std::recursive_mutex> guard(dispatch_lock);
+
 #ifdef _DEBUG
 
 	if (event->eid == BREAKPOINT && event->bpt.hea != BADADDR)
@@ -1814,47 +2134,41 @@ int idaapi continue_after_event(const debug_event_t *event)
 
 	if (event->eid == PROCESS_ATTACH || event->eid == PROCESS_SUSPEND || event->eid == STEP || event->eid == BREAKPOINT) {
 
+		// the process can't run without the writes made while it was stopped
+		if (!flush_pending_writes())
+			return false;
+
+		memcache.flush();
+
 		if (event->eid == BREAKPOINT)
 		{
-			if (addr_has_bp(event->ea) == true)
+			if (main_bpts.contains(event->ea))
 			{	
-				SNPS3ClearBreakPoint(TargetID, PS3_UI_CPU, ProcessID, -1, event->ea);
-
-				do_step(event->tid, 0);
+				backend->clear_breakpoint(-1, event->ea);
 
-				SNPS3ProcessContinue(TargetID, ProcessID);
+				// the step runs what was written over the breakpoint
+				restore_written_bpt(event->ea);
 
-				memset(&target_event, 0, 0x20);
+				step_over_bpt(event->tid);
 
-				continue_from_bp = true;
-
-				Kick();
-
-				SNPS3SetBreakPoint(TargetID, PS3_UI_CPU, ProcessID, -1, event->ea);
+				backend->set_breakpoint(-1, event->ea);
 			}
 
 			if (event->bpt.hea == dabr_addr)
 			{
-				SNPS3SetDABR(TargetID, ProcessID, dabr_addr | 4);
-
-				do_step(event->tid, 0);
-
-				SNPS3ProcessContinue(TargetID, ProcessID);
+				backend->set_dabr(dabr_addr | 4);
 
-				memset(&target_event, 0, 0x20);
+				step_over_bpt(event->tid);
 
-				continue_from_bp = true;
-
-				Kick();
-
-				SNPS3SetDABR(TargetID, ProcessID, dabr_addr | dabr_type);
+				backend->set_dabr(dabr_addr | dabr_type);
 
 			}
 		}
 
-		SNPS3ProcessContinue(TargetID, ProcessID);
+		resume_process();
+		process_stopped = false;
 
-		memset(&target_event, 0, 0x20);
+		last_target_event = 0;
 
 		//get_threads_info();
 
@@ -1875,9 +2189,21 @@ int idaapi thread_suspend(thid_t tid)
 {
 	debug_printf("thread_suspend: tid = 0x%X\n", tid);
 
-	SNPS3ThreadStop(TargetID, PS3_UI_CPU, ProcessID, tid);
+	std::lock_guard<std::recursive_mutex> guard(dispatch_lock);
+
+	if (spu_table.find(tid) != NULL)
+	{
+		msg("SPU threads stop and run with the process\n");
+		return 0;
+	}
+
+	if (!backend->stop_thread(tid))
+	{
+		msg("ThreadStop Error: %d\n", backend->error());
+		return 0;
+	}
 
-	get_thread_state(tid);
+	thread_table.set_state(tid, TSTATE_STOP);
 
 	return 1;
 }
@@ -1887,188 +2213,384 @@ int idaapi thread_continue(thid_t tid)
 {
 	debug_printf("thread_continue: tid = 0x%X\n", tid);
 
-	SNPS3ThreadContinue(TargetID, PS3_UI_CPU, ProcessID, tid);
+	std::lock_guard<std::recursive_mutex> guard(dispatch_lock);
+
+	if (spu_table.find(tid) != NULL)
+	{
+		msg("SPU threads stop and run with the process\n");
+		return 0;
+	}
 
-	get_thread_state(tid);
+	if (!flush_pending_writes())
+		return 0;
+
+	regcache.invalidate(tid);
+	thread_snapshot.erase(tid);
+
+	if (!backend->resume_thread(tid))
+	{
+		msg("ThreadContinue Error: %d\n", backend->error());
+		return 0;
+	}
+
+	// running or sleeping, it's up to the thread
+	thread_table.forget_state(tid);
 
 	return 1;
 }
 
 //-------------------------------------------------------------------------
-int do_step(uint32 tid, uint32 dbg_notification)
+// Original instruction at 'ea', from the decoded instruction cache if possible
+static const cached_insn_t *get_insn(ea_t ea)
+{
+	const cached_insn_t *c = insn_cache.find(ea);
+	uint32 word;
+
+	if (c != NULL)
+		return c;
+
+	if (!backend->read_memory(ea, &word, 4))
+		return NULL;
+
+	if (word == *(uint32*)bpt_code && !bpt_shadow.find(ea, &word))
+		return NULL;
+
+	return insn_cache.add(ea, word);
+}
+
+// Plant a breakpoint for thread 'tid' where the current step may end
+static void set_step_bpt(uint32 tid, uint32 ea)
+{
+	// a breakpoint of all threads stops this one as well
+	if (main_bpts.contains(ea) || std::find(step_bpts.begin(), step_bpts.end(), ea) != step_bpts.end())
+		return;
+
+	const cached_insn_t *c = get_insn(ea);
+
+	if (c != NULL)
+		bpt_shadow.set(ea, c->word);
+
+	backend->set_breakpoint(tid, ea);
+	step_bpts.push_back(ea);
+}
+
+// Plant breakpoints on every instruction the one at the PC of 'tid' may reach
+static int plant_step_bpts(uint32 tid)
 {
 	uint32 ea;
-	uint32 instruction;
-	uint32 next_addr;
-	uint32 resolved_addr;
-	uint32 addr;
-	uint32 v;
-	int state;
+	const cached_insn_t *insn;
 	
 	ea = read_pc_register(tid);
 
-	SNPS3ProcessGetMemory(TargetID, PS3_UI_CPU, ProcessID, -1, ea, 4, (byte *)&instruction);
-	if (instruction == *(uint32*)bpt_code)
-		instruction = main_bpts_map[ea];
+	insn = get_insn(ea);
 
-	instruction = bswap32(instruction);
-	
-	state = get_thread_state(tid);
+	if (insn == NULL)
+	{
+		msg("Can't read instruction at 0x%X\n", ea);
+		return 0;
+	}
+
+#ifdef _DEBUG
 
-	if (state == SNPS3_PPU_SLEEP)
+	// the state has been forgotten when the process ran, asking costs a request
+	if (get_thread_state(tid) == TSTATE_SLEEP)
 	{
 		msg("THIS THREAD SLEEPS!\n");
 	}
 
-	next_addr = ea + 4;
-	resolved_addr = next_addr;
-	
-	//case 1 - bge, bne, beq, blt...
-	if ( instruction >> 26 == 16 )
-	{
-		addr = instruction & 0xFFFC;
-		
-		if ( addr & 0x8000 )
-			addr = addr | 0xFFFF0000;
-		
-		if ( !(instruction & 2) )
-			addr += ea;
-		
-		resolved_addr = addr;
-		
-		if ( instruction & 1 )
-		{
-			SNPS3ProcessGetMemory(TargetID, PS3_UI_CPU, ProcessID, -1, next_addr, 4, (byte *)&instruction);
-			if (instruction != *(uint32*)bpt_code)
-				main_bpts_map[next_addr] = instruction;
+#endif
 
-			SNPS3SetBreakPoint(TargetID, PS3_UI_CPU, ProcessID, tid, next_addr);
-			step_bpts.push_back(next_addr);
+	// planting a breakpoint may invalidate the entry
+	ppc_step_t step = insn->step;
 
-			SNPS3ProcessGetMemory(TargetID, PS3_UI_CPU, ProcessID, -1, resolved_addr, 4, (byte *)&instruction);
-			if (instruction != *(uint32*)bpt_code)
-				main_bpts_map[resolved_addr] = instruction;
+	if (step.flags & STEP_NEXT)
+		set_step_bpt(tid, ea + 4);
 
-			SNPS3SetBreakPoint(TargetID, PS3_UI_CPU, ProcessID, tid, resolved_addr);
-			step_bpts.push_back(resolved_addr);
-			
-			return 1;
-		}
+	if (step.flags & STEP_TARGET)
+		set_step_bpt(tid, step.target);
 
-		SNPS3ProcessGetMemory(TargetID, PS3_UI_CPU, ProcessID, -1, next_addr, 4, (byte *)&instruction);
-		if (instruction != *(uint32*)bpt_code)
-			main_bpts_map[next_addr] = instruction;
-
-		SNPS3SetBreakPoint(TargetID, PS3_UI_CPU, ProcessID, tid, next_addr);
-		step_bpts.push_back(next_addr);
-		
-		SNPS3ProcessGetMemory(TargetID, PS3_UI_CPU, ProcessID, -1, resolved_addr, 4, (byte *)&instruction);
-		if (instruction != *(uint32*)bpt_code)
-			main_bpts_map[resolved_addr] = instruction;
-
-		SNPS3SetBreakPoint(TargetID, PS3_UI_CPU, ProcessID, tid, resolved_addr);
-		step_bpts.push_back(resolved_addr);
-		
-    	return 1;
-	}
-
-	//case 2 - bl, b
-	if ( instruction >> 26 == 18 )
-	{
-		addr = instruction & 0x3FFFFFC;
-		
-		if ( addr & 0x2000000 )
-			addr = addr | 0xFC000000;
-		
-		if ( !(instruction & 2) )
-			addr += ea;
-		
-		resolved_addr = addr;
-		
-		if ( instruction & 1 )
-		{
-    		// bl
+	if (step.flags & STEP_LR)
+		set_step_bpt(tid, read_lr_register(tid));
 
-			SNPS3ProcessGetMemory(TargetID, PS3_UI_CPU, ProcessID, -1, resolved_addr, 4, (byte *)&instruction);
-			if (instruction != *(uint32*)bpt_code)
-				main_bpts_map[resolved_addr] = instruction;
+	if (step.flags & STEP_CTR)
+		set_step_bpt(tid, read_ctr_register(tid));
 
-		  	SNPS3SetBreakPoint(TargetID, PS3_UI_CPU, ProcessID, tid, resolved_addr);
-		  	step_bpts.push_back(resolved_addr);
+	return 1;
+}
 
-      		return 1;
-    	}
+//-------------------------------------------------------------------------
+static const cached_insn_t *fetch_insn(ea_t ea, void *ud)
+{
+	return get_insn(ea);
+}
 
-		// b
+// Plant a breakpoint where the stop being run may go: outside the range it
+// is one more exit, inside it is a hop removed once the thread gets there
+static void set_range_hop(uint32 tid, uint32 ea)
+{
+	if (ea < range_lo || ea >= range_hi)
+	{
+		set_step_bpt(tid, ea);
+		return;
+	}
 
-		SNPS3ProcessGetMemory(TargetID, PS3_UI_CPU, ProcessID, -1, resolved_addr, 4, (byte *)&instruction);
-		if (instruction != *(uint32*)bpt_code)
-			main_bpts_map[resolved_addr] = instruction;
+	if (ea == range_lifted || main_bpts.contains(ea) || std::find(step_bpts.begin(), step_bpts.end(), ea) != step_bpts.end())
+		return;
 
-		SNPS3SetBreakPoint(TargetID, PS3_UI_CPU, ProcessID, tid, resolved_addr);
-		step_bpts.push_back(resolved_addr);
-		
-		return 1;
+	set_step_bpt(tid, ea);
+	range_hops.push_back(ea);
+}
+
+// Thread 'tid' is at the stop 'ea': its destination is known now. The trap
+// is lifted so that the branch runs, it is put back at the next stop.
+static void lift_range_stop(uint32 tid, uint32 ea)
+{
+	const cached_insn_t *insn = get_insn(ea);
+
+	if (insn == NULL)
+	{
+		clear_step_bpt(tid, ea);
+		range_lifted = ea;
+		return;
 	}
 
-	//case 3 - all
-	if ( instruction >> 26 != 19 || instruction & 0xE000 ) 
+	// clearing and planting breakpoints may invalidate the entry
+	ppc_step_t step = insn->step;
+
+	clear_step_bpt(tid, ea);
+	range_lifted = ea;
+
+	if (step.flags & STEP_NEXT)
+		set_range_hop(tid, ea + 4);
+
+	if (step.flags & STEP_LR)
+		set_range_hop(tid, read_lr_register(tid));
+
+	if (step.flags & STEP_CTR)
+		set_range_hop(tid, read_ctr_register(tid));
+}
+
+// Step thread 'tid' through the range armed by rangestep: breakpoints go on
+// the exits of the range and on its branches through LR or CTR, the thread
+// then runs until its PC leaves the range, see range_continue.
+static int range_step(uint32 tid)
+{
+	ppc_range_t range;
+	uint32 start = range_start;
+	uint32 end = range_end;
+	uint32 pc = read_pc_register(tid);
+
+	// armed for one step only
+	range_start = range_end = 0;
+
+	if (pc < start || pc >= end)
+		return do_step(tid, 0);
+
+	if (!ppc_range_exits(start, end, range_over_calls, fetch_insn, NULL, &range))
 	{
-		SNPS3ProcessGetMemory(TargetID, PS3_UI_CPU, ProcessID, -1, next_addr, 4, (byte *)&instruction);
-		if (instruction != *(uint32*)bpt_code)
-			main_bpts_map[next_addr] = instruction;
+		msg("Can't step range 0x%X..0x%X, stepping one instruction\n", start, end);
+		return do_step(tid, 0);
+	}
 
-		SNPS3SetBreakPoint(TargetID, PS3_UI_CPU, ProcessID, tid, next_addr);
-		step_bpts.push_back(next_addr);
-	
-		return 1;
+	step_counts[STEP_PATH_RANGE]++;
+	debug_printf("step 0x%X: %s, %u exits, %u stops\n", tid, step_path_names[STEP_PATH_RANGE], (uint32)range.exits.size(), (uint32)range.stops.size());
+
+	range_tid = tid;
+	range_lo = start;
+	range_hi = end;
+	range_stops = range.stops;
+	range_hops.clear();
+	range_lifted = 0;
+
+	for (size_t i = 0; i < range.exits.size(); i++)
+		set_step_bpt(tid, range.exits[i]);
+
+	for (size_t i = 0; i < range.stops.size(); i++)
+	{
+		if (range.stops[i] != pc)
+			set_step_bpt(tid, range.stops[i]);
 	}
-	
-	v = (instruction >> 1) & 0x3FF;
-	
-	//case 4 - blr, beqlr, blelr...
-	if ( v == 16 )
-	{		
-		resolved_addr = read_lr_register(tid);
-		
-		SNPS3ProcessGetMemory(TargetID, PS3_UI_CPU, ProcessID, -1, next_addr, 4, (byte *)&instruction);
-		if (instruction != *(uint32*)bpt_code)
-			main_bpts_map[next_addr] = instruction;
-
-		SNPS3SetBreakPoint(TargetID, PS3_UI_CPU, ProcessID, tid, next_addr);
-		step_bpts.push_back(next_addr);
-		
-		SNPS3ProcessGetMemory(TargetID, PS3_UI_CPU, ProcessID, -1, resolved_addr, 4, (byte *)&instruction);
-		if (instruction != *(uint32*)bpt_code)
-			main_bpts_map[resolved_addr] = instruction;
-
-		SNPS3SetBreakPoint(TargetID, PS3_UI_CPU, ProcessID, tid, resolved_addr);
-		step_bpts.push_back(resolved_addr);
-		
-		return 1;
+
+	if (std::find(range.stops.begin(), range.stops.end(), pc) != range.stops.end())
+		lift_range_stop(tid, pc);
+
+	return 1;
+}
+
+// A trap of the thread stepping a range. If it is still inside, at a stop
+// or a hop, it is resumed and true returned. Otherwise the step is over.
+static bool range_continue(const target_event_t &tev)
+{
+	uint32 tid = (uint32)tev.tid;
+	uint32 pc = (uint32)tev.pc;
+
+	if (pc < range_lo || pc >= range_hi || main_bpts.contains(pc))
+		return false;
+
+	bool stop = std::find(range_stops.begin(), range_stops.end(), pc) != range_stops.end();
+	bool hop = std::find(range_hops.begin(), range_hops.end(), pc) != range_hops.end();
+
+	// a trap of the program itself
+	if (!stop && !hop)
+		return false;
+
+	while (!range_hops.empty())
+	{
+		clear_step_bpt(tid, range_hops.back());
+		range_hops.pop_back();
 	}
 
-	//case 5 - bctrl, bctr, bltctr, bgtctrl...
-	if ( v != 528 )
+	if (range_lifted != 0)
+	{
+		set_step_bpt(tid, range_lifted);
+		range_lifted = 0;
+	}
+
+	if (stop)
+		lift_range_stop(tid, pc);
+
+	range_resumes++;
+
+	// the process runs on as if resumed by IDA
+	return resume_process();
+}
+
+// Get thread 'tid' ready to run one instruction. With a hardware step the
+// thread is only armed, resume_process steps it alone, otherwise breakpoints
+// are planted on the successors of the instruction and the process resumed.
+int do_step(uint32 tid, uint32 dbg_notification)
+{
+	if (HardwareStep && hw_step_available)
+	{
+		hw_step_tid = tid;
 		return 1;
+	}
 
-	resolved_addr = read_ctr_register(tid);
-	
-	SNPS3ProcessGetMemory(TargetID, PS3_UI_CPU, ProcessID, -1, next_addr, 4, (byte *)&instruction);
-	if (instruction != *(uint32*)bpt_code)
-		main_bpts_map[next_addr] = instruction;
+	step_counts[STEP_PATH_TRAP]++;
+	debug_printf("step 0x%X: %s\n", tid, step_path_names[STEP_PATH_TRAP]);
 
-	SNPS3SetBreakPoint(TargetID, PS3_UI_CPU, ProcessID, tid, next_addr);
-	step_bpts.push_back(next_addr);
-	
-	SNPS3ProcessGetMemory(TargetID, PS3_UI_CPU, ProcessID, -1, resolved_addr, 4, (byte *)&instruction);
-	if (instruction != *(uint32*)bpt_code)
-		main_bpts_map[resolved_addr] = instruction;
+	return plant_step_bpts(tid);
+}
 
-	SNPS3SetBreakPoint(TargetID, PS3_UI_CPU, ProcessID, tid, resolved_addr);
-	step_bpts.push_back(resolved_addr);
+// Trace thread 'tid' as armed by branchtrace. It is stepped here until the
+// trace is over, the events which ended it are then handled as usual, or a
+// step event is made up for IDA.
+static void run_trace(uint32 tid)
+{
+	std::lock_guard<std::recursive_mutex> guard(dispatch_lock);
 
-	return 1;
+	std::string path = trace_path;
+	uint32 pc = read_pc_register(tid);
+	btrace_writer_t out;
+	branch_tracer_t tracer(backend, fetch_insn, NULL, &main_bpts);
+
+	// armed for one step only
+	trace_path.clear();
+
+	tracer.hw_step = HardwareStep && hw_step_available;
+	tracer.poll_interval = PumpInterval;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	int reason = BTRACE_ERROR;
+
+	if (out.open(path.c_str(), tid, pc))
+		reason = tracer.run(tid, pc, trace_stop_ea, trace_max_insns, &out, on_target_event, NULL);
+	else
+		msg("Can't create %s\n", path.c_str());
+
+	uint32 ms = (uint32)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+	if (!out.close())
+		msg("Can't write %s\n", path.c_str());
+
+	if (tracer.hw_step != (HardwareStep && hw_step_available))
+		hw_step_available = false;
+
+	if (reason == BTRACE_ERROR && tracer.error != 0)
+		msg("Trace Error: %d\n", tracer.error);
+
+	msg("Traced %llu instructions, %llu branches taken in %u ms, %llu bytes written to %s\n", out.insns, out.branches, ms, out.size, path.c_str());
+
+	regcache.flush();
+	thread_snapshot.clear();
+	last_target_event = 0;
+
+	if (tracer.events.empty())
+	{
+		target_event_t tev;
+
+		tev.type = TEV_STEP;
+		tev.tid = tid;
+		tev.pc = tracer.pc;
+		tracer.events.push_back(tev);
+	}
+
+	for (size_t i = 0; i < tracer.events.size(); i++)
+		on_target_event(tracer.events[i], NULL);
+}
+
+// Set the process going after an event: the thread armed by do_step
+// for a hardware step runs alone, otherwise every thread is resumed.
+// Returns false, the process left stopped, if the writes made while it
+// was stopped could not be sent.
+static bool resume_process(void)
+{
+	if (!flush_pending_writes())
+		return false;
+
+	// nothing read from the process or its threads holds once it runs
+	memcache.flush();
+	regcache.flush();
+	thread_snapshot.clear();
+
+	// the SPUs run along
+	spu_table.invalidate();
+	thread_table.forget_states();
+
+	if (trace_tid != 0)
+	{
+		uint32 tid = trace_tid;
+
+		trace_tid = 0;
+		run_trace(tid);
+		return true;
+	}
+
+	if (hw_step_tid != 0)
+	{
+		uint32 tid = hw_step_tid;
+		int path = STEP_PATH_HW;
+
+		hw_step_tid = 0;
+
+		if (backend->step_thread(tid))
+		{
+			step_counts[path]++;
+			debug_printf("step 0x%X: %s\n", tid, step_path_names[path]);
+			return true;
+		}
+
+		if (backend->error() == TARGET_E_UNSUPPORTED)
+		{
+			msg("%s can't step a single thread, using breakpoints\n", backend->name());
+			hw_step_available = false;
+		}
+		else
+		{
+			msg("ThreadStep Error: %d\n", backend->error());
+		}
+
+		path = STEP_PATH_FALLBACK;
+		step_counts[path]++;
+		debug_printf("step 0x%X: %s\n", tid, step_path_names[path]);
+
+		plant_step_bpts(tid);
+	}
+
+	if (!backend->resume())
+		msg("ProcessContinue Error: %d\n", backend->error());
+
+	return true;
 }
 
 //--------------------------------------------------------------------------
@@ -2078,10 +2600,33 @@ int idaapi thread_set_step(thid_t tid)
 	int dbg_notification;
 	int result = 0;
 
+	std::lock_guard<std::recursive_mutex> guard(dispatch_lock);
+
+	if (spu_table.find(tid) != NULL)
+	{
+		msg("SPU threads can't be stepped\n");
+		return 0;
+	}
+
 	dbg_notification = get_running_notification();
 
+	if (!flush_pending_writes())
+		return 0;
+
+	memcache.flush();
+
 	if (dbg_notification == STEP_INTO || dbg_notification == STEP_OVER) {
-		result = do_step(tid, dbg_notification);
+
+		if (!trace_path.empty())
+		{
+			trace_tid = tid;
+			result = 1;
+		}
+		else if (range_end > range_start)
+			result = range_step(tid);
+		else
+			result = do_step(tid, dbg_notification);
+
 		singlestep = true;
 	}
 
@@ -2089,57 +2634,151 @@ int idaapi thread_set_step(thid_t tid)
 }
 
 //-------------------------------------------------------------------------
-uint32 read_pc_register(uint32 tid) 
+static bool fetch_thread_registers(uint64 tid, uint32 count, const uint32 *ids, uint8 *slots, void *ud)
+{
+	if (!backend->get_registers(tid, count, ids, slots))
+	{
+		msg("ThreadGetRegisters Error: %d\n", backend->error());
+		return false;
+	}
+
+	return true;
+}
+
+static uint32 read_general_register(uint32 tid, int idx)
+{
+	int i = thread_snapshot.find(tid);
+
+	if (i >= 0)
+	{
+		switch (idx)
+		{
+			case R_PC:  return (uint32)thread_snapshot.pc[i];
+			case R_LR:  return (uint32)thread_snapshot.lr[i];
+			case R_CTR: return (uint32)thread_snapshot.ctr[i];
+		}
+	}
+
+	const regval *regs = (const regval *)regcache.fetch(tid, RC_GENERAL, fetch_thread_registers, NULL);
+
+	if (regs == NULL)
+		return BADADDR;
+
+	return (uint32)bswap64(regs[idx].lval);
+}
+
+uint32 read_pc_register(uint32 tid) 
+{
+	return read_general_register(tid, R_PC);
+}
+
+uint32 read_lr_register(uint32 tid) 
+{
+	return read_general_register(tid, R_LR);
+}
+
+uint32 read_ctr_register(uint32 tid) 
+{
+	return read_general_register(tid, R_CTR);
+}
+
+//-------------------------------------------------------------------------
+// Bring the thread table in step with 'tids', the threads of the stopped
+// process. The new ones are only recorded, their info is fetched on demand.
+static void refresh_thread_table(const std::vector<uint64> &tids)
+{
+	std::vector<uint64> added;
+	size_t known = thread_table.size();
+
+	thread_table.sync(tids, &added);
+
+	for (size_t i = 0; i < added.size(); i++)
+		thread_table.add(added[i]);
+
+	if (thread_table.size() != known)
+		memory_map.stale = true;
+}
+
+//-------------------------------------------------------------------------
+// Fill thread_snapshot with the key registers of all threads in one pass
+void take_thread_snapshot(void)
 {
-	SNRESULT snr = SN_S_OK;
-	uint32 reg = SNPS3_pc;
-	byte result[SNPS3_REGLEN];
+	static const uint32 ids[] = { TREG_PC, TREG_LR, TREG_GPR0 + 1, TREG_CTR };
+	regval result[qnumber(ids)];
+	std::vector<uint64> PPUThreadIDs;
+
+	thread_snapshot.clear();
 
-	if (SN_FAILED( snr = SNPS3ThreadGetRegisters(TargetID, PS3_UI_CPU, ProcessID, tid, 1, &reg, result)))
+	if (!backend->get_threads(&PPUThreadIDs))
 	{
-		msg("read_pc_register -> SNPS3ThreadGetRegisters Error: %d\n", snr);
-		return BADADDR;
+		msg("ThreadList Error: %d\n", backend->error());
+		return;
 	}
 
-	return bswap32(*(uint32 *)(result + 4));
+	// the thread list comes for free here
+	refresh_thread_table(PPUThreadIDs);
+
+	uint32 count = qmin(uint32(PPUThreadIDs.size()), SnapshotMaxThreads);
+
+	thread_snapshot.reserve(count);
+
+	for (uint32 i = 0; i < count; i++)
+	{
+		if (!backend->get_registers(PPUThreadIDs[i], qnumber(ids), ids, (uint8 *)result))
+			continue;
+
+		thread_snapshot.add(PPUThreadIDs[i], bswap64(result[0].lval), bswap64(result[1].lval), bswap64(result[2].lval), bswap64(result[3].lval));
+	}
 }
 
-uint32 read_lr_register(uint32 tid) 
+//--------------------------------------------------------------------------
+// Registers of an SPU thread in the PPU register set: the first 32 SPU
+// registers in the vector registers, their preferred slots in the GPRs,
+// PC and LR pointing in the local store window of the thread
+static int read_spu_registers(const spu_thread_t &t, int clsmask, regval_t *values)
 {
-	SNRESULT snr = SN_S_OK;
-	uint32 reg = SNPS3_lr;
-	byte result[SNPS3_REGLEN];
+	const uint8 *regs = spu_table.registers(t.tid, backend);
 
-	if (SN_FAILED( snr = SNPS3ThreadGetRegisters(TargetID, PS3_UI_CPU, ProcessID, tid, 1, &reg, result)))
+	if (regs == NULL)
 	{
-		msg("read_lr_register -> SNPS3ThreadGetRegisters Error: %d\n", snr);
-		return BADADDR;
+		msg("SPU ThreadGetRegisters Error: %d\n", backend->error());
+		return 1;
 	}
 
-	return bswap32(*(uint32 *)(result + 4));
-}
+	uint64 ls = spu_table.window(t);
 
-uint32 read_ctr_register(uint32 tid) 
-{
-	SNRESULT snr = SN_S_OK;
-	uint32 reg = SNPS3_ctr;
-	byte result[SNPS3_REGLEN];
+	if (clsmask & RC_VECTOR)
+	{
+		uint8 vr[32 * 16];
+		bswap128(vr, regs, 32);
+
+		for (int i = 0; i < 32; i++)
+			values[R_V0 + i].set_bytes(&vr[i * 16], 16);
+	}
 
-	if (SN_FAILED( snr = SNPS3ThreadGetRegisters(TargetID, PS3_UI_CPU, ProcessID, tid, 1, &reg, result)))
+	for (int i = 0; i < qnumber(registers_id); i++)
 	{
-		msg("read_ctr_register -> SNPS3ThreadGetRegisters Error: %d\n", snr);
-		return BADADDR;
+		if ((registers[i].register_class & clsmask) == 0 || registers[i].dtyp == dt_byte16)
+			continue;
+
+		if (i < 32)
+			values[i].ival = spu_word(regs, SREG_GPR0 + i);
+		else if (i == R_PC)
+			values[i].ival = ls + (spu_word(regs, SREG_NPC) & (SPU_LS_SIZE - 4));
+		else if (i == R_LR)
+			values[i].ival = ls + (spu_word(regs, SREG_GPR0) & (SPU_LS_SIZE - 4));
+		else
+			values[i].ival = 0;
 	}
 
-	return bswap32(*(uint32 *)(result + 4));
+	return 1;
 }
 
 //--------------------------------------------------------------------------
 // Read thread registers
 int idaapi read_registers(thid_t tid, int clsmask, regval_t *values)
 {
-	SNRESULT snr = SN_S_OK;
-	regval *RegsBuf;
+	const regval *regs;
 
 	if ( values == NULL ) 
 	{
@@ -2147,30 +2786,39 @@ int idaapi read_registers(thid_t tid, int clsmask, regval_t *values)
 		return false;
 	}
 
-	RegsBuf = (regval *)malloc(qnumber(registers_id) * SNPS3_REGLEN);
+	std::lock_guard<std::recursive_mutex> guard(dispatch_lock);
 
-	if (SN_FAILED( snr = SNPS3ThreadGetRegisters(TargetID, PS3_UI_CPU, ProcessID, tid, qnumber(registers_id), registers_id, (byte *)RegsBuf)))
-	{
-		debug_printf("read_registers -> SNPS3ThreadGetRegisters Error: %d\n", snr);
+	const spu_thread_t *spu = spu_table.find(tid);
+
+	if (spu != NULL)
+		return read_spu_registers(*spu, clsmask, values);
+
+	// only the requested classes are fetched, the rest stays cached until resume
+	regs = (const regval *)regcache.fetch(tid, clsmask, fetch_thread_registers, NULL);
+
+	if (regs == NULL)
 		return 1;
 
-	} else {
+	if (clsmask & RC_VECTOR)
+	{
+		// all 32 vector registers are byte swapped in one pass
+		uint8 vr[32 * 16];
+		bswap128(vr, (const uint8 *)&regs[R_V0], 32);
 
-		for(int i=0;i<qnumber(registers_id);i++) {
+		for (int i = 0; i < 32; i++)
+			values[R_V0 + i].set_bytes(&vr[i * 16], 16);
+	}
 
-			if (clsmask == RC_GENERAL || clsmask == RC_FLOAT)
-			{
-				values[i].ival = bswap64(RegsBuf[i].lval);
+	for(int i=0;i<qnumber(registers_id);i++) {
 
-				if (i == 33) // CR
-				{
-					values[i].ival = (values[i].ival << 32) | (values[i].ival >> 32);
-				}
+		if ((registers[i].register_class & clsmask) == 0 || registers[i].dtyp == dt_byte16)
+			continue;
 
-			} else {
-				//for ( int i=R_XMM0; i < R_MXCSR; i++,xptr+=16 )
-				//  values[i].set_bytes(xptr, 16);
-			}
+		values[i].ival = bswap64(regs[i].lval);
+
+		if (i == R_CR)
+		{
+			values[i].ival = (values[i].ival << 32) | (values[i].ival >> 32);
 		}
 	}
 
@@ -2181,9 +2829,8 @@ int idaapi read_registers(thid_t tid, int clsmask, regval_t *values)
 // Write one thread register
 int idaapi write_register(thid_t tid, int reg_idx, const regval_t *value)
 {
-	SNRESULT snr = SN_S_OK;
 	uint32 reg;
-	uint64 val;
+	regval val;
 
 	if ( value == NULL )
 	{
@@ -2191,21 +2838,49 @@ int idaapi write_register(thid_t tid, int reg_idx, const regval_t *value)
 		return false;
 	}
 
+	std::lock_guard<std::recursive_mutex> guard(dispatch_lock);
+
 	//Ida Pro 6.1 has sign extension bug: if val is 32 bits, high 32 bits will be 0xFFFFFFFF
 
-	if ( reg_idx > qnumber(registers) )
+	if ( reg_idx < 0 || reg_idx >= qnumber(registers) )
 	{
 		debug_printf("wrong reg_idx !\n");
 		return false;
 	}
 
+	if (spu_table.find(tid) != NULL)
+	{
+		msg("SPU registers are read only\n");
+		return false;
+	}
+
 	reg = registers_id[reg_idx];
 
-	val = bswap64(value->ival);
+	memset(&val, 0, sizeof(val));
+
+	if (registers[reg_idx].dtyp == dt_byte16)
+	{
+		const bytevec_t &bytes = value->bytes();
+
+		if (bytes.size() != sizeof(val))
+		{
+			debug_printf("wrong vector size !\n");
+			return false;
+		}
+
+		bswap128((uint8 *)&val, &bytes[0], 1);
+	}
+	else
+	{
+		val.lval = bswap64(value->ival);
+	}
+
+	regcache.invalidate(tid);
+	thread_snapshot.erase(tid);
 
-	if (SN_FAILED( snr = SNPS3ThreadSetRegisters(TargetID, PS3_UI_CPU, ProcessID, tid, 1, &reg, (byte *)&val)))
+	if (!backend->set_registers(tid, 1, &reg, (const uint8 *)&val))
 	{
-		msg("SNPS3ThreadSetRegisters Error: %d\n", snr);
+		msg("ThreadSetRegisters Error: %d\n", backend->error());
 		return false;
 	}
 
@@ -2223,90 +2898,188 @@ int idaapi write_register(thid_t tid, int reg_idx, const regval_t *value)
 //    1: new memory layout is returned
 int idaapi get_memory_info(meminfo_vec_t &areas)
 {
-	/*SNRESULT snr = SN_S_OK;
-	uint32 AreaCount;
-	uint32 BufSize;
-	SNPS3VirtualMemoryArea* Buf;
+	std::lock_guard<std::recursive_mutex> guard(dispatch_lock);
+
+	if (!memory_map.stale && !memory_map.vm_stale)
+		return -2;
 
 	debug_printf("get_memory_info\n");
 
-	SNPS3GetVirtualMemoryInfo(TargetID, ProcessID, true, &AreaCount, &BufSize, NULL);
+	std::vector<mem_area_t> map;
+
+	if (RealMemoryMap)
+	{
+		if (memory_map.vm_stale)
+		{
+			if (!backend->get_memory_areas(&memory_map.vm))
+			{
+				msg("GetVirtualMemoryInfo Error: %d\n", backend->error());
+				memory_map.vm.clear();
+			}
+		}
+
+		// the segments of the database cost no request, they are taken every time
+		memory_map.image.clear();
 
-	debug_printf("BufSize: 0x%X\n", BufSize);
+		for (int i = 0; i < get_segm_qty(); i++)
+		{
+			segment_t *seg = getnseg(i);
+			char name[MAXSTR];
+			char sclass[MAXSTR];
 
-	Buf = (SNPS3VirtualMemoryArea *)malloc(BufSize);
+			if (seg == NULL || seg->is_debugger_segm())
+				continue;
 
-	if (SN_FAILED( snr = SNPS3GetVirtualMemoryInfo(TargetID, ProcessID, true, &AreaCount, &BufSize, (byte *)Buf)))
-	{
-		msg("SNPS3GetVirtualMemoryInfo Error: %d\n", snr);
-		return -3;
+			if (get_true_segm_name(seg, name, sizeof(name)) < 0)
+				name[0] = '\0';
+
+			if (get_segm_class(seg, sclass, sizeof(sclass)) < 0)
+				sclass[0] = '\0';
+
+			uint8 perm = seg->perm != 0 ? seg->perm : MEM_PERM_READ | MEM_PERM_WRITE | MEM_PERM_EXEC;
+
+			memory_map.image.push_back(mem_area_t(seg->startEA, seg->endEA, name, sclass, perm));
+		}
+
+		memory_map.build(&map);
 	}
 
-	debug_printf("AreaCount: 0x%X\n", AreaCount);
+	memory_map.stale = false;
+	memory_map.vm_stale = false;
+
+	// nothing known about the process, let IDA try everything
+	if (map.empty())
+		map.push_back(mem_area_t(0, 0xFFFF0000, "", "", 0));
+
+	uint64 fingerprint = memory_map_t::fingerprint(map);
+
+	if (fingerprint == memory_map.reported)
+		return -2;
 
-	memory_info_t info;
+	memory_map.reported = fingerprint;
 
-	for(uint32 i = 0; i < AreaCount; i++) {
+	for (size_t i = 0; i < map.size(); i++)
+	{
+		memory_info_t info;
 
-		debug_printf("Address: 0x%llX, Size: 0x%llX\n", Buf[i].uAddress, Buf[i].uVSize);
+		debug_printf("Address: 0x%llX, Size: 0x%llX, %s\n", map[i].start, map[i].end - map[i].start, map[i].name.c_str());
 
-		info.startEA = Buf[i].uAddress;
-		info.endEA = Buf[i].uAddress + Buf[i].uVSize;
-		info.name = NULL;
-		info.sclass = NULL;
+		info.startEA = (ea_t)map[i].start;
+		info.endEA = (ea_t)map[i].end;
+		info.name = map[i].name.c_str();
+		info.sclass = map[i].sclass.c_str();
 		info.sbase = 0;
 		info.bitness = 1;
-		info.perm = 0; // SEGPERM_EXEC / SEGPERM_WRITE / SEGPERM_READ
+		info.perm = map[i].perm;
 
 		areas.push_back(info);
-
 	}
 
-	free(Buf);*/
-
-	memory_info_t info;
-
-	info.startEA = 0;
-	info.endEA = 0xFFFF0000;
-	info.name = NULL;
-	info.sclass = NULL;
-	info.sbase = 0;
-	info.bitness = 1;
-	info.perm = 0; // SEGPERM_EXEC / SEGPERM_WRITE / SEGPERM_READ
-	
-	areas.push_back(info);
-
 	return 1;
 }
 
+//--------------------------------------------------------------------------
+static bool fetch_target_memory(ea_t ea, void *buffer, uint32 size, void *ud)
+{
+	return backend->read_memory(ea, buffer, size);
+}
+
 //--------------------------------------------------------------------------
 // Read process memory
 ssize_t idaapi read_memory(ea_t ea, void *buffer, size_t size)
 {
-	SNPS3ProcessGetMemory(TargetID, PS3_UI_CPU, ProcessID, -1, ea, size, (byte *)buffer);
+	std::lock_guard<std::recursive_mutex> guard(dispatch_lock);
 
-	for(int i=0;i<size;i+=4) {
+	// local stores come from their snapshot, a whole one is read at a time
+	if (spu_table.at(ea) != NULL)
+	{
+		size_t done = spu_table.read(ea, buffer, size, backend);
 
-		if(*(uint32 *)((char*)buffer+i) == *(uint32 *)bpt_code) 
-		{
-			*(uint32 *)((char*)buffer+i) = main_bpts_map[ea+i];
-		}
+		return done != 0 ? ssize_t(done) : -1;
+	}
+
+	// pages holding pending writes must be up to date before they're fetched
+	ea_t page_start = ea & ~(ea_t)(MEMORY_PAGE_SIZE - 1);
+	ea_t page_end = (ea + size + MEMORY_PAGE_SIZE - 1) & ~(ea_t)(MEMORY_PAGE_SIZE - 1);
+
+	// if they don't make it, the next read shows what the target holds
+	if (pending_writes.overlaps(page_start, page_end - page_start) && !flush_pending_writes())
+		return -1;
+
+	if (size > MEMCACHE_MAX_READ)
+	{
+		size_t done = chunked_read(ea, buffer, size, fetch_target_memory, NULL, ReadChunkSize);
+
+		if (done == 0)
+			return -1;
+
+		bpt_shadow.patch(ea, buffer, done, bpt_code);
+
+		return done;
+	}
+
+	// Whole pages are cached until the process is resumed, if they can't be read
+	// (e.g. the range touches an unmapped page) fall back to the exact range
+	if (!memcache.read(ea, buffer, size, fetch_target_memory, NULL))
+	{
+		backend->read_memory(ea, buffer, uint32(size));
 	}
 
+	bpt_shadow.patch(ea, buffer, size, bpt_code);
+
 	return size;
 }
 
+//--------------------------------------------------------------------------
+static bool store_target_memory(ea_t ea, const void *buffer, uint32 size, void *ud)
+{
+	if (!backend->write_memory(ea, buffer, size))
+	{
+		msg("ProcessSetMemory Error: %d\n", backend->error());
+
+		// the cached copies hold the bytes that never reached the target
+		memcache.invalidate(ea, size);
+		insn_cache.invalidate(ea, size);
+		return false;
+	}
+
+	return true;
+}
+
+//--------------------------------------------------------------------------
+// Send the buffered writes to the target, returns false if any of them failed
+bool flush_pending_writes(void)
+{
+	return pending_writes.empty() || pending_writes.flush(store_target_memory, NULL);
+}
+
 //--------------------------------------------------------------------------
 // Write process memory
 ssize_t idaapi write_memory(ea_t ea, const void *buffer, size_t size)
 {
-	SNRESULT snr = SN_S_OK;
+	std::vector<uint8> data((uint8 *)buffer, (uint8 *)buffer + size);
 
-	if (SN_FAILED( snr = SNPS3ProcessSetMemory(TargetID, PS3_UI_CPU, ProcessID, -1, ea, size, (byte *)buffer)))
-	{
-		msg("SNPS3ProcessSetMemory Error: %d\n", snr);
+	if (size == 0)
+		return 0;
+
+	std::lock_guard<std::recursive_mutex> guard(dispatch_lock);
+
+	// the local stores can only be read
+	if (spu_table.at(ea) != NULL)
+		return -1;
+
+	// Writing over one of our breakpoints changes the instruction it hides,
+	// the trap itself must stay in place
+	bpt_shadow.absorb(ea, &data[0], size, bpt_code);
+
+	memcache.update(ea, &data[0], size);
+	insn_cache.invalidate(ea, size);
+
+	// Writes are delayed until the process is resumed or the memory is read back
+	pending_writes.add(ea, &data[0], size);
+
+	if (pending_writes.size() >= WRITE_COMBINE_MAX && !flush_pending_writes())
 		return -1;
-	}
 
 	return size;
 }
@@ -2314,6 +3087,14 @@ ssize_t idaapi write_memory(ea_t ea, const void *buffer, size_t size)
 //--------------------------------------------------------------------------
 int idaapi is_ok_bpt(bpttype_t type, ea_t ea, int len)
 {
+	std::lock_guard<std::recursive_mutex> guard(dispatch_lock);
+
+	if (spu_table.at(ea) != NULL)
+	{
+		msg("Breakpoints can't be set in a local store\n");
+		return BPT_BAD_ADDR;
+	}
+
 	switch(type)
 	{
 		case BPT_SOFT:
@@ -2399,20 +3180,193 @@ int idaapi is_ok_bpt(bpttype_t type, ea_t ea, int len)
 
 }
 
+//--------------------------------------------------------------------------
+// Program DABR without disturbing the process when possible
+static void set_dabr(uint64 value)
+{
+	dabr_value = value;
+	dabr_pending = false;
+
+	if (process_stopped)
+	{
+		if (!backend->set_dabr(value))
+			msg("SetDABR Error: %d\n", backend->error());
+
+		debug_printf("DABR: 0x%llX\n", value);
+		return;
+	}
+
+	if (ForceImmediateDABR)
+	{
+		backend->stop();
+
+		if (!backend->set_dabr(value))
+			msg("SetDABR Error: %d\n", backend->error());
+
+		debug_printf("DABR: 0x%llX\n", value);
+
+		backend->resume();
+		return;
+	}
+
+	dabr_pending = true;
+
+	debug_printf("DABR: 0x%llX deferred until the process stops\n", value);
+}
+
+static void apply_pending_dabr(void)
+{
+	if (!dabr_pending || !process_stopped)
+		return;
+
+	dabr_pending = false;
+
+	if (!backend->set_dabr(dabr_value))
+		msg("SetDABR Error: %d\n", backend->error());
+
+	debug_printf("DABR: 0x%llX\n", dabr_value);
+}
+
+//--------------------------------------------------------------------------
+// Install the software breakpoints bpts[idx[...]]: the original words are
+// read first with as few requests as possible, then the traps are set.
+// Returns the number of breakpoints installed.
+static int add_soft_bpts(update_bpt_info_t *bpts, std::vector<int> &idx)
+{
+	std::vector<ea_t> eas;
+	std::vector<uint32> orig;
+	std::vector<bpt_range_t> ranges;
+	std::vector<uint8> buf;
+	int cnt = 0;
+
+	struct lt_ea
+	{
+		const update_bpt_info_t *bpts;
+		bool operator()(int a, int b) const { return bpts[a].ea < bpts[b].ea; }
+	} lt = { bpts };
+
+	std::sort(idx.begin(), idx.end(), lt);
+
+	for (size_t i = 0; i < idx.size(); i++)
+		eas.push_back(bpts[idx[i]].ea);
+
+	orig.resize(idx.size());
+
+	coalesce_bpt_reads(eas, BPT_READ_GAP, MEMCACHE_MAX_READ, &ranges);
+
+	for (size_t r = 0; r < ranges.size(); r++)
+	{
+		const bpt_range_t &range = ranges[r];
+
+		buf.resize(size_t(range.end - range.start));
+
+		// if the whole range can't be read, try its breakpoints one by one
+		bool ok = fetch_target_memory(range.start, &buf[0], uint32(buf.size()), NULL);
+
+		for (size_t i = range.first; i < range.first + range.count; i++)
+		{
+			update_bpt_info_t &b = bpts[idx[i]];
+
+			b.code = BPT_OK;
+
+			if (ok)
+			{
+				memcpy(&orig[i], &buf[size_t(b.ea - range.start)], BPT_SIZE);
+			}
+			else if (!fetch_target_memory(b.ea, &orig[i], BPT_SIZE, NULL))
+			{
+				msg("Can't read original instruction at 0x%llX\n", (uint64)b.ea);
+				b.code = BPT_READ_ERROR;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < idx.size(); i++)
+	{
+		update_bpt_info_t &b = bpts[idx[i]];
+
+		if (b.code != BPT_OK)
+			continue;
+
+		if (!backend->set_breakpoint(-1, b.ea))
+		{
+			msg("SetBreakPoint Error: %d\n", backend->error());
+			b.code = BPT_WRITE_ERROR;
+			continue;
+		}
+
+		if (orig[i] != *(uint32*)bpt_code)
+			bpt_shadow.set(b.ea, orig[i]);
+
+		//debug_printf("orig_inst = 0x%X\n", bswap32(orig[i]));
+
+		b.orgbytes.resize(BPT_SIZE);
+		memcpy(&b.orgbytes[0], &orig[i], BPT_SIZE);
+
+		memcache.invalidate(b.ea, BPT_SIZE);
+
+		main_bpts.add(b.ea);
+
+		cnt++;
+	}
+
+	return cnt;
+}
+
+// Remove the software breakpoints bpts[idx[...]].
+// Returns the number of breakpoints removed.
+static int del_soft_bpts(update_bpt_info_t *bpts, const std::vector<int> &idx)
+{
+	int cnt = 0;
+
+	for (size_t i = 0; i < idx.size(); i++)
+	{
+		update_bpt_info_t &b = bpts[idx[i]];
+
+		if (!backend->clear_breakpoint(-1, b.ea))
+		{
+			msg("ClearBreakPoint Error: %d\n", backend->error());
+			b.code = BPT_WRITE_ERROR;
+			continue;
+		}
+
+		main_bpts.remove(b.ea);
+		restore_written_bpt(b.ea);
+		bpt_shadow.erase(b.ea);
+		memcache.invalidate(b.ea, BPT_SIZE);
+
+		b.code = BPT_OK;
+		cnt++;
+	}
+
+	return cnt;
+}
+
 //--------------------------------------------------------------------------
 int idaapi update_bpts(update_bpt_info_t *bpts, int nadd, int ndel)
 {
 	int i;
-	std::vector<uint32>::iterator it;
-	uint32 orig_inst = -1;
 	uint32 BPCount;
 	int cnt = 0;
+	std::vector<int> soft_add;
+	std::vector<int> soft_del;
+
+	std::lock_guard<std::recursive_mutex> guard(dispatch_lock);
 
 	//SNPS3GetBreakPoints(TargetID, PS3_UI_CPU, ProcessID, -1, &BPCount, NULL);
 	//debug_printf("BreakPoints sum: %d\n", BPCount);
 
 	//bp_list();
 
+	// the original words under new breakpoints must include the writes
+	if (!flush_pending_writes())
+	{
+		for (i = 0; i < nadd + ndel; i++)
+			bpts[i].code = BPT_WRITE_ERROR;
+
+		return 0;
+	}
+
 	for(i = 0; i < nadd; i++) {
 
 		debug_printf("add_bpt: type: %d, ea: 0x%X, code: %d\n", bpts[i].type, bpts[i].ea, bpts[i].code);
@@ -2425,22 +3379,7 @@ int idaapi update_bpts(update_bpt_info_t *bpts, int nadd, int ndel)
 				{
 					debug_printf("Software breakpoint\n");
 
-					SNPS3ProcessGetMemory(TargetID, PS3_UI_CPU, ProcessID, -1, bpts[i].ea, 4, (byte *)&orig_inst);
-
-					if (orig_inst != *(uint32*)bpt_code)
-						main_bpts_map[bpts[i].ea] = orig_inst;
-
-					//debug_printf("orig_inst = 0x%X\n", bswap32(orig_inst));
-
-					bpts[i].orgbytes.push_back(orig_inst);
-
-					SNPS3SetBreakPoint(TargetID, PS3_UI_CPU, ProcessID, -1, bpts[i].ea);
-
-					bpts[i].code = BPT_OK;
-
-					main_bpts.push_back(bpts[i].ea);
-
-					cnt++;
+					soft_add.push_back(i);
 				}
 				break;
 
@@ -2460,13 +3399,7 @@ int idaapi update_bpts(update_bpt_info_t *bpts, int nadd, int ndel)
 
 					if (dabr_is_set == false)
 					{
-						SNPS3ProcessStop(TargetID, ProcessID);
-					
-						SNPS3SetDABR(TargetID, ProcessID, bpts[i].ea | 6);
-					
-						debug_printf("DABR: 0x%X\n", bpts[i].ea | 6);
-					
-						SNPS3ProcessContinue(TargetID, ProcessID);
+						set_dabr(bpts[i].ea | 6);
 					
 						dabr_addr = bpts[i].ea;
 
@@ -2495,13 +3428,7 @@ int idaapi update_bpts(update_bpt_info_t *bpts, int nadd, int ndel)
 
 					if (dabr_is_set == false)
 					{
-						SNPS3ProcessStop(TargetID, ProcessID);
-
-						SNPS3SetDABR(TargetID, ProcessID, bpts[i].ea | 7);
-
-						debug_printf("DABR: 0x%X\n", bpts[i].ea | 7);
-
-						SNPS3ProcessContinue(TargetID, ProcessID);
+						set_dabr(bpts[i].ea | 7);
 
 						dabr_addr = bpts[i].ea;
 
@@ -2526,28 +3453,19 @@ int idaapi update_bpts(update_bpt_info_t *bpts, int nadd, int ndel)
 		}
 	}
 
+	cnt += add_soft_bpts(bpts, soft_add);
+
 	for(i = 0; i < ndel; i++) {
 
 		debug_printf("del_bpt: type: %d, ea: 0x%X, code: %d\n", bpts[nadd + i].type, bpts[nadd + i].ea, bpts[nadd + i].code);
 
-		bpts[nadd + i].code = BPT_OK;
-		cnt++;
-
 		switch(bpts[nadd + i].type)
 		{
 			case BPT_SOFT:
 				{
 					debug_printf("Software breakpoint\n");
 
-					bpts[nadd + i].orgbytes.pop_back();
-
-					SNPS3ClearBreakPoint(TargetID, PS3_UI_CPU, ProcessID, -1, bpts[nadd + i].ea);
-					
-					it = std::find(main_bpts.begin(), main_bpts.end(), bpts[nadd + i].ea);
-
-					main_bpts.erase(it);
-
-					main_bpts_map.erase(bpts[nadd + i].ea);
+					soft_del.push_back(nadd + i);
 				}
 				break;
 
@@ -2567,18 +3485,21 @@ int idaapi update_bpts(update_bpt_info_t *bpts, int nadd, int ndel)
 
 					dabr_addr = 0;
 
-					SNPS3ProcessStop(TargetID, ProcessID);
-					
-					SNPS3SetDABR(TargetID, ProcessID, bpts[nadd + i].ea | 4);
-					
-					debug_printf("DABR: 0x%X\n", bpts[nadd + i].ea | 4);
+					set_dabr(bpts[nadd + i].ea | 4);
 
-					SNPS3ProcessContinue(TargetID, ProcessID);
+					bpts[nadd + i].code = BPT_OK;
+					cnt++;
 				}
 				break;
+
+			default:
+				bpts[nadd + i].code = BPT_OK;
+				cnt++;
 		}
 	}
 
+	cnt += del_soft_bpts(bpts, soft_del);
+
 	//SNPS3GetBreakPoints(TargetID, PS3_UI_CPU, ProcessID, -1, &BPCount, NULL);
 	//debug_printf("BreakPoints sum: %d\n", BPCount);
 
@@ -2611,6 +3532,38 @@ ea_t idaapi map_address(ea_t off, const regval_t *regs, int regnum)
 //-------------------------------------------------------------------------
 int idaapi send_ioctl(int fn, const void *buf, size_t size, void **poutbuf, ssize_t *poutsize)
 {
+	switch (fn)
+	{
+		case DECI3_IOCTL_GET_TMAPI_STATS:
+			{
+				std::vector<tmapi_stat_record_t> stats;
+
+				if (poutbuf == NULL || poutsize == NULL)
+					return -1;
+
+				tmapi_stats.get(&stats);
+
+				*poutsize = stats.size() * sizeof(tmapi_stat_record_t);
+				*poutbuf = NULL;
+
+				if (!stats.empty())
+				{
+					// freed by the caller
+					*poutbuf = qalloc(*poutsize);
+
+					if (*poutbuf == NULL)
+						return -1;
+
+					memcpy(*poutbuf, &stats[0], *poutsize);
+				}
+			}
+			return 1;
+
+		case DECI3_IOCTL_RESET_TMAPI_STATS:
+			tmapi_stats.reset();
+			return 1;
+	}
+
 	return 0;
 }
 
@@ -2632,7 +3585,7 @@ debugger_t debugger =
   registers,					// Array of registers
   qnumber(registers),			// Number of registers
 
-  0x1000,						// Size of a memory page
+  MEMORY_PAGE_SIZE,				// Size of a memory page
 
   bpt_code,						// Array of bytes for a breakpoint instruction
   qnumber(bpt_code),			// Size of this array
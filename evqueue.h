@@ -0,0 +1,114 @@
+#ifndef __EVQUEUE__
+#define __EVQUEUE__
+
+//
+//      Queues of debug events waiting to be reported to IDA
+//
+
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <pro.h>
+#include <idd.hpp>
+
+// Very simple class to store pending events
+enum queue_pos_t
+{
+  IN_FRONT,
+  IN_BACK
+};
+
+struct eventlist_t : public std::deque<debug_event_t>
+{
+private:
+  bool synced;
+public:
+  // save a pending event
+  void enqueue(const debug_event_t &ev, queue_pos_t pos)
+  {
+    if ( pos != IN_BACK )
+      push_front(ev);
+    else
+      push_back(ev);
+  }
+
+  // retrieve a pending event
+  bool retrieve(debug_event_t *event)
+  {
+    if ( empty() )
+      return false;
+    // get the first event and return it
+    *event = front();
+    pop_front();
+    return true;
+  }
+};
+
+// Single producer/single consumer queue of pending events.
+// The ring slots are allocated once: while the ring has room push() and
+// pop() never block nor allocate. When it is full the events spill to an
+// overflow list, in order, until the consumer has drained it: no event is
+// ever dropped. N must be a power of 2.
+template<size_t N>
+class event_ring_t
+{
+  debug_event_t slots[N];
+  std::atomic<size_t> head;       // next slot to read, moved by the consumer
+  std::atomic<size_t> tail;       // next slot to write, moved by the producer
+  std::deque<debug_event_t> spill; // events that came while the ring was full
+  std::atomic<size_t> spilled;    // size of spill
+  std::mutex spill_lock;
+  std::atomic<uint32> overflows;  // events spilled since the last take_overflows()
+public:
+  event_ring_t() : head(0), tail(0), spilled(0), overflows(0) {}
+
+  // producer side
+  void push(const debug_event_t &ev)
+  {
+    size_t t = tail.load(std::memory_order_relaxed);
+    // once an event has spilled the next ones follow it, to keep the order
+    if ( spilled.load(std::memory_order_acquire) == 0
+      && t - head.load(std::memory_order_acquire) != N )
+    {
+      slots[t & (N - 1)] = ev;
+      tail.store(t + 1, std::memory_order_release);
+      return;
+    }
+    std::lock_guard<std::mutex> lock(spill_lock);
+    spill.push_back(ev);
+    spilled.store(spill.size(), std::memory_order_release);
+    overflows.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // consumer side, the spilled events come after all those of the ring
+  bool pop(debug_event_t *ev)
+  {
+    // read before the ring: while spilled events wait, the producer can't
+    // add to the ring anything that should come before them
+    size_t s = spilled.load(std::memory_order_acquire);
+    size_t h = head.load(std::memory_order_relaxed);
+    if ( h != tail.load(std::memory_order_acquire) )
+    {
+      *ev = slots[h & (N - 1)];
+      head.store(h + 1, std::memory_order_release);
+      return true;
+    }
+    if ( s == 0 )
+      return false;
+    std::lock_guard<std::mutex> lock(spill_lock);
+    *ev = spill.front();
+    spill.pop_front();
+    spilled.store(spill.size(), std::memory_order_release);
+    return true;
+  }
+
+  bool empty(void) const
+  {
+    return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire)
+        && spilled.load(std::memory_order_acquire) == 0;
+  }
+
+  uint32 take_overflows(void) { return overflows.exchange(0); }
+};
+
+#endif
@@ -0,0 +1,109 @@
+// Copyright (C) 2014 oct0xor
+//
+// This program is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License 2.0 for more details.
+//
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http ://www.gnu.org/licenses/
+
+
+#include <stdio.h>
+#include <chrono>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "evtrace.h"
+
+//--------------------------------------------------------------------------
+// std::chrono clocks are too coarse on VS2013
+uint64 host_clock(void)
+{
+#ifdef _WIN32
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER now;
+
+	if (freq.QuadPart == 0)
+		QueryPerformanceFrequency(&freq);
+
+	QueryPerformanceCounter(&now);
+
+	return uint64(now.QuadPart / freq.QuadPart) * 1000000000 + uint64(now.QuadPart % freq.QuadPart) * 1000000000 / freq.QuadPart;
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+//--------------------------------------------------------------------------
+void event_trace_t::init(size_t capacity)
+{
+	records.clear();
+	records.resize(capacity);
+	clear();
+}
+
+void event_trace_t::clear(void)
+{
+	total = 0;
+	start = host_clock();
+	start_epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+//--------------------------------------------------------------------------
+void event_trace_t::add(uint32 type, uint64 tid, uint64 ea, uint32 arg, uint64 target_time)
+{
+	if (records.empty())
+		return;
+
+	evtrace_record_t &r = records[size_t(total % records.size())];
+
+	r.host_time = host_clock() - start;
+	r.target_time = target_time;
+	r.tid = tid;
+	r.ea = ea;
+	r.type = type;
+	r.arg = arg;
+
+	total++;
+}
+
+//--------------------------------------------------------------------------
+int event_trace_t::save(const char *path) const
+{
+	FILE *fp = fopen(path, "wb");
+
+	if (fp == NULL)
+		return -1;
+
+	evtrace_header_t hdr;
+	size_t count = size();
+
+	hdr.magic = EVTRACE_MAGIC;
+	hdr.version = EVTRACE_VERSION;
+	hdr.record_size = sizeof(evtrace_record_t);
+	hdr.count = uint32(count);
+	hdr.dropped = uint32(total - count);
+	hdr.host_start = start_epoch;
+
+	bool ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1;
+
+	// the oldest record is the next one to be overwritten
+	size_t first = total > records.size() ? size_t(total % records.size()) : 0;
+
+	if (ok && first != 0)
+		ok = fwrite(&records[first], sizeof(evtrace_record_t), records.size() - first, fp) == records.size() - first;
+
+	if (ok && count != 0)
+		ok = fwrite(&records[0], sizeof(evtrace_record_t), first != 0 ? first : count, fp) == (first != 0 ? first : count);
+
+	ok = fclose(fp) == 0 && ok;
+
+	return ok ? int(count) : -1;
+}
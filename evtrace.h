@@ -0,0 +1,69 @@
+#ifndef __EVTRACE__
+#define __EVTRACE__
+
+//
+//      Trace of the debug events received from the target.
+//      Records are kept in a fixed-size ring, the oldest ones are
+//      overwritten, and can be saved to a compact binary file.
+//
+
+#include <vector>
+#include <pro.h>
+
+#define EVTRACE_MAGIC   0x52543344      // "D3TR"
+#define EVTRACE_VERSION 2
+
+// Monotonic host clock in ns
+uint64 host_clock(void);
+
+#pragma pack(push, 1)
+
+// File layout: evtrace_header_t followed by 'count' records, oldest first
+struct evtrace_header_t
+{
+	uint32 magic;
+	uint16 version;
+	uint16 record_size;
+	uint32 count;                   // records in the file
+	uint32 dropped;                 // older records overwritten in the ring
+	uint64 host_start;              // host time the trace was started or cleared, ns since epoch,
+	                                // the origin of the record host times
+};
+
+struct evtrace_record_t
+{
+	uint64 host_time;               // ns since the trace was started
+	uint64 target_time;             // target timebase, 0 if the event carries none
+	uint64 tid;
+	uint64 ea;                      // pc, module id...
+	uint32 type;                    // TEV_*
+	uint32 arg;                     // event specific
+};
+
+#pragma pack(pop)
+
+class event_trace_t
+{
+	std::vector<evtrace_record_t> records;
+	uint64 total;                   // records added since the last clear
+	uint64 start;                   // host clock at the last clear
+	uint64 start_epoch;
+
+public:
+	event_trace_t() : total(0), start(0), start_epoch(0) {}
+
+	// Allocate room for 'capacity' records, 0 disables the trace
+	void init(size_t capacity);
+
+	void add(uint32 type, uint64 tid, uint64 ea, uint32 arg, uint64 target_time);
+
+	// Write the trace to 'path'. Returns the number of records written or -1.
+	int save(const char *path) const;
+
+	void clear(void);
+
+	size_t size(void) const { return size_t(qmin(total, (uint64)records.size())); }
+	size_t capacity(void) const { return records.size(); }
+};
+
+#endif
@@ -0,0 +1,238 @@
+// Copyright (C) 2014 oct0xor
+//
+// This program is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License 2.0 for more details.
+//
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http ://www.gnu.org/licenses/
+
+#include "memcache.h"
+
+//--------------------------------------------------------------------------
+void mem_cache_t::copy_out(uint32 page, const uint8 *data, ea_t ea, void *buffer, size_t size)
+{
+	ea_t page_ea = (ea_t)page * MEMORY_PAGE_SIZE;
+	ea_t start = qmax(page_ea, ea);
+	ea_t end = qmin(page_ea + MEMORY_PAGE_SIZE, ea + size);
+
+	memcpy((uint8 *)buffer + (start - ea), data + (start - page_ea), end - start);
+}
+
+//--------------------------------------------------------------------------
+bool mem_cache_t::read(ea_t ea, void *buffer, size_t size, mem_fetch_t *fetch, void *ud)
+{
+	if (size == 0)
+		return true;
+
+	uint32 first = uint32(ea / MEMORY_PAGE_SIZE);
+	uint32 last = uint32((ea + size - 1) / MEMORY_PAGE_SIZE);
+	uint32 page = first;
+
+	while (page <= last)
+	{
+		std::unordered_map<uint32, page_t>::const_iterator it = pages.find(page);
+
+		if (it != pages.end())
+		{
+			copy_out(page, &it->second[0], ea, buffer, size);
+			hits++;
+			page++;
+			continue;
+		}
+
+		// fetch the whole run of missing pages at once
+		uint32 run_end = page + 1;
+
+		while (run_end <= last && pages.find(run_end) == pages.end())
+			run_end++;
+
+		uint32 npages = run_end - page;
+		page_t run(npages * MEMORY_PAGE_SIZE);
+
+		if (!fetch((ea_t)page * MEMORY_PAGE_SIZE, &run[0], uint32(run.size()), ud))
+			return false;
+
+		misses += npages;
+
+		if (pages.size() + npages > MEMCACHE_MAX_PAGES)
+			pages.clear();
+
+		for (uint32 i = 0; i < npages; i++)
+		{
+			page_t &data = pages[page + i];
+			data.assign(run.begin() + i * MEMORY_PAGE_SIZE, run.begin() + (i + 1) * MEMORY_PAGE_SIZE);
+			copy_out(page + i, &data[0], ea, buffer, size);
+		}
+
+		page = run_end;
+	}
+
+	return true;
+}
+
+//--------------------------------------------------------------------------
+void mem_cache_t::invalidate(ea_t ea, size_t size)
+{
+	if (size == 0 || pages.empty())
+		return;
+
+	uint32 first = uint32(ea / MEMORY_PAGE_SIZE);
+	uint32 last = uint32((ea + size - 1) / MEMORY_PAGE_SIZE);
+
+	for (uint32 page = first; page <= last; page++)
+		pages.erase(page);
+}
+
+//--------------------------------------------------------------------------
+void mem_cache_t::update(ea_t ea, const void *buffer, size_t size)
+{
+	if (size == 0 || pages.empty())
+		return;
+
+	uint32 first = uint32(ea / MEMORY_PAGE_SIZE);
+	uint32 last = uint32((ea + size - 1) / MEMORY_PAGE_SIZE);
+
+	for (uint32 page = first; page <= last; page++)
+	{
+		std::unordered_map<uint32, page_t>::iterator it = pages.find(page);
+
+		if (it == pages.end())
+			continue;
+
+		ea_t page_ea = (ea_t)page * MEMORY_PAGE_SIZE;
+		ea_t start = qmax(page_ea, ea);
+		ea_t end = qmin(page_ea + MEMORY_PAGE_SIZE, ea + size);
+
+		memcpy(&it->second[0] + (start - page_ea), (const uint8 *)buffer + (start - ea), end - start);
+	}
+}
+
+//--------------------------------------------------------------------------
+size_t chunked_read(ea_t ea, void *buffer, size_t size, mem_fetch_t *fetch, void *ud, uint32 chunk_size)
+{
+	if (chunk_size == 0)
+		chunk_size = MEMORY_PAGE_SIZE;
+
+	// each request costs a round trip, so the whole range goes in one
+	if (size_t(uint32(size)) == size && fetch(ea, buffer, uint32(size), ud))
+		return size;
+
+	uint8 *dst = (uint8 *)buffer;
+	size_t done = 0;
+
+	while (done < size)
+	{
+		uint32 len = uint32(qmin(size_t(chunk_size), size - done));
+
+		if (!fetch(ea + done, dst + done, len, ud))
+			break;
+
+		done += len;
+	}
+
+	if (done == size)
+		return size;
+
+	// The failed chunk may still start with readable pages
+	size_t chunk_end = qmin(done + chunk_size, size);
+
+	while (done < chunk_end)
+	{
+		uint32 len = uint32(qmin(size_t(MEMORY_PAGE_SIZE - (ea + done) % MEMORY_PAGE_SIZE), chunk_end - done));
+
+		if (!fetch(ea + done, dst + done, len, ud))
+			break;
+
+		done += len;
+	}
+
+	return done;
+}
+
+//--------------------------------------------------------------------------
+void write_combiner_t::add(ea_t ea, const void *buffer, size_t size)
+{
+	if (size == 0)
+		return;
+
+	writes++;
+
+	ea_t start = ea;
+	ea_t end = ea + size;
+
+	// find the first range touching [ea, ea+size)
+	ranges_t::iterator first = ranges.upper_bound(ea);
+
+	if (first != ranges.begin())
+	{
+		ranges_t::iterator prev = first;
+		--prev;
+
+		if (prev->first + prev->second.size() >= ea)
+			first = prev;
+	}
+
+	ranges_t::iterator last = first;
+
+	while (last != ranges.end() && last->first <= end)
+	{
+		start = qmin(start, last->first);
+		end = qmax(end, ea_t(last->first + last->second.size()));
+		++last;
+	}
+
+	std::vector<uint8> merged(size_t(end - start));
+
+	for (ranges_t::iterator it = first; it != last; ++it)
+	{
+		memcpy(&merged[0] + (it->first - start), &it->second[0], it->second.size());
+		pending -= it->second.size();
+	}
+
+	memcpy(&merged[0] + (ea - start), buffer, size);
+
+	ranges.erase(first, last);
+	pending += merged.size();
+	ranges[start].swap(merged);
+}
+
+//--------------------------------------------------------------------------
+bool write_combiner_t::overlaps(ea_t ea, size_t size) const
+{
+	if (size == 0 || ranges.empty())
+		return false;
+
+	ranges_t::const_iterator it = ranges.lower_bound(ea + size);
+
+	if (it == ranges.begin())
+		return false;
+
+	--it;
+
+	return it->first + it->second.size() > ea;
+}
+
+//--------------------------------------------------------------------------
+bool write_combiner_t::flush(mem_store_t *store, void *ud)
+{
+	bool ok = true;
+
+	for (ranges_t::const_iterator it = ranges.begin(); it != ranges.end(); ++it)
+	{
+		if (!store(it->first, &it->second[0], uint32(it->second.size()), ud))
+			ok = false;
+
+		transfers++;
+	}
+
+	ranges.clear();
+	pending = 0;
+
+	return ok;
+}
@@ -0,0 +1,97 @@
+#ifndef __MEMCACHE__
+#define __MEMCACHE__
+
+//
+//      Host side cache of target memory pages.
+//      The cache is only valid while the process is stopped: it must be
+//      flushed whenever the target is resumed or its memory is modified.
+//
+
+#include <map>
+#include <vector>
+#include <unordered_map>
+#include <pro.h>
+
+#define MEMORY_PAGE_SIZE 0x1000
+
+// Number of pages kept before the cache is recycled
+#define MEMCACHE_MAX_PAGES 1024
+
+// Reads bigger than this bypass the cache
+#define MEMCACHE_MAX_READ (16 * MEMORY_PAGE_SIZE)
+
+// Reads 'size' bytes of target memory at 'ea'. Returns true on success.
+typedef bool mem_fetch_t(ea_t ea, void *buffer, uint32 size, void *ud);
+
+// Writes 'size' bytes of target memory at 'ea'. Returns true on success.
+typedef bool mem_store_t(ea_t ea, const void *buffer, uint32 size, void *ud);
+
+// Read [ea, ea+size) in a single request. If it fails, the range is read
+// again in units of 'chunk_size' bytes to find out how much of it can be.
+// Returns the number of bytes read from the beginning of the range.
+size_t chunked_read(ea_t ea, void *buffer, size_t size, mem_fetch_t *fetch, void *ud, uint32 chunk_size);
+
+class mem_cache_t
+{
+	typedef std::vector<uint8> page_t;
+	std::unordered_map<uint32, page_t> pages;
+
+	void copy_out(uint32 page, const uint8 *data, ea_t ea, void *buffer, size_t size);
+
+public:
+	uint32 hits;
+	uint32 misses;
+
+	mem_cache_t() : hits(0), misses(0) {}
+
+	// Copy [ea, ea+size) into 'buffer'. Missing pages are fetched with
+	// 'fetch', contiguous runs of missing pages in a single request.
+	// Returns false if the range could not be fetched.
+	bool read(ea_t ea, void *buffer, size_t size, mem_fetch_t *fetch, void *ud);
+
+	// Apply a write to the pages already cached
+	void update(ea_t ea, const void *buffer, size_t size);
+
+	// Forget the pages overlapping [ea, ea+size)
+	void invalidate(ea_t ea, size_t size);
+
+	// Forget everything
+	void flush(void) { pages.clear(); }
+
+	size_t size(void) const { return pages.size(); }
+	void reset_stats(void) { hits = misses = 0; }
+};
+
+// Pending pages are sent once this many bytes are buffered
+#define WRITE_COMBINE_MAX 0x10000
+
+// Buffer of pending writes. Overlapping and adjacent writes are merged
+// so that they reach the target in as few transfers as possible.
+class write_combiner_t
+{
+	typedef std::map<ea_t, std::vector<uint8> > ranges_t;
+	ranges_t ranges;
+	size_t pending;
+
+public:
+	uint32 writes;
+	uint32 transfers;
+
+	write_combiner_t() : pending(0), writes(0), transfers(0) {}
+
+	// Queue a write, newer bytes replace older ones
+	void add(ea_t ea, const void *buffer, size_t size);
+
+	// Is any byte of [ea, ea+size) waiting to be written?
+	bool overlaps(ea_t ea, size_t size) const;
+
+	// Send every merged range with 'store' and forget them.
+	// Returns false if any of the transfers failed.
+	bool flush(mem_store_t *store, void *ud);
+
+	bool empty(void) const { return ranges.empty(); }
+	size_t size(void) const { return pending; }
+	void reset_stats(void) { writes = transfers = 0; }
+};
+
+#endif
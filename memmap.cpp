@@ -0,0 +1,179 @@
+// Copyright (C) 2014 oct0xor
+//
+// This program is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License 2.0 for more details.
+//
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http ://www.gnu.org/licenses/
+
+#include <string.h>
+#include <algorithm>
+#include <kernwin.hpp>
+#include "memmap.h"
+
+//--------------------------------------------------------------------------
+void memory_map_t::clear(void)
+{
+	modules.clear();
+	image.clear();
+	vm.clear();
+	stale = true;
+	vm_stale = true;
+	reported = 0;
+}
+
+static bool area_less(const mem_area_t &a, const mem_area_t &b)
+{
+	return a.start < b.start;
+}
+
+void memory_map_t::build(std::vector<mem_area_t> *areas) const
+{
+	std::vector<mem_area_t> named(image);
+	char name[MAXSTR];
+
+	for (std::map<uint32, target_module_t>::const_iterator it = modules.begin(); it != modules.end(); ++it)
+	{
+		const target_module_t &mod = it->second;
+
+		// "elf name - module name"
+		size_t sep = mod.name.rfind(" - ");
+		std::string base = sep != std::string::npos ? mod.name.substr(sep + 3) : mod.name;
+
+		// the text segment comes first, then the data
+		for (size_t i = 0; i < mod.segments.size(); i++)
+		{
+			const target_segment_t &s = mod.segments[i];
+
+			if (s.mem_size == 0)
+				continue;
+
+			if (i == 0)
+				qsnprintf(name, sizeof(name), "%s.text", base.c_str());
+			else if (i == 1)
+				qsnprintf(name, sizeof(name), "%s.data", base.c_str());
+			else
+				qsnprintf(name, sizeof(name), "%s.data%u", base.c_str(), (uint32)i);
+
+			if (i == 0)
+				named.push_back(mem_area_t(s.base, s.base + s.mem_size, name, "CODE", MEM_PERM_READ | MEM_PERM_EXEC));
+			else
+				named.push_back(mem_area_t(s.base, s.base + s.mem_size, name, "DATA", MEM_PERM_READ | MEM_PERM_WRITE));
+		}
+	}
+
+	if (threads != NULL)
+	{
+		for (thread_table_t::const_iterator it = threads->begin(); it != threads->end(); ++it)
+		{
+			const target_thread_t &t = it->second;
+
+			if (t.stack_size == 0)
+				continue;
+
+			qsnprintf(name, sizeof(name), "stack_%llX", t.tid);
+			named.push_back(mem_area_t(t.stack_addr, t.stack_addr + t.stack_size, name, "STACK", MEM_PERM_READ | MEM_PERM_WRITE));
+		}
+	}
+
+	if (spus != NULL)
+	{
+		for (spu_table_t::const_iterator it = spus->begin(); it != spus->end(); ++it)
+		{
+			const spu_thread_t &t = it->second;
+			uint64 start = spus->window(t);
+
+			// read only, the local stores are served from their snapshots
+			qsnprintf(name, sizeof(name), "spu_ls_%X", t.tid);
+			named.push_back(mem_area_t(start, start + SPU_LS_SIZE, name, "CODE", MEM_PERM_READ | MEM_PERM_EXEC));
+		}
+	}
+
+	// earlier areas win where they overlap
+	std::stable_sort(named.begin(), named.end(), area_less);
+
+	areas->clear();
+
+	for (size_t i = 0; i < named.size(); i++)
+	{
+		mem_area_t a = named[i];
+
+		if (!areas->empty())
+			a.start = qmax(a.start, areas->back().end);
+
+		if (a.start < a.end)
+			areas->push_back(a);
+	}
+
+	size_t count = areas->size();
+
+	for (size_t i = 0; i < vm.size(); i++)
+	{
+		uint64 start = vm[i].base;
+		uint64 end = vm[i].base + vm[i].size;
+
+		size_t j = std::upper_bound(areas->begin(), areas->begin() + count, mem_area_t(start, start, "", "", 0), area_less) - areas->begin();
+
+		if (j != 0)
+			j--;
+
+		// the pieces not covered by a named area
+		for (; j < count && start < end; j++)
+		{
+			uint64 named_start = (*areas)[j].start;
+			uint64 named_end = (*areas)[j].end;
+
+			if (named_start >= end)
+				break;
+
+			if (named_end <= start)
+				continue;
+
+			if (named_start > start)
+				areas->push_back(mem_area_t(start, named_start, "", "", MEM_PERM_READ | MEM_PERM_WRITE));
+
+			start = named_end;
+		}
+
+		if (start < end)
+			areas->push_back(mem_area_t(start, end, "", "", MEM_PERM_READ | MEM_PERM_WRITE));
+	}
+
+	std::sort(areas->begin(), areas->end(), area_less);
+}
+
+//--------------------------------------------------------------------------
+// FNV-1a
+static uint64 hash_bytes(uint64 h, const void *data, size_t size)
+{
+	const uint8 *p = (const uint8 *)data;
+
+	for (size_t i = 0; i < size; i++)
+		h = (h ^ p[i]) * 0x100000001B3ULL;
+
+	return h;
+}
+
+uint64 memory_map_t::fingerprint(const std::vector<mem_area_t> &areas)
+{
+	uint64 h = 0xCBF29CE484222325ULL;
+
+	for (size_t i = 0; i < areas.size(); i++)
+	{
+		const mem_area_t &a = areas[i];
+
+		h = hash_bytes(h, &a.start, sizeof(a.start));
+		h = hash_bytes(h, &a.end, sizeof(a.end));
+		h = hash_bytes(h, &a.perm, sizeof(a.perm));
+		h = hash_bytes(h, a.name.c_str(), a.name.size() + 1);
+		h = hash_bytes(h, a.sclass.c_str(), a.sclass.size() + 1);
+	}
+
+	return h;
+}
@@ -0,0 +1,73 @@
+#ifndef __MEMMAP__
+#define __MEMMAP__
+
+//
+//      Memory map of the process, as returned by get_memory_info.
+//      The areas come from the virtual memory areas reported by the target,
+//      the segments of the loaded modules, the stacks of the thread table,
+//      the local store windows of the SPU threads and the segments of the
+//      database. A fingerprint of the last map returned
+//      tells IDA when nothing changed.
+//
+
+#include <map>
+#include <vector>
+#include <string>
+#include "backend.h"
+#include "threads.h"
+#include "spu.h"
+
+// Same values as SEGPERM_...
+#define MEM_PERM_EXEC  1
+#define MEM_PERM_WRITE 2
+#define MEM_PERM_READ  4
+
+struct mem_area_t
+{
+	uint64 start;
+	uint64 end;
+	std::string name;
+	std::string sclass;                 // "CODE", "DATA", "STACK" or empty
+	uint8 perm;                         // MEM_PERM_...
+
+	mem_area_t() : start(0), end(0), perm(0) {}
+	mem_area_t(uint64 _start, uint64 _end, const char *_name, const char *_sclass, uint8 _perm)
+		: start(_start), end(_end), name(_name), sclass(_sclass), perm(_perm) {}
+};
+
+class memory_map_t
+{
+public:
+	// Inputs, kept up to date from the target events
+	std::map<uint32, target_module_t> modules;          // by module id
+	std::vector<mem_area_t> image;                      // segments of the database
+	std::vector<target_memory_area_t> vm;               // from the target
+
+	// Set when an input changed, cleared once the map is returned
+	bool stale;
+
+	// Set when a module or a thread came or went, 'vm' has to be fetched
+	// again. Memory the process maps by itself shows up with the next one.
+	bool vm_stale;
+
+	// Fingerprint of the map last returned
+	uint64 reported;
+
+	// Stacks of these threads, local stores of these SPU threads
+	const thread_table_t *threads;
+	const spu_table_t *spus;
+
+	memory_map_t() : stale(true), vm_stale(true), reported(0), threads(NULL), spus(NULL) {}
+
+	// Forget the inputs, but not the thread table
+	void clear(void);
+
+	// Named areas first: the database, then modules, stacks and local stores,
+	// clipped where they overlap the previous ones. The virtual memory areas
+	// fill the rest. Sorted by address.
+	void build(std::vector<mem_area_t> *areas) const;
+
+	static uint64 fingerprint(const std::vector<mem_area_t> &areas);
+};
+
+#endif
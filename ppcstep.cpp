@@ -0,0 +1,164 @@
+// Copyright (C) 2014 oct0xor
+//
+// This program is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License 2.0 for more details.
+//
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http ://www.gnu.org/licenses/
+
+#include <algorithm>
+#include "ppcstep.h"
+#include "backend.h"
+
+// Branch forms, told apart by the primary and extended opcodes
+struct branch_form_t
+{
+	uint32 mask;
+	uint32 match;
+	uint32 dest;                        // STEP_TARGET, STEP_LR or STEP_CTR
+	uint32 disp;                        // displacement bits, for STEP_TARGET
+	bool cond;                          // BO field present
+};
+
+static const branch_form_t branch_forms[] =
+{
+	{ 0xFC000000, 0x48000000, STEP_TARGET, 0x03FFFFFC, false },  // b, ba, bl, bla
+	{ 0xFC000000, 0x40000000, STEP_TARGET, 0x0000FFFC, true },   // bc, bca, bcl, bcla
+	{ 0xFC0007FE, 0x4C000020, STEP_LR,     0,          true },   // bclr, bclrl
+	{ 0xFC0007FE, 0x4C000420, STEP_CTR,    0,          true },   // bcctr, bcctrl
+};
+
+#define INSN_AA   0x00000002            // absolute address
+#define INSN_LK   0x00000001            // link, the return address goes to LR
+#define BO_ALWAYS 0x14                  // don't test CR, don't decrement CTR
+
+//--------------------------------------------------------------------------
+void ppc_decode_step(uint32 insn, uint32 ea, ppc_step_t *step)
+{
+	step->flags = STEP_NEXT;
+	step->target = ea + 4;
+
+	for (size_t i = 0; i < qnumber(branch_forms); i++)
+	{
+		const branch_form_t &f = branch_forms[i];
+
+		if ((insn & f.mask) != f.match)
+			continue;
+
+		uint32 bo = (insn >> 21) & 0x1F;
+
+		step->flags = f.dest;
+
+		if (f.cond && (bo & BO_ALWAYS) != BO_ALWAYS)
+			step->flags |= STEP_NEXT;
+
+		if (insn & INSN_LK)
+			step->flags |= STEP_CALL;
+
+		if (f.dest == STEP_TARGET)
+		{
+			// sign extend from the top displacement bit
+			uint32 disp = insn & f.disp;
+			uint32 sign = (f.disp + 4) >> 1;
+
+			if (disp & sign)
+				disp |= ~f.disp & ~3;
+
+			step->target = (insn & INSN_AA) ? disp : ea + disp;
+		}
+
+		return;
+	}
+}
+
+//--------------------------------------------------------------------------
+bool ppc_range_exits(uint32 start, uint32 end, bool over_calls, insn_fetch_t *fetch, void *ud, ppc_range_t *range)
+{
+	range->exits.clear();
+	range->stops.clear();
+
+	if (end <= start || end - start > RANGE_MAX_SIZE)
+		return false;
+
+	for (uint32 ea = start; ea < end; ea += 4)
+	{
+		const cached_insn_t *c = fetch(ea, ud);
+
+		if (c == NULL)
+			return false;
+
+		uint32 flags = c->step.flags;
+
+		if (over_calls && (flags & STEP_CALL))
+			flags = STEP_NEXT;
+
+		if ((flags & STEP_NEXT) && ea + 4 == end)
+			range->exits.push_back(end);
+
+		if (flags & (STEP_LR | STEP_CTR))
+			range->stops.push_back(ea);
+
+		if ((flags & STEP_TARGET) && (c->step.target < start || c->step.target >= end))
+			range->exits.push_back(c->step.target);
+	}
+
+	std::sort(range->exits.begin(), range->exits.end());
+	range->exits.erase(std::unique(range->exits.begin(), range->exits.end()), range->exits.end());
+
+	return true;
+}
+
+//--------------------------------------------------------------------------
+const cached_insn_t *insn_cache_t::find(ea_t ea)
+{
+	insn_map_t::const_iterator it = insns.find(ea);
+
+	if (it == insns.end())
+	{
+		misses++;
+		return NULL;
+	}
+
+	hits++;
+	return &it->second;
+}
+
+const cached_insn_t *insn_cache_t::add(ea_t ea, uint32 word)
+{
+	cached_insn_t &c = insns[ea];
+
+	c.word = word;
+	ppc_decode_step(bswap32(word), uint32(ea), &c.step);
+
+	return &c;
+}
+
+void insn_cache_t::invalidate(ea_t ea, size_t size)
+{
+	if (insns.empty() || size == 0)
+		return;
+
+	ea_t first = ea & ~ea_t(3);
+
+	// a big write is cheaper to check against every entry
+	if (size / 4 > insns.size())
+	{
+		for (insn_map_t::iterator it = insns.begin(); it != insns.end(); )
+		{
+			if (it->first + 4 > ea && it->first < ea + size)
+				it = insns.erase(it);
+			else
+				++it;
+		}
+		return;
+	}
+
+	for (ea_t a = first; a < ea + size; a += 4)
+		insns.erase(a);
+}
@@ -0,0 +1,92 @@
+#ifndef __PPCSTEP__
+#define __PPCSTEP__
+
+//
+//      Where a single step of a PPU instruction may end up.
+//      Only branches are decoded: their destination is either encoded in
+//      the instruction or taken from LR or CTR, the rest falls through.
+//
+
+#include <vector>
+#include <unordered_map>
+#include <pro.h>
+
+// Destinations of a step
+#define STEP_NEXT   0x01                // the following instruction
+#define STEP_TARGET 0x02                // ppc_step_t::target
+#define STEP_LR     0x04                // the address held in LR
+#define STEP_CTR    0x08                // the address held in CTR
+#define STEP_CALL   0x10                // the branch sets LR (bl, bcl, bclrl, bcctrl)
+
+struct ppc_step_t
+{
+	uint32 flags;                       // STEP_...
+	uint32 target;                      // branch destination if STEP_TARGET is set
+};
+
+// Decode 'insn' (host byte order) found at 'ea'. Unconditional branches
+// only reach their destination, conditional ones may also fall through.
+void ppc_decode_step(uint32 insn, uint32 ea, ppc_step_t *step);
+
+// Decoded instructions of the process, keyed by address. The words are the
+// original instructions (never our traps), in target byte order, so they
+// also stand for a memory read when a breakpoint is planted over them.
+// Entries must be invalidated whenever the memory they come from is written.
+// The pointers handed out stay valid until the entry is invalidated or the
+// cache trimmed or cleared, adding never drops an entry.
+#define INSN_CACHE_MAX 0x10000
+
+struct cached_insn_t
+{
+	uint32 word;                        // target byte order
+	ppc_step_t step;
+};
+
+class insn_cache_t
+{
+	typedef std::unordered_map<ea_t, cached_insn_t> insn_map_t;
+	insn_map_t insns;
+
+public:
+	uint32 hits;
+	uint32 misses;
+
+	insn_cache_t() : hits(0), misses(0) {}
+
+	// NULL if 'ea' has not been decoded yet
+	const cached_insn_t *find(ea_t ea);
+
+	// Decode and remember the instruction 'word' (target byte order) at 'ea'
+	const cached_insn_t *add(ea_t ea, uint32 word);
+
+	// Forget the instructions overlapping [ea, ea+size)
+	void invalidate(ea_t ea, size_t size);
+
+	// Start over once INSN_CACHE_MAX instructions are held, only where no
+	// pointer to an entry is in use
+	void trim(void) { if (insns.size() >= INSN_CACHE_MAX) insns.clear(); }
+
+	void clear(void) { insns.clear(); }
+	size_t size(void) const { return insns.size(); }
+	void reset_stats(void) { hits = misses = 0; }
+};
+
+// Where a thread running from inside [start, end) may leave it. The
+// destination of a branch through LR or CTR is only known when the thread
+// reaches it, such branches are reported as stops instead.
+#define RANGE_MAX_SIZE 0x4000
+
+typedef const cached_insn_t *insn_fetch_t(ea_t ea, void *ud);
+
+struct ppc_range_t
+{
+	std::vector<uint32> exits;          // destinations outside the range, sorted
+	std::vector<uint32> stops;          // branches through LR or CTR inside the range
+};
+
+// Scan the instructions of [start, end) got from 'fetch'. With 'over_calls'
+// a call is expected to come back to the following instruction. Fails if the
+// range is too big or an instruction can't be fetched.
+bool ppc_range_exits(uint32 start, uint32 end, bool over_calls, insn_fetch_t *fetch, void *ud, ppc_range_t *range);
+
+#endif
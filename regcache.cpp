@@ -0,0 +1,148 @@
+// Copyright (C) 2014 oct0xor
+//
+// This program is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License 2.0 for more details.
+//
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http ://www.gnu.org/licenses/
+
+#include "regcache.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define HAVE_SSE2
+#endif
+
+//--------------------------------------------------------------------------
+void bswap128(uint8 *dst, const uint8 *src, size_t count)
+{
+#ifdef HAVE_SSE2
+	for (size_t i = 0; i < count; i++, src += 16, dst += 16)
+	{
+		__m128i x = _mm_loadu_si128((const __m128i *)src);
+
+		// bytes within words, words within quads, then the two quads
+		x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+		x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(0, 1, 2, 3));
+		x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(0, 1, 2, 3));
+		x = _mm_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2));
+
+		_mm_storeu_si128((__m128i *)dst, x);
+	}
+#else
+	for (size_t i = 0; i < count; i++, src += 16, dst += 16)
+	{
+		uint8 tmp[16];
+
+		for (int j = 0; j < 16; j++)
+			tmp[j] = src[15 - j];
+
+		memcpy(dst, tmp, 16);
+	}
+#endif
+}
+
+//--------------------------------------------------------------------------
+const uint8 *reg_cache_t::fetch(uint64 tid, int clsmask, reg_fetch_t *fetch, void *ud)
+{
+	thread_regs_t &regs = threads[tid];
+
+	if (regs.slots.empty())
+		regs.slots.resize(nregs * REGCACHE_SLOT_SIZE);
+
+	int missing = clsmask & ~regs.valid;
+
+	if (missing == 0)
+	{
+		hits++;
+		return &regs.slots[0];
+	}
+
+	misses++;
+
+	std::vector<uint32> want;
+	std::vector<int> index;
+
+	for (int i = 0; i < nregs; i++)
+	{
+		if (classes[i] & missing)
+		{
+			want.push_back(ids[i]);
+			index.push_back(i);
+		}
+	}
+
+	if (!want.empty())
+	{
+		std::vector<uint8> buf(want.size() * REGCACHE_SLOT_SIZE);
+
+		if (!fetch(tid, uint32(want.size()), &want[0], &buf[0], ud))
+			return NULL;
+
+		for (size_t i = 0; i < index.size(); i++)
+			memcpy(&regs.slots[index[i] * REGCACHE_SLOT_SIZE], &buf[i * REGCACHE_SLOT_SIZE], REGCACHE_SLOT_SIZE);
+	}
+
+	regs.valid |= missing;
+
+	return &regs.slots[0];
+}
+
+//--------------------------------------------------------------------------
+void thread_snapshot_t::clear(void)
+{
+	tid.clear();
+	pc.clear();
+	lr.clear();
+	sp.clear();
+	ctr.clear();
+}
+
+void thread_snapshot_t::reserve(size_t n)
+{
+	tid.reserve(n);
+	pc.reserve(n);
+	lr.reserve(n);
+	sp.reserve(n);
+	ctr.reserve(n);
+}
+
+void thread_snapshot_t::add(uint64 _tid, uint64 _pc, uint64 _lr, uint64 _sp, uint64 _ctr)
+{
+	tid.push_back(_tid);
+	pc.push_back(_pc);
+	lr.push_back(_lr);
+	sp.push_back(_sp);
+	ctr.push_back(_ctr);
+}
+
+void thread_snapshot_t::erase(uint64 _tid)
+{
+	int i = find(_tid);
+
+	if (i < 0)
+		return;
+
+	tid[i] = tid.back(); tid.pop_back();
+	pc[i] = pc.back(); pc.pop_back();
+	lr[i] = lr.back(); lr.pop_back();
+	sp[i] = sp.back(); sp.pop_back();
+	ctr[i] = ctr.back(); ctr.pop_back();
+}
+
+int thread_snapshot_t::find(uint64 _tid) const
+{
+	for (size_t i = 0; i < tid.size(); i++)
+	{
+		if (tid[i] == _tid)
+			return int(i);
+	}
+
+	return -1;
+}
@@ -0,0 +1,86 @@
+#ifndef __REGCACHE__
+#define __REGCACHE__
+
+//
+//      Host side cache of thread registers.
+//      Registers are fetched one class at a time and kept until the
+//      thread is resumed or one of its registers is written.
+//
+
+#include <vector>
+#include <unordered_map>
+#include <pro.h>
+
+// Size of a register slot as returned by the target (big endian)
+#define REGCACHE_SLOT_SIZE 16
+
+// Reverse the byte order of 'count' 128-bit values (target slot <-> host
+// order). 'dst' and 'src' may be the same buffer.
+void bswap128(uint8 *dst, const uint8 *src, size_t count);
+
+// Reads registers 'ids[0..count-1]' of thread 'tid' into consecutive slots.
+// Returns true on success.
+typedef bool reg_fetch_t(uint64 tid, uint32 count, const uint32 *ids, uint8 *slots, void *ud);
+
+class reg_cache_t
+{
+	struct thread_regs_t
+	{
+		int valid;                      // mask of the classes present in 'slots'
+		std::vector<uint8> slots;
+		thread_regs_t() : valid(0) {}
+	};
+	std::unordered_map<uint64, thread_regs_t> threads;
+
+	const uint32 *ids;                  // target register number of each register
+	const int *classes;                 // class mask of each register
+	int nregs;
+
+public:
+	uint32 hits;
+	uint32 misses;
+
+	reg_cache_t() : ids(NULL), classes(NULL), nregs(0), hits(0), misses(0) {}
+
+	void init(const uint32 *_ids, const int *_classes, int _nregs)
+	{
+		ids = _ids;
+		classes = _classes;
+		nregs = _nregs;
+		flush();
+	}
+
+	// Return the register slots of thread 'tid' with at least the classes of
+	// 'clsmask' filled in. Missing classes are fetched with a single request.
+	// Returns NULL if the registers could not be read.
+	const uint8 *fetch(uint64 tid, int clsmask, reg_fetch_t *fetch, void *ud);
+
+	// Forget the registers of one thread
+	void invalidate(uint64 tid) { threads.erase(tid); }
+
+	// Forget everything
+	void flush(void) { threads.clear(); }
+};
+
+// Key registers of many threads, stored as parallel arrays so that a
+// stop with dozens of threads only costs a few small allocations
+struct thread_snapshot_t
+{
+	std::vector<uint64> tid;
+	std::vector<uint64> pc;
+	std::vector<uint64> lr;
+	std::vector<uint64> sp;
+	std::vector<uint64> ctr;
+
+	void clear(void);
+	void reserve(size_t n);
+	void add(uint64 _tid, uint64 _pc, uint64 _lr, uint64 _sp, uint64 _ctr);
+	void erase(uint64 _tid);
+
+	// Index of thread '_tid' or -1
+	int find(uint64 _tid) const;
+
+	size_t size(void) const { return tid.size(); }
+};
+
+#endif
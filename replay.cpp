@@ -0,0 +1,1171 @@
+// Copyright (C) 2014 oct0xor
+//
+// This program is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License 2.0 for more details.
+//
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http ://www.gnu.org/licenses/
+
+#include <string.h>
+#include <chrono>
+#include <kernwin.hpp>
+#include "replay.h"
+
+//--------------------------------------------------------------------------
+void rr_writer_t::u(uint64 v)
+{
+	while (v >= 0x80)
+	{
+		data.push_back(uint8(v | 0x80));
+		v >>= 7;
+	}
+
+	data.push_back(uint8(v));
+}
+
+void rr_writer_t::s(int64 v)
+{
+	u((uint64(v) << 1) ^ uint64(v >> 63));
+}
+
+void rr_writer_t::str(const std::string &v)
+{
+	bytes(v.data(), v.size());
+}
+
+void rr_writer_t::bytes(const void *buffer, size_t size)
+{
+	u(size);
+	data.insert(data.end(), (const uint8 *)buffer, (const uint8 *)buffer + size);
+}
+
+//--------------------------------------------------------------------------
+uint64 rr_reader_t::u(void)
+{
+	uint64 v = 0;
+
+	for (int shift = 0; shift < 64; shift += 7)
+	{
+		if (p == end)
+			break;
+
+		uint8 b = *p++;
+		v |= uint64(b & 0x7f) << shift;
+
+		if ((b & 0x80) == 0)
+			return v;
+	}
+
+	bad = true;
+	return 0;
+}
+
+int64 rr_reader_t::s(void)
+{
+	uint64 v = u();
+
+	return int64(v >> 1) ^ -int64(v & 1);
+}
+
+std::string rr_reader_t::str(void)
+{
+	size_t size = size_t(u());
+	const uint8 *src = skip(size);
+
+	return src != NULL ? std::string((const char *)src, size) : std::string();
+}
+
+void rr_reader_t::bytes(void *buffer, size_t size)
+{
+	if (u() != size)
+	{
+		bad = true;
+		return;
+	}
+
+	const uint8 *src = skip(size);
+
+	if (src != NULL)
+		memcpy(buffer, src, size);
+}
+
+const uint8 *rr_reader_t::skip(size_t size)
+{
+	if (bad || size_t(end - p) < size)
+	{
+		bad = true;
+		return NULL;
+	}
+
+	const uint8 *src = p;
+	p += size;
+	return src;
+}
+
+//--------------------------------------------------------------------------
+static void put_event(rr_writer_t &w, const target_event_t &ev)
+{
+	w.u(ev.type);
+	w.u(ev.tid);
+	w.u(ev.pc);
+	w.u(ev.arg);
+	w.u(ev.timebase);
+}
+
+static void get_event(rr_reader_t &r, target_event_t *ev)
+{
+	ev->type = uint32(r.u());
+	ev->tid = r.u();
+	ev->pc = r.u();
+	ev->arg = r.u();
+	ev->timebase = r.u();
+}
+
+static void put_thread(rr_writer_t &w, const target_thread_t &t)
+{
+	w.u(t.tid);
+	w.u(t.state);
+	w.u(t.priority);
+	w.u(t.stack_addr);
+	w.u(t.stack_size);
+	w.str(t.name);
+}
+
+static void get_thread(rr_reader_t &r, target_thread_t *t)
+{
+	t->tid = r.u();
+	t->state = uint32(r.u());
+	t->priority = uint32(r.u());
+	t->stack_addr = r.u();
+	t->stack_size = r.u();
+	t->name = r.str();
+}
+
+static void put_module(rr_writer_t &w, const target_module_t &m)
+{
+	w.u(m.id);
+	w.str(m.name);
+	w.u(m.segments.size());
+
+	for (size_t i = 0; i < m.segments.size(); i++)
+	{
+		w.u(m.segments[i].base);
+		w.u(m.segments[i].file_size);
+		w.u(m.segments[i].mem_size);
+		w.u(m.segments[i].elf_type);
+	}
+}
+
+static void get_module(rr_reader_t &r, target_module_t *m)
+{
+	m->id = uint32(r.u());
+	m->name = r.str();
+	m->segments.resize(size_t(qmin(r.u(), (uint64)0x10000)));
+
+	for (size_t i = 0; i < m->segments.size(); i++)
+	{
+		m->segments[i].base = r.u();
+		m->segments[i].file_size = r.u();
+		m->segments[i].mem_size = r.u();
+		m->segments[i].elf_type = uint32(r.u());
+	}
+}
+
+template <class T> static void put_list(rr_writer_t &w, const std::vector<T> &list)
+{
+	w.u(list.size());
+
+	for (size_t i = 0; i < list.size(); i++)
+		w.u(list[i]);
+}
+
+template <class T> static void get_list(rr_reader_t &r, std::vector<T> *list)
+{
+	size_t count = size_t(r.u());
+
+	list->clear();
+
+	for (size_t i = 0; i < count && r.ok(); i++)
+		list->push_back(T(r.u()));
+}
+
+static void put_spu_group(rr_writer_t &w, const target_spu_group_t &g)
+{
+	w.u(g.id);
+	w.u(g.state);
+	w.u(g.priority);
+	w.str(g.name);
+	put_list(w, g.threads);
+}
+
+static void get_spu_group(rr_reader_t &r, target_spu_group_t *g)
+{
+	g->id = uint32(r.u());
+	g->state = uint32(r.u());
+	g->priority = uint32(r.u());
+	g->name = r.str();
+	get_list(r, &g->threads);
+}
+
+static void put_regs(rr_writer_t &w, uint64 tid, uint32 count, const uint32 *regs)
+{
+	w.u(tid);
+	w.u(count);
+
+	for (uint32 i = 0; i < count; i++)
+		w.u(regs[i]);
+}
+
+//--------------------------------------------------------------------------
+record_backend_t::record_backend_t(target_backend_t *_inner, const char *_path)
+	: inner(_inner), path(_path), fp(NULL), handler(NULL), handler_ud(NULL), records(0)
+{
+	inner->set_event_handler(on_event, this);
+}
+
+record_backend_t::~record_backend_t()
+{
+	if (fp != NULL)
+		fclose(fp);
+
+	delete inner;
+}
+
+bool record_backend_t::open(void)
+{
+	fp = fopen(path.c_str(), "wb");
+
+	if (fp == NULL)
+	{
+		msg("Can't create session log %s\n", path.c_str());
+		return false;
+	}
+
+	rrlog_header_t hdr;
+
+	hdr.magic = RRLOG_MAGIC;
+	hdr.version = RRLOG_VERSION;
+	hdr.reserved = 0;
+	hdr.host_start = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+	fwrite(&hdr, sizeof(hdr), 1, fp);
+
+	return inner->open();
+}
+
+void record_backend_t::close(void)
+{
+	inner->close();
+
+	std::lock_guard<std::mutex> guard(lock);
+
+	if (fp != NULL)
+	{
+		if (fclose(fp) != 0)
+			msg("Can't write session log %s\n", path.c_str());
+		else
+			msg("%llu records written to %s\n", records, path.c_str());
+
+		fp = NULL;
+	}
+}
+
+void record_backend_t::log(uint8 tag, const rr_writer_t &in, bool ok, const rr_writer_t &out)
+{
+	rr_writer_t rec;
+
+	rec.data.push_back(tag);
+	rec.bytes(in.data.empty() ? NULL : &in.data[0], in.data.size());
+	rec.data.push_back(ok ? 1 : 0);
+
+	if (ok)
+		rec.bytes(out.data.empty() ? NULL : &out.data[0], out.data.size());
+	else
+		rec.s(inner->error());
+
+	std::lock_guard<std::mutex> guard(lock);
+
+	if (fp == NULL)
+		return;
+
+	fwrite(&rec.data[0], 1, rec.data.size(), fp);
+	records++;
+}
+
+void record_backend_t::on_event(const target_event_t &ev, void *ud)
+{
+	record_backend_t *self = (record_backend_t *)ud;
+
+	{
+		rr_writer_t rec;
+
+		rec.data.push_back(RR_EVENT);
+		put_event(rec, ev);
+
+		std::lock_guard<std::mutex> guard(self->lock);
+
+		if (self->fp != NULL)
+		{
+			fwrite(&rec.data[0], 1, rec.data.size(), self->fp);
+			self->records++;
+		}
+	}
+
+	if (self->handler != NULL)
+		self->handler(ev, self->handler_ud);
+}
+
+void record_backend_t::set_event_handler(target_event_handler_t *_handler, void *ud)
+{
+	handler = _handler;
+	handler_ud = ud;
+}
+
+void record_backend_t::poll(void)
+{
+	inner->poll();
+}
+
+//--------------------------------------------------------------------------
+bool record_backend_t::get_processes(std::vector<target_process_t> *list)
+{
+	rr_writer_t in, out;
+	bool ok = inner->get_processes(list);
+
+	if (ok)
+	{
+		out.u(list->size());
+
+		for (size_t i = 0; i < list->size(); i++)
+		{
+			out.u((*list)[i].pid);
+			out.str((*list)[i].path);
+		}
+	}
+
+	log(RR_GET_PROCESSES, in, ok, out);
+	return ok;
+}
+
+bool record_backend_t::load_process(const char *path, uint32 *pid)
+{
+	rr_writer_t in, out;
+	in.str(path);
+	bool ok = inner->load_process(path, pid);
+
+	if (ok)
+		out.u(*pid);
+
+	log(RR_LOAD_PROCESS, in, ok, out);
+	return ok;
+}
+
+bool record_backend_t::attach(uint32 pid)
+{
+	rr_writer_t in, out;
+	in.u(pid);
+	bool ok = inner->attach(pid);
+
+	log(RR_ATTACH, in, ok, out);
+	return ok;
+}
+
+bool record_backend_t::stop(void)
+{
+	rr_writer_t in, out;
+	bool ok = inner->stop();
+
+	log(RR_STOP, in, ok, out);
+	return ok;
+}
+
+bool record_backend_t::resume(void)
+{
+	rr_writer_t in, out;
+	bool ok = inner->resume();
+
+	log(RR_RESUME, in, ok, out);
+	return ok;
+}
+
+//--------------------------------------------------------------------------
+bool record_backend_t::get_threads(std::vector<uint64> *tids)
+{
+	rr_writer_t in, out;
+	bool ok = inner->get_threads(tids);
+
+	if (ok)
+		put_list(out, *tids);
+
+	log(RR_GET_THREADS, in, ok, out);
+	return ok;
+}
+
+bool record_backend_t::get_thread_info(uint64 tid, target_thread_t *info)
+{
+	rr_writer_t in, out;
+	in.u(tid);
+	bool ok = inner->get_thread_info(tid, info);
+
+	if (ok)
+		put_thread(out, *info);
+
+	log(RR_GET_THREAD_INFO, in, ok, out);
+	return ok;
+}
+
+bool record_backend_t::stop_thread(uint64 tid)
+{
+	rr_writer_t in, out;
+	in.u(tid);
+	bool ok = inner->stop_thread(tid);
+
+	log(RR_STOP_THREAD, in, ok, out);
+	return ok;
+}
+
+bool record_backend_t::resume_thread(uint64 tid)
+{
+	rr_writer_t in, out;
+	in.u(tid);
+	bool ok = inner->resume_thread(tid);
+
+	log(RR_RESUME_THREAD, in, ok, out);
+	return ok;
+}
+
+bool record_backend_t::step_thread(uint64 tid)
+{
+	rr_writer_t in, out;
+	in.u(tid);
+	bool ok = inner->step_thread(tid);
+
+	log(RR_STEP_THREAD, in, ok, out);
+	return ok;
+}
+
+//--------------------------------------------------------------------------
+bool record_backend_t::get_registers(uint64 tid, uint32 count, const uint32 *regs, uint8 *slots)
+{
+	rr_writer_t in, out;
+	put_regs(in, tid, count, regs);
+	bool ok = inner->get_registers(tid, count, regs, slots);
+
+	if (ok)
+		out.bytes(slots, count * TREG_SLOT_SIZE);
+
+	log(RR_GET_REGISTERS, in, ok, out);
+	return ok;
+}
+
+bool record_backend_t::set_registers(uint64 tid, uint32 count, const uint32 *regs, const uint8 *slots)
+{
+	rr_writer_t in, out;
+	put_regs(in, tid, count, regs);
+	in.bytes(slots, count * TREG_SLOT_SIZE);
+	bool ok = inner->set_registers(tid, count, regs, slots);
+
+	log(RR_SET_REGISTERS, in, ok, out);
+	return ok;
+}
+
+//--------------------------------------------------------------------------
+bool record_backend_t::get_spu_groups(std::vector<uint32> *ids)
+{
+	rr_writer_t in, out;
+	bool ok = inner->get_spu_groups(ids);
+
+	if (ok)
+		put_list(out, *ids);
+
+	log(RR_GET_SPU_GROUPS, in, ok, out);
+	return ok;
+}
+
+bool record_backend_t::get_spu_group_info(uint32 id, target_spu_group_t *info)
+{
+	rr_writer_t in, out;
+	in.u(id);
+	bool ok = inner->get_spu_group_info(id, info);
+
+	if (ok)
+		put_spu_group(out, *info);
+
+	log(RR_GET_SPU_GROUP_INFO, in, ok, out);
+	return ok;
+}
+
+bool record_backend_t::get_spu_registers(uint32 tid, uint32 count, const uint32 *regs, uint8 *slots)
+{
+	rr_writer_t in, out;
+	put_regs(in, tid, count, regs);
+	bool ok = inner->get_spu_registers(tid, count, regs, slots);
+
+	if (ok)
+		out.bytes(slots, count * TREG_SLOT_SIZE);
+
+	log(RR_GET_SPU_REGISTERS, in, ok, out);
+	return ok;
+}
+
+//--------------------------------------------------------------------------
+bool record_backend_t::read_memory(ea_t ea, void *buffer, uint32 size)
+{
+	rr_writer_t in, out;
+	in.u(ea);
+	in.u(size);
+	bool ok = inner->read_memory(ea, buffer, size);
+
+	if (ok)
+		out.bytes(buffer, size);
+
+	log(RR_READ_MEMORY, in, ok, out);
+	return ok;
+}
+
+bool record_backend_t::write_memory(ea_t ea, const void *buffer, uint32 size)
+{
+	rr_writer_t in, out;
+	in.u(ea);
+	in.bytes(buffer, size);
+	bool ok = inner->write_memory(ea, buffer, size);
+
+	log(RR_WRITE_MEMORY, in, ok, out);
+	return ok;
+}
+
+bool record_backend_t::get_memory_areas(std::vector<target_memory_area_t> *areas)
+{
+	rr_writer_t in, out;
+	bool ok = inner->get_memory_areas(areas);
+
+	if (ok)
+	{
+		out.u(areas->size());
+
+		for (size_t i = 0; i < areas->size(); i++)
+		{
+			out.u((*areas)[i].base);
+			out.u((*areas)[i].size);
+		}
+	}
+
+	log(RR_GET_MEMORY_AREAS, in, ok, out);
+	return ok;
+}
+
+bool record_backend_t::read_spu_ls(uint32 tid, uint32 addr, void *buffer, uint32 size)
+{
+	rr_writer_t in, out;
+	in.u(tid);
+	in.u(addr);
+	in.u(size);
+	bool ok = inner->read_spu_ls(tid, addr, buffer, size);
+
+	if (ok)
+		out.bytes(buffer, size);
+
+	log(RR_READ_SPU_LS, in, ok, out);
+	return ok;
+}
+
+//--------------------------------------------------------------------------
+bool record_backend_t::set_breakpoint(uint64 tid, ea_t ea)
+{
+	rr_writer_t in, out;
+	in.u(tid);
+	in.u(ea);
+	bool ok = inner->set_breakpoint(tid, ea);
+
+	log(RR_SET_BREAKPOINT, in, ok, out);
+	return ok;
+}
+
+bool record_backend_t::clear_breakpoint(uint64 tid, ea_t ea)
+{
+	rr_writer_t in, out;
+	in.u(tid);
+	in.u(ea);
+	bool ok = inner->clear_breakpoint(tid, ea);
+
+	log(RR_CLEAR_BREAKPOINT, in, ok, out);
+	return ok;
+}
+
+bool record_backend_t::get_breakpoints(uint64 tid, std::vector<uint64> *list)
+{
+	rr_writer_t in, out;
+	in.u(tid);
+	bool ok = inner->get_breakpoints(tid, list);
+
+	if (ok)
+		put_list(out, *list);
+
+	log(RR_GET_BREAKPOINTS, in, ok, out);
+	return ok;
+}
+
+bool record_backend_t::set_dabr(uint64 value)
+{
+	rr_writer_t in, out;
+	in.u(value);
+	bool ok = inner->set_dabr(value);
+
+	log(RR_SET_DABR, in, ok, out);
+	return ok;
+}
+
+//--------------------------------------------------------------------------
+bool record_backend_t::get_modules(std::vector<uint32> *ids)
+{
+	rr_writer_t in, out;
+	bool ok = inner->get_modules(ids);
+
+	if (ok)
+		put_list(out, *ids);
+
+	log(RR_GET_MODULES, in, ok, out);
+	return ok;
+}
+
+bool record_backend_t::get_module_info(uint32 id, target_module_t *info)
+{
+	rr_writer_t in, out;
+	in.u(id);
+	bool ok = inner->get_module_info(id, info);
+
+	if (ok)
+		put_module(out, *info);
+
+	log(RR_GET_MODULE_INFO, in, ok, out);
+	return ok;
+}
+
+//--------------------------------------------------------------------------
+replay_backend_t::replay_backend_t(const char *_path)
+	: path(_path), next(0), next_event(0), handler(NULL), handler_ud(NULL), diverged(false), err(0),
+	  served(0), mismatches(0)
+{
+}
+
+bool replay_backend_t::open(void)
+{
+	FILE *fp = fopen(path.c_str(), "rb");
+
+	if (fp == NULL)
+	{
+		msg("Can't open session log %s\n", path.c_str());
+		return false;
+	}
+
+	fseek(fp, 0, SEEK_END);
+	long size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+
+	data.resize(size > 0 ? size_t(size) : 0);
+
+	bool ok = !data.empty() && fread(&data[0], 1, data.size(), fp) == data.size();
+
+	fclose(fp);
+
+	if (!ok || !parse())
+	{
+		msg("%s is not a session log\n", path.c_str());
+		return false;
+	}
+
+	msg("Replaying %u records from %s\n", (uint32)entries.size(), path.c_str());
+
+	return true;
+}
+
+bool replay_backend_t::parse(void)
+{
+	rrlog_header_t hdr;
+
+	if (data.size() < sizeof(hdr))
+		return false;
+
+	memcpy(&hdr, &data[0], sizeof(hdr));
+
+	if (hdr.magic != RRLOG_MAGIC || hdr.version != RRLOG_VERSION)
+		return false;
+
+	rr_reader_t r(&data[sizeof(hdr)], data.size() - sizeof(hdr));
+
+	entries.clear();
+	next = next_event = 0;
+
+	while (!r.eof())
+	{
+		entry_t e;
+		const uint8 *tag = r.skip(1);
+
+		if (tag == NULL || *tag == 0 || *tag >= RR_COUNT)
+			break;
+
+		e.tag = *tag;
+		e.done = false;
+		e.ok = true;
+		e.err = 0;
+		e.in = e.in_size = e.out = e.out_size = 0;
+
+		if (e.tag == RR_EVENT)
+		{
+			get_event(r, &e.ev);
+		}
+		else
+		{
+			e.in_size = size_t(r.u());
+			const uint8 *in = r.skip(e.in_size);
+			const uint8 *status = r.skip(1);
+
+			if (in == NULL || status == NULL)
+				break;
+
+			e.in = in - &data[0];
+			e.ok = *status != 0;
+
+			if (e.ok)
+			{
+				e.out_size = size_t(r.u());
+				const uint8 *out = r.skip(e.out_size);
+
+				if (out == NULL)
+					break;
+
+				e.out = out - &data[0];
+			}
+			else
+			{
+				e.err = int(r.s());
+			}
+		}
+
+		if (!r.ok())
+			break;
+
+		entries.push_back(e);
+	}
+
+	// a session cut short (e.g. IDA crashed) is still worth replaying
+	if (!r.eof())
+		msg("Session log %s is truncated after %u records\n", path.c_str(), (uint32)entries.size());
+
+	return true;
+}
+
+void replay_backend_t::close(void)
+{
+	msg("Replay: %llu requests served, %llu unmatched, %u of %u records used\n",
+		served, mismatches, (uint32)next, (uint32)entries.size());
+}
+
+bool replay_backend_t::finished(void)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	for (size_t i = next_event; i < entries.size(); i++)
+	{
+		if (!entries[i].done)
+			return false;
+	}
+
+	return true;
+}
+
+//--------------------------------------------------------------------------
+bool replay_backend_t::fetch(uint8 tag, const rr_writer_t &in, rr_reader_t *out)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	// the requests are serialized, each one must be the next recorded,
+	// the events recorded in between are left to poll()
+	size_t i = next;
+
+	while (i < entries.size() && (entries[i].done || entries[i].tag == RR_EVENT))
+		i++;
+
+	entry_t *e = i < entries.size() ? &entries[i] : NULL;
+
+	if (e != NULL && e->tag == tag && e->in_size == in.data.size() &&
+		(e->in_size == 0 || memcmp(&data[e->in], &in.data[0], e->in_size) == 0))
+	{
+		e->done = true;
+		served++;
+
+		// events are delivered once the requests recorded before them are served
+		while (next < entries.size() && (entries[next].done || entries[next].tag == RR_EVENT))
+			next++;
+
+		if (!e->ok)
+			return fail(e->err);
+
+		*out = rr_reader_t(e->out_size != 0 ? &data[e->out] : NULL, e->out_size);
+		return true;
+	}
+
+	mismatches++;
+
+	if (!diverged)
+	{
+		msg("Replay diverged: no record matches request %d at record %u\n", tag, (uint32)next);
+		diverged = true;
+	}
+
+	return fail(E_DIVERGED);
+}
+
+void replay_backend_t::set_event_handler(target_event_handler_t *_handler, void *ud)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	handler = _handler;
+	handler_ud = ud;
+}
+
+void replay_backend_t::poll(void)
+{
+	std::vector<target_event_t> ready;
+	target_event_handler_t *h;
+	void *ud;
+
+	{
+		std::lock_guard<std::recursive_mutex> guard(lock);
+
+		for (; next_event < next; next_event++)
+		{
+			entry_t &e = entries[next_event];
+
+			if (e.tag == RR_EVENT && !e.done)
+			{
+				e.done = true;
+				ready.push_back(e.ev);
+			}
+		}
+
+		h = handler;
+		ud = handler_ud;
+	}
+
+	// the handler may call us back
+	for (size_t i = 0; h != NULL && i < ready.size(); i++)
+		h(ready[i], ud);
+}
+
+//--------------------------------------------------------------------------
+bool replay_backend_t::get_processes(std::vector<target_process_t> *list)
+{
+	rr_writer_t in;
+	rr_reader_t out;
+
+	if (!fetch(RR_GET_PROCESSES, in, &out))
+		return false;
+
+	size_t count = size_t(out.u());
+
+	list->clear();
+
+	for (size_t i = 0; i < count && out.ok(); i++)
+	{
+		target_process_t p;
+		p.pid = uint32(out.u());
+		p.path = out.str();
+		list->push_back(p);
+	}
+
+	return done(out);
+}
+
+bool replay_backend_t::load_process(const char *path, uint32 *pid)
+{
+	rr_writer_t in;
+	rr_reader_t out;
+	in.str(path);
+
+	if (!fetch(RR_LOAD_PROCESS, in, &out))
+		return false;
+
+	*pid = uint32(out.u());
+	return done(out);
+}
+
+bool replay_backend_t::attach(uint32 pid)
+{
+	rr_writer_t in;
+	rr_reader_t out;
+	in.u(pid);
+
+	return fetch(RR_ATTACH, in, &out);
+}
+
+bool replay_backend_t::stop(void)
+{
+	rr_writer_t in;
+	rr_reader_t out;
+
+	return fetch(RR_STOP, in, &out);
+}
+
+bool replay_backend_t::resume(void)
+{
+	rr_writer_t in;
+	rr_reader_t out;
+
+	return fetch(RR_RESUME, in, &out);
+}
+
+//--------------------------------------------------------------------------
+bool replay_backend_t::get_threads(std::vector<uint64> *tids)
+{
+	rr_writer_t in;
+	rr_reader_t out;
+
+	if (!fetch(RR_GET_THREADS, in, &out))
+		return false;
+
+	get_list(out, tids);
+	return done(out);
+}
+
+bool replay_backend_t::get_thread_info(uint64 tid, target_thread_t *info)
+{
+	rr_writer_t in;
+	rr_reader_t out;
+	in.u(tid);
+
+	if (!fetch(RR_GET_THREAD_INFO, in, &out))
+		return false;
+
+	get_thread(out, info);
+	return done(out);
+}
+
+bool replay_backend_t::stop_thread(uint64 tid)
+{
+	rr_writer_t in;
+	rr_reader_t out;
+	in.u(tid);
+
+	return fetch(RR_STOP_THREAD, in, &out);
+}
+
+bool replay_backend_t::resume_thread(uint64 tid)
+{
+	rr_writer_t in;
+	rr_reader_t out;
+	in.u(tid);
+
+	return fetch(RR_RESUME_THREAD, in, &out);
+}
+
+bool replay_backend_t::step_thread(uint64 tid)
+{
+	rr_writer_t in;
+	rr_reader_t out;
+	in.u(tid);
+
+	return fetch(RR_STEP_THREAD, in, &out);
+}
+
+//--------------------------------------------------------------------------
+bool replay_backend_t::get_registers(uint64 tid, uint32 count, const uint32 *regs, uint8 *slots)
+{
+	rr_writer_t in;
+	rr_reader_t out;
+	put_regs(in, tid, count, regs);
+
+	if (!fetch(RR_GET_REGISTERS, in, &out))
+		return false;
+
+	out.bytes(slots, count * TREG_SLOT_SIZE);
+	return done(out);
+}
+
+bool replay_backend_t::set_registers(uint64 tid, uint32 count, const uint32 *regs, const uint8 *slots)
+{
+	rr_writer_t in;
+	rr_reader_t out;
+	put_regs(in, tid, count, regs);
+	in.bytes(slots, count * TREG_SLOT_SIZE);
+
+	return fetch(RR_SET_REGISTERS, in, &out);
+}
+
+//--------------------------------------------------------------------------
+bool replay_backend_t::get_spu_groups(std::vector<uint32> *ids)
+{
+	rr_writer_t in;
+	rr_reader_t out;
+
+	if (!fetch(RR_GET_SPU_GROUPS, in, &out))
+		return false;
+
+	get_list(out, ids);
+	return done(out);
+}
+
+bool replay_backend_t::get_spu_group_info(uint32 id, target_spu_group_t *info)
+{
+	rr_writer_t in;
+	rr_reader_t out;
+	in.u(id);
+
+	if (!fetch(RR_GET_SPU_GROUP_INFO, in, &out))
+		return false;
+
+	get_spu_group(out, info);
+	return done(out);
+}
+
+bool replay_backend_t::get_spu_registers(uint32 tid, uint32 count, const uint32 *regs, uint8 *slots)
+{
+	rr_writer_t in;
+	rr_reader_t out;
+	put_regs(in, tid, count, regs);
+
+	if (!fetch(RR_GET_SPU_REGISTERS, in, &out))
+		return false;
+
+	out.bytes(slots, count * TREG_SLOT_SIZE);
+	return done(out);
+}
+
+//--------------------------------------------------------------------------
+bool replay_backend_t::read_memory(ea_t ea, void *buffer, uint32 size)
+{
+	rr_writer_t in;
+	rr_reader_t out;
+	in.u(ea);
+	in.u(size);
+
+	if (!fetch(RR_READ_MEMORY, in, &out))
+		return false;
+
+	out.bytes(buffer, size);
+	return done(out);
+}
+
+bool replay_backend_t::write_memory(ea_t ea, const void *buffer, uint32 size)
+{
+	rr_writer_t in;
+	rr_reader_t out;
+	in.u(ea);
+	in.bytes(buffer, size);
+
+	return fetch(RR_WRITE_MEMORY, in, &out);
+}
+
+bool replay_backend_t::get_memory_areas(std::vector<target_memory_area_t> *areas)
+{
+	rr_writer_t in;
+	rr_reader_t out;
+
+	if (!fetch(RR_GET_MEMORY_AREAS, in, &out))
+		return false;
+
+	size_t count = size_t(out.u());
+
+	areas->clear();
+
+	for (size_t i = 0; i < count && out.ok(); i++)
+	{
+		target_memory_area_t a;
+
+		a.base = out.u();
+		a.size = out.u();
+		areas->push_back(a);
+	}
+
+	return done(out);
+}
+
+bool replay_backend_t::read_spu_ls(uint32 tid, uint32 addr, void *buffer, uint32 size)
+{
+	rr_writer_t in;
+	rr_reader_t out;
+	in.u(tid);
+	in.u(addr);
+	in.u(size);
+
+	if (!fetch(RR_READ_SPU_LS, in, &out))
+		return false;
+
+	out.bytes(buffer, size);
+	return done(out);
+}
+
+//--------------------------------------------------------------------------
+bool replay_backend_t::set_breakpoint(uint64 tid, ea_t ea)
+{
+	rr_writer_t in;
+	rr_reader_t out;
+	in.u(tid);
+	in.u(ea);
+
+	return fetch(RR_SET_BREAKPOINT, in, &out);
+}
+
+bool replay_backend_t::clear_breakpoint(uint64 tid, ea_t ea)
+{
+	rr_writer_t in;
+	rr_reader_t out;
+	in.u(tid);
+	in.u(ea);
+
+	return fetch(RR_CLEAR_BREAKPOINT, in, &out);
+}
+
+bool replay_backend_t::get_breakpoints(uint64 tid, std::vector<uint64> *list)
+{
+	rr_writer_t in;
+	rr_reader_t out;
+	in.u(tid);
+
+	if (!fetch(RR_GET_BREAKPOINTS, in, &out))
+		return false;
+
+	get_list(out, list);
+	return done(out);
+}
+
+bool replay_backend_t::set_dabr(uint64 value)
+{
+	rr_writer_t in;
+	rr_reader_t out;
+	in.u(value);
+
+	return fetch(RR_SET_DABR, in, &out);
+}
+
+//--------------------------------------------------------------------------
+bool replay_backend_t::get_modules(std::vector<uint32> *ids)
+{
+	rr_writer_t in;
+	rr_reader_t out;
+
+	if (!fetch(RR_GET_MODULES, in, &out))
+		return false;
+
+	get_list(out, ids);
+	return done(out);
+}
+
+bool replay_backend_t::get_module_info(uint32 id, target_module_t *info)
+{
+	rr_writer_t in;
+	rr_reader_t out;
+	in.u(id);
+
+	if (!fetch(RR_GET_MODULE_INFO, in, &out))
+		return false;
+
+	get_module(out, info);
+	return done(out);
+}
@@ -0,0 +1,260 @@
+#ifndef __REPLAY__
+#define __REPLAY__
+
+//
+//      Session recording at the backend boundary.
+//      record_backend_t wraps another backend and logs every request with
+//      its reply, and every target event, to a compact binary file.
+//      replay_backend_t serves the same requests from such a file, so a
+//      session can be reproduced or benchmarked without a target.
+//
+
+#include <stdio.h>
+#include <mutex>
+#include <vector>
+#include <string>
+#include "backend.h"
+
+#define RRLOG_MAGIC   0x50523344        // "D3RP"
+#define RRLOG_VERSION 1
+
+// File layout: rrlog_header_t followed by records, each one starts with its tag.
+//   RR_EVENT      the event fields
+//   RR_<request>  size of the inputs, inputs, status byte, then the error code
+//                 if the request failed or the size of the outputs and outputs
+// Integers are LEB128 varints (zigzag for signed ones), strings and buffers
+// are prefixed with their size.
+enum
+{
+	RR_EVENT = 1,
+	RR_GET_PROCESSES,
+	RR_LOAD_PROCESS,
+	RR_ATTACH,
+	RR_STOP,
+	RR_RESUME,
+	RR_GET_THREADS,
+	RR_GET_THREAD_INFO,
+	RR_STOP_THREAD,
+	RR_RESUME_THREAD,
+	RR_GET_REGISTERS,
+	RR_SET_REGISTERS,
+	RR_READ_MEMORY,
+	RR_WRITE_MEMORY,
+	RR_SET_BREAKPOINT,
+	RR_CLEAR_BREAKPOINT,
+	RR_GET_BREAKPOINTS,
+	RR_SET_DABR,
+	RR_GET_MODULES,
+	RR_GET_MODULE_INFO,
+	RR_STEP_THREAD,
+	RR_GET_MEMORY_AREAS,
+	RR_GET_SPU_GROUPS,
+	RR_GET_SPU_GROUP_INFO,
+	RR_GET_SPU_REGISTERS,
+	RR_READ_SPU_LS,
+	RR_COUNT
+};
+
+#pragma pack(push, 1)
+
+struct rrlog_header_t
+{
+	uint32 magic;
+	uint16 version;
+	uint16 reserved;
+	uint64 host_start;              // ns since epoch
+};
+
+#pragma pack(pop)
+
+class rr_writer_t
+{
+public:
+	std::vector<uint8> data;
+
+	void u(uint64 v);
+	void s(int64 v);
+	void str(const std::string &v);
+	void bytes(const void *buffer, size_t size);
+};
+
+// Reading past the end or a size mismatch sets the error flag
+class rr_reader_t
+{
+	const uint8 *p;
+	const uint8 *end;
+	bool bad;
+
+public:
+	rr_reader_t() : p(NULL), end(NULL), bad(false) {}
+	rr_reader_t(const uint8 *data, size_t size) : p(data), end(data + size), bad(false) {}
+
+	uint64 u(void);
+	int64 s(void);
+	std::string str(void);
+
+	// The buffer must have been written with exactly 'size' bytes
+	void bytes(void *buffer, size_t size);
+
+	// Skip 'size' raw bytes, returns where they start
+	const uint8 *skip(size_t size);
+
+	bool ok(void) const { return !bad; }
+	bool eof(void) const { return p == end; }
+};
+
+//--------------------------------------------------------------------------
+class record_backend_t : public target_backend_t
+{
+	target_backend_t *inner;
+	std::string path;
+	FILE *fp;
+	std::mutex lock;
+	target_event_handler_t *handler;
+	void *handler_ud;
+
+	static void on_event(const target_event_t &ev, void *ud);
+	void log(uint8 tag, const rr_writer_t &in, bool ok, const rr_writer_t &out);
+
+public:
+	// Records written so far
+	uint64 records;
+
+	// Takes ownership of '_inner'
+	record_backend_t(target_backend_t *_inner, const char *_path);
+	virtual ~record_backend_t();
+
+	virtual const char *name(void) const { return inner->name(); }
+	virtual int error(void) const { return inner->error(); }
+
+	virtual bool open(void);
+	virtual void close(void);
+
+	virtual void set_event_handler(target_event_handler_t *_handler, void *ud);
+	virtual void poll(void);
+
+	virtual bool get_processes(std::vector<target_process_t> *list);
+	virtual bool load_process(const char *path, uint32 *pid);
+	virtual bool attach(uint32 pid);
+	virtual bool stop(void);
+	virtual bool resume(void);
+
+	virtual bool get_threads(std::vector<uint64> *tids);
+	virtual bool get_thread_info(uint64 tid, target_thread_t *info);
+	virtual bool stop_thread(uint64 tid);
+	virtual bool resume_thread(uint64 tid);
+	virtual bool step_thread(uint64 tid);
+
+	virtual bool get_registers(uint64 tid, uint32 count, const uint32 *regs, uint8 *slots);
+	virtual bool set_registers(uint64 tid, uint32 count, const uint32 *regs, const uint8 *slots);
+
+	virtual bool get_spu_groups(std::vector<uint32> *ids);
+	virtual bool get_spu_group_info(uint32 id, target_spu_group_t *info);
+	virtual bool get_spu_registers(uint32 tid, uint32 count, const uint32 *regs, uint8 *slots);
+
+	virtual bool read_memory(ea_t ea, void *buffer, uint32 size);
+	virtual bool write_memory(ea_t ea, const void *buffer, uint32 size);
+	virtual bool get_memory_areas(std::vector<target_memory_area_t> *areas);
+	virtual bool read_spu_ls(uint32 tid, uint32 addr, void *buffer, uint32 size);
+
+	virtual bool set_breakpoint(uint64 tid, ea_t ea);
+	virtual bool clear_breakpoint(uint64 tid, ea_t ea);
+	virtual bool get_breakpoints(uint64 tid, std::vector<uint64> *list);
+	virtual bool set_dabr(uint64 value);
+
+	virtual bool get_modules(std::vector<uint32> *ids);
+	virtual bool get_module_info(uint32 id, target_module_t *info);
+};
+
+//--------------------------------------------------------------------------
+// A request is served by the first matching record (same tag and inputs)
+// not served yet. Events are delivered by poll() once every request
+// recorded before them has been served.
+class replay_backend_t : public target_backend_t
+{
+	struct entry_t
+	{
+		uint8 tag;
+		bool done;                      // request served or event delivered
+		bool ok;
+		int err;
+		size_t in;                      // offsets of the inputs and outputs in 'data'
+		size_t in_size;
+		size_t out;
+		size_t out_size;
+		target_event_t ev;              // RR_EVENT only
+	};
+
+	std::string path;
+	std::vector<uint8> data;
+	std::vector<entry_t> entries;
+	size_t next;                        // first request not served yet
+	size_t next_event;                  // first event not delivered yet
+	std::recursive_mutex lock;
+	target_event_handler_t *handler;
+	void *handler_ud;
+	bool diverged;
+	int err;
+
+	bool fail(int code) { err = code; return false; }
+	bool parse(void);
+
+	// Find the record answering request 'tag' with inputs 'in'
+	bool fetch(uint8 tag, const rr_writer_t &in, rr_reader_t *out);
+	bool done(const rr_reader_t &out) { return out.ok() || fail(E_CORRUPT); }
+
+public:
+	// Requests served, and requests no record matched
+	uint64 served;
+	uint64 mismatches;
+
+	enum { E_DIVERGED = -100, E_CORRUPT = -101 };
+
+	replay_backend_t(const char *_path);
+
+	virtual const char *name(void) const { return "replay"; }
+	virtual int error(void) const { return err; }
+
+	virtual bool open(void);
+	virtual void close(void);
+
+	virtual void set_event_handler(target_event_handler_t *_handler, void *ud);
+	virtual void poll(void);
+
+	virtual bool get_processes(std::vector<target_process_t> *list);
+	virtual bool load_process(const char *path, uint32 *pid);
+	virtual bool attach(uint32 pid);
+	virtual bool stop(void);
+	virtual bool resume(void);
+
+	virtual bool get_threads(std::vector<uint64> *tids);
+	virtual bool get_thread_info(uint64 tid, target_thread_t *info);
+	virtual bool stop_thread(uint64 tid);
+	virtual bool resume_thread(uint64 tid);
+	virtual bool step_thread(uint64 tid);
+
+	virtual bool get_registers(uint64 tid, uint32 count, const uint32 *regs, uint8 *slots);
+	virtual bool set_registers(uint64 tid, uint32 count, const uint32 *regs, const uint8 *slots);
+
+	virtual bool get_spu_groups(std::vector<uint32> *ids);
+	virtual bool get_spu_group_info(uint32 id, target_spu_group_t *info);
+	virtual bool get_spu_registers(uint32 tid, uint32 count, const uint32 *regs, uint8 *slots);
+
+	virtual bool read_memory(ea_t ea, void *buffer, uint32 size);
+	virtual bool write_memory(ea_t ea, const void *buffer, uint32 size);
+	virtual bool get_memory_areas(std::vector<target_memory_area_t> *areas);
+	virtual bool read_spu_ls(uint32 tid, uint32 addr, void *buffer, uint32 size);
+
+	virtual bool set_breakpoint(uint64 tid, ea_t ea);
+	virtual bool clear_breakpoint(uint64 tid, ea_t ea);
+	virtual bool get_breakpoints(uint64 tid, std::vector<uint64> *list);
+	virtual bool set_dabr(uint64 value);
+
+	virtual bool get_modules(std::vector<uint32> *ids);
+	virtual bool get_module_info(uint32 id, target_module_t *info);
+
+	// Every record served or delivered
+	bool finished(void);
+};
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef _IDD_HPP
+#define _IDD_HPP
+
+//
+//      Minimal stand-in for the IDA SDK idd.hpp: the debug events only
+//
+
+#include <pro.h>
+
+enum event_id_t
+{
+	NO_EVENT       = 0x00000000,
+	PROCESS_START  = 0x00000001,
+	PROCESS_EXIT   = 0x00000002,
+	THREAD_START   = 0x00000004,
+	THREAD_EXIT    = 0x00000008,
+	BREAKPOINT     = 0x00000010,
+	STEP           = 0x00000020,
+	EXCEPTION      = 0x00000040,
+	LIBRARY_LOAD   = 0x00000080,
+	LIBRARY_UNLOAD = 0x00000100,
+	INFORMATION    = 0x00000200,
+	SYSCALL        = 0x00000400,
+	WINMESSAGE     = 0x00000800,
+	PROCESS_ATTACH = 0x00001000,
+	PROCESS_DETACH = 0x00002000,
+	PROCESS_SUSPEND= 0x00004000,
+	TRACE_FULL     = 0x00008000
+};
+
+#define NO_THREAD 0
+
+struct module_info_t
+{
+	char name[QMAXPATH];
+	ea_t base;
+	asize_t size;
+	ea_t rebase_to;
+};
+
+struct e_breakpoint_t
+{
+	ea_t hea;
+	ea_t kea;
+};
+
+struct e_exception_t
+{
+	uint32 code;
+	bool can_cont;
+	ea_t ea;
+	char info[MAXSTR];
+};
+
+struct debug_event_t
+{
+	event_id_t eid;
+	pid_t pid;
+	thid_t tid;
+	ea_t ea;
+	bool handled;
+	union
+	{
+		module_info_t modinfo;
+		int exit_code;
+		char info[MAXSTR];
+		e_breakpoint_t bpt;
+		e_exception_t exc;
+	};
+};
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef __KERNWIN_HPP
+#define __KERNWIN_HPP
+
+//
+//      Minimal stand-in for the IDA SDK kernwin.hpp: messages go to stdout
+//
+
+#include <pro.h>
+
+AS_PRINTF(1, 2) int msg(const char *format, ...);
+AS_PRINTF(1, 2) int warning(const char *format, ...);
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef _PRO_H
+#define _PRO_H
+
+//
+//      Minimal stand-in for the IDA SDK pro.h, just enough to build the
+//      target independent sources outside of Visual Studio (see CMakeLists.txt)
+//
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <vector>
+
+typedef unsigned char  uchar;
+typedef uint8_t        uint8;
+typedef int8_t         int8;
+typedef uint16_t       uint16;
+typedef int16_t        int16;
+typedef uint32_t       uint32;
+typedef int32_t        int32;
+typedef uint64_t       uint64;
+typedef int64_t        int64;
+typedef unsigned int   uint;
+typedef unsigned short ushort;
+
+#ifdef __EA64__
+typedef uint64 ea_t;
+typedef uint64 asize_t;
+typedef uint64 uval_t;
+#else
+typedef uint32 ea_t;
+typedef uint32 asize_t;
+typedef uint32 uval_t;
+#endif
+
+typedef int thid_t;
+
+#define BADADDR ea_t(-1)
+#define MAXSTR 1024
+#define QMAXPATH 260
+
+#define idaapi
+#define AS_PRINTF(format_idx, varg_idx)
+
+#define CASSERT(cnd) static_assert((cnd), #cnd)
+#define qnumber(array) (sizeof(array) / sizeof(array[0]))
+
+#define qmin(a,b) ((a) < (b)? (a): (b))
+#define qmax(a,b) ((a) > (b)? (a): (b))
+
+template <class T> class qvector : public std::vector<T> {};
+
+typedef qvector<uchar> bytevec_t;
+typedef qvector<ea_t> eavec_t;
+
+typedef int error_t;
+#define eOk 0
+
+char *qstrncpy(char *dst, const char *src, size_t dstsize);
+AS_PRINTF(3, 4) int qsnprintf(char *buffer, size_t n, const char *format, ...);
+
+#endif
@@ -0,0 +1,56 @@
+// Copyright (C) 2014 oct0xor
+//
+// This program is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License 2.0 for more details.
+//
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http ://www.gnu.org/licenses/
+
+#include <stdarg.h>
+#include <kernwin.hpp>
+
+//--------------------------------------------------------------------------
+char *qstrncpy(char *dst, const char *src, size_t dstsize)
+{
+	if (dstsize == 0)
+		return dst;
+
+	strncpy(dst, src, dstsize - 1);
+	dst[dstsize - 1] = '\0';
+	return dst;
+}
+
+int qsnprintf(char *buffer, size_t n, const char *format, ...)
+{
+	va_list va;
+	va_start(va, format);
+	int code = vsnprintf(buffer, n, format, va);
+	va_end(va);
+	return code;
+}
+
+//--------------------------------------------------------------------------
+int msg(const char *format, ...)
+{
+	va_list va;
+	va_start(va, format);
+	int code = vprintf(format, va);
+	va_end(va);
+	return code;
+}
+
+int warning(const char *format, ...)
+{
+	va_list va;
+	va_start(va, format);
+	int code = vfprintf(stderr, format, va);
+	va_end(va);
+	fputc('\n', stderr);
+	return code;
+}
@@ -0,0 +1,1134 @@
+// Copyright (C) 2014 oct0xor
+//
+// This program is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License 2.0 for more details.
+//
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http ://www.gnu.org/licenses/
+
+
+#include <algorithm>
+#include "sim_backend.h"
+
+#define TRAP_WORD 0x7fe00008            // tw 31,0,0
+
+#define SPR_LR  8
+#define SPR_CTR 9
+
+static inline uint32 load_be32(const uint8 *p)
+{
+	return (uint32(p[0]) << 24) | (uint32(p[1]) << 16) | (uint32(p[2]) << 8) | p[3];
+}
+
+static inline void store_be32(uint8 *p, uint32 v)
+{
+	p[0] = uint8(v >> 24);
+	p[1] = uint8(v >> 16);
+	p[2] = uint8(v >> 8);
+	p[3] = uint8(v);
+}
+
+static inline uint64 sext(uint64 v, int bits)
+{
+	return uint64(int64(v << (64 - bits)) >> (64 - bits));
+}
+
+//--------------------------------------------------------------------------
+sim_backend_t::sim_backend_t()
+	: handler(NULL), handler_ud(NULL), pid(0), running(false), dabr(0), timebase(0), err(E_OK),
+	  slice(256), requests(0), executed(0)
+{
+}
+
+bool sim_backend_t::open(void)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	if (processes.empty())
+		load_demo();
+
+	return true;
+}
+
+void sim_backend_t::load_demo(void)
+{
+	static const uint32 code[] =
+	{
+		0x38600000,     // li     r3, 0
+		0x38630001,     // addi   r3, r3, 1
+		0x2c030064,     // cmpwi  r3, 100
+		0x4180fff8,     // blt    -8
+		0x4bfffff0,     // b      -16
+	};
+
+	static const uint32 spu_code[] =
+	{
+		0x40800003,     // il     $3, 0
+		0x1c004183,     // ai     $3, $3, 1
+		0x327fff80,     // br     -4
+	};
+
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	add_process(0x1010200, "/app_home/sim.self");
+	map_memory(0x10000, 0x10000);
+	map_memory(0xd0000000, 0x10000);
+	write_words(0x10200, code, qnumber(code));
+	add_thread(0x100, "main", 0x10200, 0xd000ff00);
+	add_module(0x10, "sim.self - sim", 0x10000, 0x10000);
+	add_spu_group(0x4000100, "sim_spu", 0x2000100, 2);
+	write_ls(0x2000100, 0, spu_code, qnumber(spu_code));
+	write_ls(0x2000101, 0, spu_code, qnumber(spu_code));
+}
+
+//--------------------------------------------------------------------------
+uint8 *sim_backend_t::page(ea_t ea, bool create)
+{
+	uint32 n = uint32(ea / SIM_PAGE_SIZE);
+	std::unordered_map<uint32, page_t>::iterator it = pages.find(n);
+
+	if (it != pages.end())
+		return &it->second[0];
+
+	if (!create)
+		return NULL;
+
+	page_t &p = pages[n];
+	p.resize(SIM_PAGE_SIZE);
+	return &p[0];
+}
+
+bool sim_backend_t::peek(ea_t ea, void *buffer, uint32 size)
+{
+	uint8 *dst = (uint8 *)buffer;
+
+	while (size != 0)
+	{
+		uint8 *p = page(ea, false);
+
+		if (p == NULL)
+			return fail(E_BAD_ADDRESS);
+
+		uint32 off = uint32(ea % SIM_PAGE_SIZE);
+		uint32 len = qmin(size, SIM_PAGE_SIZE - off);
+
+		memcpy(dst, p + off, len);
+
+		dst += len;
+		ea += len;
+		size -= len;
+	}
+
+	return true;
+}
+
+bool sim_backend_t::poke(ea_t ea, const void *buffer, uint32 size)
+{
+	const uint8 *src = (const uint8 *)buffer;
+
+	// all or nothing
+	for (ea_t a = ea - ea % SIM_PAGE_SIZE; a < ea + size; a += SIM_PAGE_SIZE)
+	{
+		if (page(a, false) == NULL)
+			return fail(E_BAD_ADDRESS);
+	}
+
+	while (size != 0)
+	{
+		uint8 *p = page(ea, false);
+		uint32 off = uint32(ea % SIM_PAGE_SIZE);
+		uint32 len = qmin(size, SIM_PAGE_SIZE - off);
+
+		memcpy(p + off, src, len);
+
+		src += len;
+		ea += len;
+		size -= len;
+	}
+
+	return true;
+}
+
+//--------------------------------------------------------------------------
+uint64 sim_backend_t::read_reg(const thread_t &t, int r)
+{
+	const uint8 *p = t.regs[r];
+	return (uint64(load_be32(p)) << 32) | load_be32(p + 4);
+}
+
+void sim_backend_t::write_reg(thread_t &t, int r, uint64 value)
+{
+	uint8 *p = t.regs[r];
+	store_be32(p, uint32(value >> 32));
+	store_be32(p + 4, uint32(value));
+}
+
+void sim_backend_t::post(uint32 type, uint64 tid, uint64 pc, uint64 arg)
+{
+	target_event_t ev;
+
+	ev.type = type;
+	ev.tid = tid;
+	ev.pc = pc;
+	ev.arg = arg;
+	ev.timebase = timebase;
+
+	pending.push_back(ev);
+}
+
+//--------------------------------------------------------------------------
+// Stop on a data access matching DABR, before the access is made
+bool sim_backend_t::check_dabr(thread_t &t, ea_t ea, bool store)
+{
+	// bit 0: reads, bit 1: writes, the address is doubleword aligned
+	if ((dabr & (store ? 2 : 1)) == 0 || (dabr & ~7ULL) != (uint64(ea) & ~7ULL))
+		return true;
+
+	post(TEV_DABR_MATCH, t.info.tid, read_reg(t, TREG_PC), ea);
+	running = false;
+	return false;
+}
+
+bool sim_backend_t::execute(thread_t &t)
+{
+	ea_t pc = ea_t(read_reg(t, TREG_PC));
+	ea_t next = pc + 4;
+	uint8 raw[4];
+
+	if (!peek(pc, raw, 4))
+	{
+		post(TEV_TEXT_HTAB_MISS, t.info.tid, pc, 0);
+		running = false;
+		return false;
+	}
+
+	uint32 w = load_be32(raw);
+
+	if (w == TRAP_WORD)
+	{
+		std::map<ea_t, bpt_t>::const_iterator it = bpts.find(pc);
+		bool hit = true;
+
+		if (it != bpts.end())
+		{
+			const std::vector<uint64> &tids = it->second.tids;
+
+			hit = std::find(tids.begin(), tids.end(), uint64(-1)) != tids.end()
+			   || std::find(tids.begin(), tids.end(), t.info.tid) != tids.end();
+
+			// another thread's breakpoint: run the hidden instruction
+			if (!hit)
+				w = load_be32((const uint8 *)&it->second.orig);
+		}
+
+		if (hit)
+		{
+			post(TEV_TRAP, t.info.tid, pc, 0);
+			running = false;
+			return false;
+		}
+	}
+
+	executed++;
+	timebase++;
+
+	uint32 op = w >> 26;
+	int rd = (w >> 21) & 31;
+	int ra = (w >> 16) & 31;
+	int rb = (w >> 11) & 31;
+	uint64 simm = sext(w & 0xffff, 16);
+	uint64 base = ra == 0 ? 0 : read_reg(t, TREG_GPR0 + ra);
+
+	switch (op)
+	{
+		case 10:    // cmpli
+		case 11:    // cmpi
+			{
+				int crf = (w >> 23) & 7;
+				bool l = (w >> 21) & 1;
+				uint64 a = read_reg(t, TREG_GPR0 + ra);
+				uint32 c;
+
+				if (op == 11)
+				{
+					int64 x = l ? int64(a) : int64(int32(a));
+					int64 y = int64(simm);
+					c = x < y ? 8 : x > y ? 4 : 2;
+				}
+				else
+				{
+					uint64 x = l ? a : uint32(a);
+					uint64 y = w & 0xffff;
+					c = x < y ? 8 : x > y ? 4 : 2;
+				}
+
+				uint32 cr = uint32(read_reg(t, TREG_CR) >> 32);
+				int shift = 28 - 4 * crf;
+
+				cr = (cr & ~(0xfU << shift)) | (c << shift);
+				write_reg(t, TREG_CR, uint64(cr) << 32);
+			}
+			break;
+
+		case 14:    // addi
+			write_reg(t, TREG_GPR0 + rd, base + simm);
+			break;
+
+		case 15:    // addis
+			write_reg(t, TREG_GPR0 + rd, base + (simm << 16));
+			break;
+
+		case 24:    // ori
+			write_reg(t, TREG_GPR0 + ra, read_reg(t, TREG_GPR0 + rd) | (w & 0xffff));
+			break;
+
+		case 16:    // bc
+		case 18:    // b
+		case 19:    // bclr, bcctr
+			{
+				uint32 xo = (w >> 1) & 0x3ff;
+
+				if (op == 19 && xo != 16 && xo != 528)
+					break;
+
+				ea_t target;
+				bool taken = true;
+
+				if (op == 18)
+				{
+					target = ea_t(sext(w & 0x3fffffc, 26));
+				}
+				else
+				{
+					int bo = rd;
+					int bi = ra;
+					uint32 cr = uint32(read_reg(t, TREG_CR) >> 32);
+
+					if ((bo & 4) == 0 && !(op == 19 && xo == 528))
+					{
+						uint64 ctr = read_reg(t, TREG_CTR) - 1;
+						write_reg(t, TREG_CTR, ctr);
+						taken = (ctr != 0) != ((bo & 2) != 0);
+					}
+
+					if ((bo & 0x10) == 0)
+						taken = taken && ((cr >> (31 - bi)) & 1) == uint32((bo >> 3) & 1);
+
+					if (op == 16)
+						target = ea_t(sext(w & 0xfffc, 16));
+					else if (xo == 16)
+						target = ea_t(read_reg(t, TREG_LR) & ~3ULL);
+					else
+						target = ea_t(read_reg(t, TREG_CTR) & ~3ULL);
+				}
+
+				if (op != 19 && (w & 2) == 0)
+					target += pc;
+
+				if (w & 1)
+					write_reg(t, TREG_LR, pc + 4);
+
+				if (taken)
+					next = target;
+			}
+			break;
+
+		case 31:
+			{
+				uint32 xo = (w >> 1) & 0x3ff;
+				int spr = ra | (rb << 5);
+
+				if (xo == 444)          // or
+				{
+					write_reg(t, TREG_GPR0 + ra, read_reg(t, TREG_GPR0 + rd) | read_reg(t, TREG_GPR0 + rb));
+				}
+				else if (xo == 467)     // mtspr
+				{
+					if (spr == SPR_LR || spr == SPR_CTR)
+						write_reg(t, spr == SPR_LR ? TREG_LR : TREG_CTR, read_reg(t, TREG_GPR0 + rd));
+				}
+				else if (xo == 339)     // mfspr
+				{
+					if (spr == SPR_LR || spr == SPR_CTR)
+						write_reg(t, TREG_GPR0 + rd, read_reg(t, spr == SPR_LR ? TREG_LR : TREG_CTR));
+				}
+			}
+			break;
+
+		case 32:    // lwz
+		case 36:    // stw
+		case 58:    // ld
+		case 62:    // std
+			{
+				bool is_store = op == 36 || op == 62;
+				uint32 size = op == 32 || op == 36 ? 4 : 8;
+				ea_t ea = ea_t(base + (size == 8 ? sext(w & 0xfffc, 16) : simm));
+				uint8 buf[8];
+
+				// ldu, lwa, stdu... are not interpreted
+				if (size == 8 && (w & 3) != 0)
+					break;
+
+				if (!check_dabr(t, ea, is_store))
+					return false;
+
+				if (is_store)
+				{
+					uint64 v = read_reg(t, TREG_GPR0 + rd);
+
+					if (size == 8)
+						store_be32(buf, uint32(v >> 32));
+					store_be32(buf + size - 4, uint32(v));
+
+					if (store(ea, buf, size))
+						break;
+				}
+				else if (peek(ea, buf, size))
+				{
+					uint64 v = load_be32(buf + size - 4);
+
+					if (size == 8)
+						v |= uint64(load_be32(buf)) << 32;
+
+					write_reg(t, TREG_GPR0 + rd, v);
+					break;
+				}
+
+				post(TEV_DATA_HTAB_MISS, t.info.tid, pc, ea);
+				running = false;
+				return false;
+			}
+	}
+
+	write_reg(t, TREG_PC, next);
+	return true;
+}
+
+//--------------------------------------------------------------------------
+void sim_backend_t::set_event_handler(target_event_handler_t *_handler, void *ud)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	handler = _handler;
+	handler_ud = ud;
+}
+
+void sim_backend_t::poll(void)
+{
+	std::vector<target_event_t> ready;
+	target_event_handler_t *h;
+	void *ud;
+
+	{
+		std::lock_guard<std::recursive_mutex> guard(lock);
+
+		for (uint32 n = 0; running && n < slice; n++)
+		{
+			std::map<uint64, thread_t>::iterator it;
+
+			for (it = threads.begin(); running && it != threads.end(); ++it)
+			{
+				if (!it->second.suspended)
+					execute(it->second);
+			}
+		}
+
+		ready.assign(pending.begin(), pending.end());
+		pending.clear();
+
+		h = handler;
+		ud = handler_ud;
+	}
+
+	// the handler may call us back
+	for (size_t i = 0; h != NULL && i < ready.size(); i++)
+		h(ready[i], ud);
+}
+
+//--------------------------------------------------------------------------
+bool sim_backend_t::get_processes(std::vector<target_process_t> *list)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	requests++;
+	*list = processes;
+	return true;
+}
+
+bool sim_backend_t::load_process(const char *path, uint32 *_pid)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	requests++;
+
+	// the scripted process stands in for whatever is loaded
+	uint32 n = processes.empty() ? 0 : processes[0].pid;
+
+	for (size_t i = 0; i < processes.size(); i++)
+	{
+		if (processes[i].path == path)
+			n = processes[i].pid;
+	}
+
+	if (n == 0)
+	{
+		n = 0x1010200;
+		add_process(n, path);
+	}
+
+	post(TEV_PROCESS_CREATE, 0, 0, 0);
+
+	pid = n;
+	running = false;
+	*_pid = n;
+
+	return true;
+}
+
+bool sim_backend_t::attach(uint32 _pid)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	requests++;
+
+	for (size_t i = 0; i < processes.size(); i++)
+	{
+		if (processes[i].pid == _pid)
+		{
+			pid = _pid;
+			running = false;
+			return true;
+		}
+	}
+
+	return fail(E_NO_PROCESS);
+}
+
+bool sim_backend_t::stop(void)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	requests++;
+
+	if (pid == 0)
+		return fail(E_NO_PROCESS);
+
+	running = false;
+	return true;
+}
+
+bool sim_backend_t::resume(void)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	requests++;
+
+	if (pid == 0)
+		return fail(E_NO_PROCESS);
+
+	running = true;
+	return true;
+}
+
+//--------------------------------------------------------------------------
+bool sim_backend_t::get_threads(std::vector<uint64> *tids)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	requests++;
+
+	tids->clear();
+
+	for (std::map<uint64, thread_t>::const_iterator it = threads.begin(); it != threads.end(); ++it)
+		tids->push_back(it->first);
+
+	return true;
+}
+
+bool sim_backend_t::get_thread_info(uint64 tid, target_thread_t *info)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	requests++;
+
+	std::map<uint64, thread_t>::const_iterator it = threads.find(tid);
+
+	if (it == threads.end())
+		return fail(E_NO_THREAD);
+
+	*info = it->second.info;
+
+	if (it->second.suspended)
+		info->state = TSTATE_SUSPENDED;
+	else
+		info->state = running ? TSTATE_ONPROC : TSTATE_STOP;
+
+	return true;
+}
+
+bool sim_backend_t::stop_thread(uint64 tid)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	requests++;
+
+	std::map<uint64, thread_t>::iterator it = threads.find(tid);
+
+	if (it == threads.end())
+		return fail(E_NO_THREAD);
+
+	it->second.suspended = true;
+	return true;
+}
+
+bool sim_backend_t::resume_thread(uint64 tid)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	requests++;
+
+	std::map<uint64, thread_t>::iterator it = threads.find(tid);
+
+	if (it == threads.end())
+		return fail(E_NO_THREAD);
+
+	it->second.suspended = false;
+	return true;
+}
+
+bool sim_backend_t::step_thread(uint64 tid)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	requests++;
+
+	if (pid == 0)
+		return fail(E_NO_PROCESS);
+
+	std::map<uint64, thread_t>::iterator it = threads.find(tid);
+
+	if (it == threads.end())
+		return fail(E_NO_THREAD);
+
+	// traps and faults have already been posted
+	if (execute(it->second))
+		post(TEV_STEP, tid, read_reg(it->second, TREG_PC), 0);
+
+	return true;
+}
+
+//--------------------------------------------------------------------------
+bool sim_backend_t::get_registers(uint64 tid, uint32 count, const uint32 *regs, uint8 *slots)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	requests++;
+
+	std::map<uint64, thread_t>::const_iterator it = threads.find(tid);
+
+	if (it == threads.end())
+		return fail(E_NO_THREAD);
+
+	for (uint32 i = 0; i < count; i++)
+	{
+		if (regs[i] >= TREG_COUNT)
+			return fail(E_BAD_PARAM);
+
+		memcpy(slots + i * TREG_SLOT_SIZE, it->second.regs[regs[i]], TREG_SLOT_SIZE);
+	}
+
+	return true;
+}
+
+bool sim_backend_t::set_registers(uint64 tid, uint32 count, const uint32 *regs, const uint8 *slots)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	requests++;
+
+	std::map<uint64, thread_t>::iterator it = threads.find(tid);
+
+	if (it == threads.end())
+		return fail(E_NO_THREAD);
+
+	for (uint32 i = 0; i < count; i++)
+	{
+		if (regs[i] >= TREG_COUNT)
+			return fail(E_BAD_PARAM);
+	}
+
+	for (uint32 i = 0; i < count; i++)
+		memcpy(it->second.regs[regs[i]], slots + i * TREG_SLOT_SIZE, TREG_SLOT_SIZE);
+
+	return true;
+}
+
+//--------------------------------------------------------------------------
+bool sim_backend_t::get_spu_groups(std::vector<uint32> *ids)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	requests++;
+
+	ids->clear();
+
+	for (std::map<uint32, target_spu_group_t>::const_iterator it = spu_groups.begin(); it != spu_groups.end(); ++it)
+		ids->push_back(it->first);
+
+	return true;
+}
+
+bool sim_backend_t::get_spu_group_info(uint32 id, target_spu_group_t *info)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	requests++;
+
+	std::map<uint32, target_spu_group_t>::const_iterator it = spu_groups.find(id);
+
+	if (it == spu_groups.end())
+		return fail(E_NOT_FOUND);
+
+	*info = it->second;
+	info->state = running ? SGSTATE_RUNNING : SGSTATE_STOPPED;
+
+	return true;
+}
+
+bool sim_backend_t::get_spu_registers(uint32 tid, uint32 count, const uint32 *regs, uint8 *slots)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	requests++;
+
+	std::map<uint32, spu_thread_t>::const_iterator it = spu_threads.find(tid);
+
+	if (it == spu_threads.end())
+		return fail(E_NO_THREAD);
+
+	for (uint32 i = 0; i < count; i++)
+	{
+		if (regs[i] >= SREG_COUNT)
+			return fail(E_BAD_PARAM);
+
+		memcpy(slots + i * TREG_SLOT_SIZE, it->second.regs[regs[i]], TREG_SLOT_SIZE);
+	}
+
+	return true;
+}
+
+//--------------------------------------------------------------------------
+bool sim_backend_t::read_memory(ea_t ea, void *buffer, uint32 size)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	requests++;
+
+	// like the real target, the traps are visible
+	return peek(ea, buffer, size);
+}
+
+bool sim_backend_t::write_memory(ea_t ea, const void *buffer, uint32 size)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	requests++;
+
+	// like the real target, the word saved under a breakpoint is the one
+	// found when it was set, clear_breakpoint puts that one back
+	return poke(ea, buffer, size);
+}
+
+bool sim_backend_t::get_memory_areas(std::vector<target_memory_area_t> *areas)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+	std::vector<uint32> numbers;
+
+	requests++;
+
+	for (std::unordered_map<uint32, page_t>::const_iterator it = pages.begin(); it != pages.end(); ++it)
+		numbers.push_back(it->first);
+
+	std::sort(numbers.begin(), numbers.end());
+
+	areas->clear();
+
+	for (size_t i = 0; i < numbers.size(); i++)
+	{
+		uint64 base = uint64(numbers[i]) * SIM_PAGE_SIZE;
+
+		if (!areas->empty() && areas->back().base + areas->back().size == base)
+		{
+			areas->back().size += SIM_PAGE_SIZE;
+			continue;
+		}
+
+		target_memory_area_t a;
+		a.base = base;
+		a.size = SIM_PAGE_SIZE;
+		areas->push_back(a);
+	}
+
+	return true;
+}
+
+bool sim_backend_t::store(ea_t ea, const void *buffer, uint32 size)
+{
+	if (!poke(ea, buffer, size))
+		return false;
+
+	// bytes written over a breakpoint go under the trap, which stays armed
+	std::map<ea_t, bpt_t>::iterator it = bpts.lower_bound(ea >= 3 ? ea - 3 : 0);
+	uint8 trap[4];
+
+	store_be32(trap, TRAP_WORD);
+
+	for (; it != bpts.end() && it->first < ea + size; ++it)
+	{
+		uint8 *orig = (uint8 *)&it->second.orig;
+
+		for (int i = 0; i < 4; i++)
+		{
+			ea_t a = it->first + i;
+
+			if (a >= ea && a < ea + size)
+				orig[i] = ((const uint8 *)buffer)[a - ea];
+		}
+
+		poke(it->first, trap, 4);
+	}
+
+	return true;
+}
+
+//--------------------------------------------------------------------------
+bool sim_backend_t::set_breakpoint(uint64 tid, ea_t ea)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	requests++;
+
+	std::map<ea_t, bpt_t>::iterator it = bpts.find(ea);
+
+	if (it == bpts.end())
+	{
+		bpt_t b;
+		uint8 trap[4];
+
+		if (!peek(ea, &b.orig, 4))
+			return false;
+
+		store_be32(trap, TRAP_WORD);
+		poke(ea, trap, 4);
+
+		it = bpts.insert(std::make_pair(ea, b)).first;
+	}
+
+	std::vector<uint64> &tids = it->second.tids;
+
+	if (std::find(tids.begin(), tids.end(), tid) == tids.end())
+		tids.push_back(tid);
+
+	return true;
+}
+
+bool sim_backend_t::clear_breakpoint(uint64 tid, ea_t ea)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	requests++;
+
+	std::map<ea_t, bpt_t>::iterator it = bpts.find(ea);
+
+	if (it == bpts.end())
+		return fail(E_NOT_FOUND);
+
+	std::vector<uint64> &tids = it->second.tids;
+	std::vector<uint64>::iterator t = std::find(tids.begin(), tids.end(), tid);
+
+	if (t == tids.end())
+		return fail(E_NOT_FOUND);
+
+	tids.erase(t);
+
+	if (tids.empty())
+	{
+		poke(ea, &it->second.orig, 4);
+		bpts.erase(it);
+	}
+
+	return true;
+}
+
+bool sim_backend_t::get_breakpoints(uint64 tid, std::vector<uint64> *list)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	requests++;
+
+	list->clear();
+
+	for (std::map<ea_t, bpt_t>::const_iterator it = bpts.begin(); it != bpts.end(); ++it)
+	{
+		const std::vector<uint64> &tids = it->second.tids;
+
+		if (tid == uint64(-1) || std::find(tids.begin(), tids.end(), tid) != tids.end())
+			list->push_back(it->first);
+	}
+
+	return true;
+}
+
+bool sim_backend_t::set_dabr(uint64 value)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	requests++;
+
+	dabr = value;
+	return true;
+}
+
+//--------------------------------------------------------------------------
+bool sim_backend_t::get_modules(std::vector<uint32> *ids)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	requests++;
+
+	ids->clear();
+
+	for (std::map<uint32, target_module_t>::const_iterator it = modules.begin(); it != modules.end(); ++it)
+		ids->push_back(it->first);
+
+	return true;
+}
+
+bool sim_backend_t::get_module_info(uint32 id, target_module_t *info)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	requests++;
+
+	std::map<uint32, target_module_t>::const_iterator it = modules.find(id);
+
+	if (it == modules.end())
+		return fail(E_NOT_FOUND);
+
+	*info = it->second;
+	return true;
+}
+
+bool sim_backend_t::read_spu_ls(uint32 tid, uint32 addr, void *buffer, uint32 size)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	requests++;
+
+	std::map<uint32, spu_thread_t>::const_iterator it = spu_threads.find(tid);
+
+	if (it == spu_threads.end())
+		return fail(E_NO_THREAD);
+
+	if (addr > SPU_LS_SIZE || size > SPU_LS_SIZE - addr)
+		return fail(E_BAD_ADDRESS);
+
+	memcpy(buffer, &it->second.ls[addr], size);
+	return true;
+}
+
+//--------------------------------------------------------------------------
+void sim_backend_t::add_process(uint32 _pid, const char *path)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	target_process_t p;
+	p.pid = _pid;
+	p.path = path;
+	processes.push_back(p);
+}
+
+void sim_backend_t::map_memory(ea_t ea, size_t size)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	for (ea_t a = ea - ea % SIM_PAGE_SIZE; a < ea + size; a += SIM_PAGE_SIZE)
+		page(a, true);
+}
+
+bool sim_backend_t::write_words(ea_t ea, const uint32 *words, size_t count)
+{
+	std::vector<uint8> buf(count * 4);
+
+	for (size_t i = 0; i < count; i++)
+		store_be32(&buf[i * 4], words[i]);
+
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	return count == 0 || store(ea, &buf[0], uint32(buf.size()));
+}
+
+void sim_backend_t::add_thread(uint64 tid, const char *name, ea_t pc, ea_t sp, bool notify)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	thread_t &t = threads[tid];
+
+	t.info.tid = tid;
+	t.info.state = TSTATE_STOP;
+	t.info.priority = 1000;
+	t.info.stack_addr = sp - sp % SIM_PAGE_SIZE;
+	t.info.stack_size = SIM_PAGE_SIZE;
+	t.info.name = name;
+	t.suspended = false;
+
+	memset(t.regs, 0, sizeof(t.regs));
+	write_reg(t, TREG_PC, pc);
+	write_reg(t, TREG_GPR0 + 1, sp);
+
+	if (notify)
+		post(TEV_THREAD_CREATE, tid, 0, 0);
+}
+
+void sim_backend_t::remove_thread(uint64 tid, bool notify)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	threads.erase(tid);
+
+	if (notify)
+		post(TEV_THREAD_EXIT, tid, 0, 0);
+}
+
+void sim_backend_t::add_module(uint32 id, const char *name, ea_t base, uint32 size, bool notify)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	target_module_t &m = modules[id];
+	target_segment_t s;
+
+	s.base = base;
+	s.file_size = size;
+	s.mem_size = size;
+	s.elf_type = 1;             // PT_LOAD
+
+	m.id = id;
+	m.name = name;
+	m.segments.assign(1, s);
+
+	if (notify)
+		post(TEV_MODULE_LOAD, threads.empty() ? 0 : threads.begin()->first, 0, id);
+}
+
+void sim_backend_t::remove_module(uint32 id, bool notify)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	modules.erase(id);
+
+	if (notify)
+		post(TEV_MODULE_UNLOAD, threads.empty() ? 0 : threads.begin()->first, 0, id);
+}
+
+void sim_backend_t::add_spu_group(uint32 id, const char *name, uint32 first_tid, uint32 count, bool notify)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	target_spu_group_t &g = spu_groups[id];
+
+	g.id = id;
+	g.state = SGSTATE_STOPPED;
+	g.priority = 100;
+	g.name = name;
+	g.threads.clear();
+
+	for (uint32 i = 0; i < count; i++)
+	{
+		spu_thread_t &t = spu_threads[first_tid + i];
+
+		t.group = id;
+		t.ls.assign(SPU_LS_SIZE, 0);
+		memset(t.regs, 0, sizeof(t.regs));
+
+		g.threads.push_back(first_tid + i);
+	}
+
+	for (uint32 i = 0; notify && i < count; i++)
+		post(TEV_SPU_THREAD_START, first_tid + i, 0, id);
+}
+
+void sim_backend_t::remove_spu_group(uint32 id, bool notify)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	std::map<uint32, target_spu_group_t>::iterator it = spu_groups.find(id);
+
+	if (it == spu_groups.end())
+		return;
+
+	for (size_t i = 0; i < it->second.threads.size(); i++)
+		spu_threads.erase(it->second.threads[i]);
+
+	spu_groups.erase(it);
+
+	if (notify)
+		post(TEV_SPU_GROUP_DESTROY, 0, 0, id);
+}
+
+bool sim_backend_t::write_ls(uint32 tid, uint32 addr, const uint32 *words, size_t count)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	std::map<uint32, spu_thread_t>::iterator it = spu_threads.find(tid);
+
+	if (it == spu_threads.end() || addr > SPU_LS_SIZE || count > (SPU_LS_SIZE - addr) / 4)
+		return false;
+
+	for (size_t i = 0; i < count; i++)
+		store_be32(&it->second.ls[addr + i * 4], words[i]);
+
+	return true;
+}
+
+void sim_backend_t::inject(const target_event_t &ev)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	pending.push_back(ev);
+}
+
+//--------------------------------------------------------------------------
+uint64 sim_backend_t::get_reg(uint64 tid, int r)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	std::map<uint64, thread_t>::const_iterator it = threads.find(tid);
+
+	if (it == threads.end() || r < 0 || r >= TREG_COUNT)
+		return 0;
+
+	return read_reg(it->second, r);
+}
+
+void sim_backend_t::set_reg(uint64 tid, int r, uint64 value)
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	std::map<uint64, thread_t>::iterator it = threads.find(tid);
+
+	if (it != threads.end() && r >= 0 && r < TREG_COUNT)
+		write_reg(it->second, r, value);
+}
+
+bool sim_backend_t::is_running(void) const
+{
+	std::lock_guard<std::recursive_mutex> guard(lock);
+
+	return running;
+}
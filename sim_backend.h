@@ -0,0 +1,163 @@
+#ifndef __SIM_BACKEND__
+#define __SIM_BACKEND__
+
+//
+//      In-process simulated PS3 target.
+//      Memory is a big-endian image made of pages mapped on demand, threads
+//      and modules are set up by a script (or the built-in demo), events can
+//      be injected at will. While the process runs, poll() executes a slice
+//      of instructions of every thread: branches, a few integer, compare and
+//      load/store forms are interpreted, anything else is a no-op. Traps and
+//      DABR matches stop the process and are reported like on a devkit.
+//      SPU thread groups hold a local store and registers but never run.
+//
+
+#include <map>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+#include "backend.h"
+
+#define SIM_PAGE_SIZE 0x1000
+
+class sim_backend_t : public target_backend_t
+{
+	struct thread_t
+	{
+		target_thread_t info;
+		bool suspended;                         // stopped with stop_thread
+		uint8 regs[TREG_COUNT][TREG_SLOT_SIZE]; // target byte order
+	};
+
+	struct bpt_t
+	{
+		uint32 orig;                            // word under the trap, target byte order
+		std::vector<uint64> tids;               // threads it applies to, -1 for all
+	};
+
+	struct spu_thread_t
+	{
+		uint32 group;
+		std::vector<uint8> ls;                  // SPU_LS_SIZE bytes
+		uint8 regs[SREG_COUNT][TREG_SLOT_SIZE]; // target byte order
+	};
+
+	typedef std::vector<uint8> page_t;
+
+	mutable std::recursive_mutex lock;
+	std::unordered_map<uint32, page_t> pages;
+	std::map<uint64, thread_t> threads;
+	std::map<ea_t, bpt_t> bpts;
+	std::map<uint32, target_module_t> modules;
+	std::map<uint32, target_spu_group_t> spu_groups;
+	std::map<uint32, spu_thread_t> spu_threads;
+	std::vector<target_process_t> processes;
+	std::deque<target_event_t> pending;
+	target_event_handler_t *handler;
+	void *handler_ud;
+	uint32 pid;
+	bool running;
+	uint64 dabr;
+	uint64 timebase;
+	int err;
+
+	bool fail(int code) { err = code; return false; }
+
+	uint8 *page(ea_t ea, bool create);
+	bool peek(ea_t ea, void *buffer, uint32 size);
+	bool poke(ea_t ea, const void *buffer, uint32 size);
+	bool store(ea_t ea, const void *buffer, uint32 size);
+	static uint64 read_reg(const thread_t &t, int r);
+	static void write_reg(thread_t &t, int r, uint64 value);
+	void post(uint32 type, uint64 tid, uint64 pc, uint64 arg);
+
+	// Execute one instruction, returns false if the process stopped
+	bool execute(thread_t &t);
+	bool check_dabr(thread_t &t, ea_t ea, bool store);
+
+public:
+	// Instructions run by every thread in each poll() while the process runs
+	uint32 slice;
+
+	// Requests served and instructions executed
+	uint64 requests;
+	uint64 executed;
+
+	enum { E_OK = 0, E_NO_PROCESS = -1, E_NO_THREAD = -2, E_BAD_ADDRESS = -3, E_BAD_PARAM = -4, E_NOT_FOUND = -5 };
+
+	sim_backend_t();
+
+	virtual const char *name(void) const { return "simulator"; }
+	virtual int error(void) const { return err; }
+
+	// Sets up the demo process if the script did not create any
+	virtual bool open(void);
+	virtual void close(void) {}
+
+	virtual void set_event_handler(target_event_handler_t *_handler, void *ud);
+	virtual void poll(void);
+
+	virtual bool get_processes(std::vector<target_process_t> *list);
+	virtual bool load_process(const char *path, uint32 *_pid);
+	virtual bool attach(uint32 _pid);
+	virtual bool stop(void);
+	virtual bool resume(void);
+
+	virtual bool get_threads(std::vector<uint64> *tids);
+	virtual bool get_thread_info(uint64 tid, target_thread_t *info);
+	virtual bool stop_thread(uint64 tid);
+	virtual bool resume_thread(uint64 tid);
+	virtual bool step_thread(uint64 tid);
+
+	virtual bool get_registers(uint64 tid, uint32 count, const uint32 *regs, uint8 *slots);
+	virtual bool set_registers(uint64 tid, uint32 count, const uint32 *regs, const uint8 *slots);
+
+	virtual bool get_spu_groups(std::vector<uint32> *ids);
+	virtual bool get_spu_group_info(uint32 id, target_spu_group_t *info);
+	virtual bool get_spu_registers(uint32 tid, uint32 count, const uint32 *regs, uint8 *slots);
+
+	virtual bool read_memory(ea_t ea, void *buffer, uint32 size);
+	virtual bool write_memory(ea_t ea, const void *buffer, uint32 size);
+
+	// The mapped pages, merged where they follow each other
+	virtual bool get_memory_areas(std::vector<target_memory_area_t> *areas);
+
+	virtual bool read_spu_ls(uint32 tid, uint32 addr, void *buffer, uint32 size);
+
+	virtual bool set_breakpoint(uint64 tid, ea_t ea);
+	virtual bool clear_breakpoint(uint64 tid, ea_t ea);
+	virtual bool get_breakpoints(uint64 tid, std::vector<uint64> *list);
+	virtual bool set_dabr(uint64 value);
+
+	virtual bool get_modules(std::vector<uint32> *ids);
+	virtual bool get_module_info(uint32 id, target_module_t *info);
+
+	// Script interface. The 'notify' variants queue the matching event.
+	void add_process(uint32 _pid, const char *path);
+	void map_memory(ea_t ea, size_t size);
+	bool write_words(ea_t ea, const uint32 *words, size_t count);
+	void add_thread(uint64 tid, const char *name, ea_t pc, ea_t sp, bool notify = false);
+	void remove_thread(uint64 tid, bool notify = false);
+	void add_module(uint32 id, const char *name, ea_t base, uint32 size, bool notify = false);
+	void remove_module(uint32 id, bool notify = false);
+
+	// SPU thread group 'id' of 'count' threads numbered from 'first_tid',
+	// each one stopped at LS address 0 with an empty local store
+	void add_spu_group(uint32 id, const char *name, uint32 first_tid, uint32 count, bool notify = false);
+	void remove_spu_group(uint32 id, bool notify = false);
+	bool write_ls(uint32 tid, uint32 addr, const uint32 *words, size_t count);
+	void inject(const target_event_t &ev);
+
+	// Register access by TREG_ number, CR is kept in the upper word
+	uint64 get_reg(uint64 tid, int r);
+	void set_reg(uint64 tid, int r, uint64 value);
+
+	bool is_running(void) const;
+
+	// A counting loop at 0x10200 in one thread of process 0x1010200,
+	// and an SPU thread group of two threads running the same loop
+	void load_demo(void);
+};
+
+#endif
@@ -0,0 +1,233 @@
+// Copyright (C) 2014 oct0xor
+//
+// This program is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License 2.0 for more details.
+//
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http ://www.gnu.org/licenses/
+
+#include <algorithm>
+#include "spu.h"
+
+// every window must be addressable by IDA, the (ea_t) casts would wrap otherwise
+CASSERT(SPU_LS_BASE + uint64(SPU_LS_SLOTS) * SPU_LS_STRIDE - 1 <= uint64(BADADDR));
+
+//--------------------------------------------------------------------------
+const spu_thread_t *spu_table_t::find(uint32 tid) const
+{
+	thread_map_t::const_iterator it = threads.find(tid);
+
+	return it != threads.end() ? &it->second : NULL;
+}
+
+const target_spu_group_t *spu_table_t::group(uint32 id) const
+{
+	std::map<uint32, target_spu_group_t>::const_iterator it = groups.find(id);
+
+	return it != groups.end() ? &it->second : NULL;
+}
+
+const spu_thread_t *spu_table_t::at(uint64 ea) const
+{
+	if (ea < base)
+		return NULL;
+
+	uint64 slot = (ea - base) / SPU_LS_STRIDE;
+
+	if (slot >= slots.size() || slots[size_t(slot)] == 0 || (ea - base) % SPU_LS_STRIDE >= SPU_LS_SIZE)
+		return NULL;
+
+	return find(slots[size_t(slot)]);
+}
+
+//--------------------------------------------------------------------------
+void spu_table_t::remove_thread(uint32 tid, std::vector<uint32> *removed)
+{
+	thread_map_t::iterator it = threads.find(tid);
+
+	if (it == threads.end())
+		return;
+
+	slots[it->second.slot] = 0;
+	snapshots.erase(tid);
+	threads.erase(it);
+
+	removed->push_back(tid);
+}
+
+void spu_table_t::update_group(const target_spu_group_t &info, std::vector<uint32> *added, std::vector<uint32> *removed)
+{
+	std::map<uint32, target_spu_group_t>::iterator g = groups.find(info.id);
+
+	if (g != groups.end())
+	{
+		const std::vector<uint32> &old = g->second.threads;
+
+		for (size_t i = 0; i < old.size(); i++)
+		{
+			if (std::find(info.threads.begin(), info.threads.end(), old[i]) == info.threads.end())
+				remove_thread(old[i], removed);
+		}
+	}
+
+	groups[info.id] = info;
+
+	for (size_t i = 0; i < info.threads.size(); i++)
+	{
+		uint32 tid = info.threads[i];
+		thread_map_t::iterator it = threads.find(tid);
+
+		if (it != threads.end())
+		{
+			it->second.group = info.id;
+			it->second.index = uint32(i);
+			continue;
+		}
+
+		// the first free window
+		size_t slot = std::find(slots.begin(), slots.end(), 0) - slots.begin();
+
+		if (slot == SPU_LS_SLOTS)
+			continue;
+
+		if (slot == slots.size())
+			slots.push_back(0);
+
+		slots[slot] = tid;
+
+		spu_thread_t &t = threads[tid];
+
+		t.tid = tid;
+		t.group = info.id;
+		t.index = uint32(i);
+		t.slot = uint32(slot);
+
+		added->push_back(tid);
+	}
+}
+
+void spu_table_t::remove_group(uint32 id, std::vector<uint32> *removed)
+{
+	std::map<uint32, target_spu_group_t>::iterator g = groups.find(id);
+
+	if (g == groups.end())
+		return;
+
+	const std::vector<uint32> &tids = g->second.threads;
+
+	for (size_t i = 0; i < tids.size(); i++)
+	{
+		const spu_thread_t *t = find(tids[i]);
+
+		// the id may have gone to another group since
+		if (t != NULL && t->group == id)
+			remove_thread(tids[i], removed);
+	}
+
+	groups.erase(g);
+}
+
+void spu_table_t::sync(const std::vector<uint32> &ids, std::vector<uint32> *removed)
+{
+	std::vector<uint32> gone;
+
+	for (std::map<uint32, target_spu_group_t>::const_iterator it = groups.begin(); it != groups.end(); ++it)
+	{
+		if (std::find(ids.begin(), ids.end(), it->first) == ids.end())
+			gone.push_back(it->first);
+	}
+
+	for (size_t i = 0; i < gone.size(); i++)
+		remove_group(gone[i], removed);
+}
+
+void spu_table_t::clear(void)
+{
+	groups.clear();
+	threads.clear();
+	slots.clear();
+	snapshots.clear();
+}
+
+//--------------------------------------------------------------------------
+const uint8 *spu_table_t::ls(uint32 tid, target_backend_t *backend)
+{
+	if (threads.count(tid) == 0)
+		return NULL;
+
+	snapshot_t &s = snapshots[tid];
+
+	if (!s.ls_valid)
+	{
+		s.ls.resize(SPU_LS_SIZE);
+
+		// one request for the whole local store, whatever part is asked for
+		if (!backend->read_spu_ls(tid, 0, &s.ls[0], SPU_LS_SIZE))
+			return NULL;
+
+		s.ls_valid = true;
+		ls_fetches++;
+	}
+
+	return &s.ls[0];
+}
+
+const uint8 *spu_table_t::registers(uint32 tid, target_backend_t *backend)
+{
+	if (threads.count(tid) == 0)
+		return NULL;
+
+	snapshot_t &s = snapshots[tid];
+
+	if (!s.regs_valid)
+	{
+		uint32 ids[SREG_COUNT];
+
+		for (uint32 i = 0; i < SREG_COUNT; i++)
+			ids[i] = i;
+
+		if (!backend->get_spu_registers(tid, SREG_COUNT, ids, &s.regs[0][0]))
+			return NULL;
+
+		s.regs_valid = true;
+		reg_fetches++;
+	}
+
+	return &s.regs[0][0];
+}
+
+size_t spu_table_t::read(uint64 ea, void *buffer, size_t size, target_backend_t *backend)
+{
+	const spu_thread_t *t = at(ea);
+
+	if (t == NULL)
+		return 0;
+
+	const uint8 *p = ls(t->tid, backend);
+
+	if (p == NULL)
+		return 0;
+
+	uint32 offset = uint32(ea - window(*t));
+	size_t count = qmin(size, size_t(SPU_LS_SIZE - offset));
+
+	memcpy(buffer, p + offset, count);
+	reads++;
+
+	return count;
+}
+
+void spu_table_t::invalidate(void)
+{
+	for (std::map<uint32, snapshot_t>::iterator it = snapshots.begin(); it != snapshots.end(); ++it)
+	{
+		it->second.ls_valid = false;
+		it->second.regs_valid = false;
+	}
+}
@@ -0,0 +1,143 @@
+#ifndef __SPU__
+#define __SPU__
+
+//
+//      SPU threads of the process.
+//      The threads of the SPU thread groups are shown to IDA as threads of
+//      the process, the local store of each one in a window of the address
+//      space. A local store is fetched whole the first time it is read after
+//      a stop, then served from that snapshot until the process runs again,
+//      and so are the registers.
+//
+
+#include <string.h>
+#include <map>
+#include <vector>
+#include "backend.h"
+
+// Local store windows follow each other this far apart. With 64 bit
+// addresses they start above the 32 bit address space of the processes,
+// which lv2 never maps. A 32 bit ea_t can't reach there, so they go to the
+// upper half of the raw SPU area instead, past the few raw SPUs lv2 creates
+// at 0xE0000000 + n * 0x100000 and below the SPU thread area at 0xF0000000.
+#define SPU_LS_STRIDE 0x100000
+#define SPU_LS_SLOTS  128
+#ifdef __EA64__
+#define SPU_LS_BASE   0x100000000ULL
+#else
+#define SPU_LS_BASE   0xE8000000ULL
+#endif
+
+// SPU status at a stop (TEV_SPU_THREAD_STOP)
+#define SPU_STATUS_STOP_SIGNAL  0x00000002  // stop and signal, code in the top bits
+#define SPU_STATUS_HALT         0x00000004
+#define SPU_STATUS_STEP         0x00000008
+#define SPU_STATUS_INVALID_INSN 0x00000020
+#define SPU_STATUS_INVALID_CH   0x00000040
+#define SPU_STOP_CODE(status)   (((status) >> 16) & 0x3FFF)
+
+// Stop and signal codes of lv2 and of the debugger
+#define SPU_STOP_GROUP_EXIT     0x101       // sys_spu_thread_group_exit
+#define SPU_STOP_THREAD_EXIT    0x102       // sys_spu_thread_exit
+#define SPU_STOP_DEBUG          0x3FFF      // stopd, a breakpoint
+
+struct spu_thread_t
+{
+	uint32 tid;
+	uint32 group;
+	uint32 index;                       // in its group
+	uint32 slot;                        // local store window, below SPU_LS_SLOTS
+};
+
+// Preferred slot of register 'r' (SREG_...) in the slots returned by get_spu_registers
+static inline uint32 spu_word(const uint8 *regs, int r)
+{
+	uint32 word;
+
+	memcpy(&word, regs + r * TREG_SLOT_SIZE, sizeof(word));
+	return bswap32(word);
+}
+
+// Did the thread stop on a fault or a breakpoint, rather than to exit or
+// to signal the PPU as it does in normal operation?
+static inline bool spu_stop_abnormal(uint32 status)
+{
+	if (status & (SPU_STATUS_HALT | SPU_STATUS_INVALID_INSN | SPU_STATUS_INVALID_CH))
+		return true;
+
+	return (status & SPU_STATUS_STOP_SIGNAL) && SPU_STOP_CODE(status) == SPU_STOP_DEBUG;
+}
+
+//--------------------------------------------------------------------------
+class spu_table_t
+{
+	struct snapshot_t
+	{
+		bool ls_valid;
+		bool regs_valid;
+		std::vector<uint8> ls;          // kept from one stop to the next
+		uint8 regs[SREG_COUNT][TREG_SLOT_SIZE];
+
+		snapshot_t() : ls_valid(false), regs_valid(false) {}
+	};
+
+	typedef std::map<uint32, spu_thread_t> thread_map_t;
+
+	std::map<uint32, target_spu_group_t> groups;
+	thread_map_t threads;
+	std::vector<uint32> slots;          // thread in each window, 0 if free
+	std::map<uint32, snapshot_t> snapshots;
+
+	void remove_thread(uint32 tid, std::vector<uint32> *removed);
+
+public:
+	// Address of the first local store window
+	uint64 base;
+
+	// Local stores and register sets fetched, reads served from the snapshots
+	uint32 ls_fetches;
+	uint32 reg_fetches;
+	uint32 reads;
+
+	spu_table_t() : base(0), ls_fetches(0), reg_fetches(0), reads(0) {}
+
+	typedef thread_map_t::const_iterator const_iterator;
+
+	const_iterator begin(void) const { return threads.begin(); }
+	const_iterator end(void) const { return threads.end(); }
+	size_t size(void) const { return threads.size(); }
+
+	// NULL if not known
+	const spu_thread_t *find(uint32 tid) const;
+	const target_spu_group_t *group(uint32 id) const;
+
+	// Start of the local store window of 't'
+	uint64 window(const spu_thread_t &t) const { return base + uint64(t.slot) * SPU_LS_STRIDE; }
+
+	// Thread whose local store is shown at 'ea', NULL if none
+	const spu_thread_t *at(uint64 ea) const;
+
+	// Add or refresh group 'info', its new threads go to 'added' and the
+	// ones it lost to 'removed'. Threads are left out once every window is taken.
+	void update_group(const target_spu_group_t &info, std::vector<uint32> *added, std::vector<uint32> *removed);
+	void remove_group(uint32 id, std::vector<uint32> *removed);
+
+	// Drop the groups missing from 'ids'
+	void sync(const std::vector<uint32> &ids, std::vector<uint32> *removed);
+
+	void clear(void);
+
+	// Local store (SPU_LS_SIZE bytes) and registers (SREG_COUNT slots) of
+	// 'tid', fetched once per stop. NULL if the target could not be read.
+	const uint8 *ls(uint32 tid, target_backend_t *backend);
+	const uint8 *registers(uint32 tid, target_backend_t *backend);
+
+	// Read up to 'size' bytes at 'ea' from one local store window,
+	// returns the number of bytes read, 0 on failure
+	size_t read(uint64 ea, void *buffer, size_t size, target_backend_t *backend);
+
+	// The process ran, every snapshot has to be fetched again
+	void invalidate(void);
+};
+
+#endif
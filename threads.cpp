@@ -0,0 +1,101 @@
+// Copyright (C) 2014 oct0xor
+//
+// This program is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License 2.0 for more details.
+//
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http ://www.gnu.org/licenses/
+
+#include <algorithm>
+#include "threads.h"
+
+//--------------------------------------------------------------------------
+const target_thread_t *thread_table_t::find(uint64 tid) const
+{
+	thread_map_t::const_iterator it = threads.find(tid);
+
+	return it != threads.end() ? &it->second : NULL;
+}
+
+void thread_table_t::update(const target_thread_t &info)
+{
+	threads[info.tid] = info;
+	unknown.erase(info.tid);
+}
+
+void thread_table_t::add(uint64 tid)
+{
+	if (threads.count(tid) != 0)
+		return;
+
+	target_thread_t &t = threads[tid];
+
+	t.tid = tid;
+	t.state = 0;
+	t.priority = 0;
+	t.stack_addr = 0;
+	t.stack_size = 0;
+	unknown.insert(tid);
+}
+
+bool thread_table_t::remove(uint64 tid)
+{
+	unknown.erase(tid);
+	return threads.erase(tid) != 0;
+}
+
+int thread_table_t::state(uint64 tid) const
+{
+	const target_thread_t *t = find(tid);
+
+	return t != NULL && unknown.count(tid) == 0 ? int(t->state) : -1;
+}
+
+bool thread_table_t::set_state(uint64 tid, uint32 state)
+{
+	thread_map_t::iterator it = threads.find(tid);
+
+	if (it == threads.end())
+		return false;
+
+	it->second.state = state;
+	unknown.erase(tid);
+	return true;
+}
+
+void thread_table_t::forget_states(void)
+{
+	for (thread_map_t::const_iterator it = threads.begin(); it != threads.end(); ++it)
+		unknown.insert(it->first);
+}
+
+//--------------------------------------------------------------------------
+void thread_table_t::sync(const std::vector<uint64> &tids, std::vector<uint64> *added)
+{
+	std::vector<uint64> sorted(tids);
+
+	std::sort(sorted.begin(), sorted.end());
+
+	for (thread_map_t::iterator it = threads.begin(); it != threads.end(); )
+	{
+		if (!std::binary_search(sorted.begin(), sorted.end(), it->first))
+		{
+			unknown.erase(it->first);
+			it = threads.erase(it);
+		}
+		else
+			++it;
+	}
+
+	for (size_t i = 0; i < sorted.size(); i++)
+	{
+		if (threads.count(sorted[i]) == 0)
+			added->push_back(sorted[i]);
+	}
+}
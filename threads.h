@@ -0,0 +1,52 @@
+#ifndef __THREADS__
+#define __THREADS__
+
+//
+//      Threads of the process as last reported by the target.
+//      Filled at attach, then kept up to date from the thread events and
+//      from the thread list of the eager snapshot, so that looking a thread
+//      up costs no request. The states are forgotten at each stop and asked
+//      again per thread, as are the threads only known by their id.
+//
+
+#include <map>
+#include <set>
+#include <vector>
+#include "backend.h"
+
+class thread_table_t
+{
+	typedef std::map<uint64, target_thread_t> thread_map_t;
+	thread_map_t threads;
+	std::set<uint64> unknown;           // threads whose state may have changed
+
+public:
+	typedef thread_map_t::const_iterator const_iterator;
+
+	const_iterator begin(void) const { return threads.begin(); }
+	const_iterator end(void) const { return threads.end(); }
+	size_t size(void) const { return threads.size(); }
+	void clear(void) { threads.clear(); unknown.clear(); }
+
+	// NULL if 'tid' is not known
+	const target_thread_t *find(uint64 tid) const;
+
+	void update(const target_thread_t &info);
+
+	// Record 'tid' without its info, which stays unknown until update()
+	void add(uint64 tid);
+	bool remove(uint64 tid);
+
+	// Last known state (TSTATE_...) of 'tid', -1 if it is not known
+	int state(uint64 tid) const;
+	bool set_state(uint64 tid, uint32 state);
+
+	// The threads ran, their states have to be asked again
+	void forget_state(uint64 tid) { unknown.insert(tid); }
+	void forget_states(void);
+
+	// Drop the threads missing from 'tids', the ones not known yet go to 'added'
+	void sync(const std::vector<uint64> &tids, std::vector<uint64> *added);
+};
+
+#endif
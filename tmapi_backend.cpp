@@ -0,0 +1,1072 @@
+// Copyright (C) 2014 oct0xor
+//
+// This program is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License 2.0 for more details.
+//
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http ://www.gnu.org/licenses/
+
+#define _WINSOCKAPI_
+
+#include <windows.h>
+#include <winsock2.h>
+#include <ws2tcpip.h>
+
+#include <vector>
+#include <string>
+
+#include <pro.h>
+#include <kernwin.hpp>
+
+#include "backend.h"
+#include "tmstats.h"
+#include "include\ps3tmapi.h"
+
+#ifdef _DEBUG
+#define debug_printf msg
+#else
+#define debug_printf(...)
+#endif
+
+std::vector<SNPS3TargetInfo*> Targets;
+std::string TargetName;
+HTARGET TargetID;
+
+bool LaunchTargetPicker = true;
+bool AlwaysDC = false;
+bool ForceDC = true;
+bool WasOriginallyConnected = false;
+
+// Target Manager number of every TREG_ register
+static const uint32 registers_id[] =
+{
+	SNPS3_gpr_0,
+	SNPS3_gpr_1,
+	SNPS3_gpr_2,	
+	SNPS3_gpr_3,	
+	SNPS3_gpr_4,	
+	SNPS3_gpr_5,	
+	SNPS3_gpr_6,	
+	SNPS3_gpr_7,	
+	SNPS3_gpr_8,	
+	SNPS3_gpr_9,	
+	SNPS3_gpr_10,
+	SNPS3_gpr_11,
+	SNPS3_gpr_12,
+	SNPS3_gpr_13,
+	SNPS3_gpr_14,
+	SNPS3_gpr_15,
+	SNPS3_gpr_16,
+	SNPS3_gpr_17,
+	SNPS3_gpr_18,
+	SNPS3_gpr_19,
+	SNPS3_gpr_20,
+	SNPS3_gpr_21,
+	SNPS3_gpr_22,
+	SNPS3_gpr_23,
+	SNPS3_gpr_24,
+	SNPS3_gpr_25,
+	SNPS3_gpr_26,
+	SNPS3_gpr_27,
+	SNPS3_gpr_28,
+	SNPS3_gpr_29,
+	SNPS3_gpr_30,
+	SNPS3_gpr_31,
+
+	SNPS3_pc,
+	SNPS3_cr,
+	SNPS3_lr,
+	SNPS3_ctr,
+	//SNPS3_xer		// "XER"
+	//SNPS3_fpscr	// "fpscr"
+	//SNPS3_vscr	// "vscr"
+	//SNPS3_vrsave  // "vrsave"
+	//SNPS3_msr		// "msr"
+
+	SNPS3_fpr_0,
+	SNPS3_fpr_1,
+	SNPS3_fpr_2,
+	SNPS3_fpr_3,
+	SNPS3_fpr_4,
+	SNPS3_fpr_5,
+	SNPS3_fpr_6,
+	SNPS3_fpr_7,
+	SNPS3_fpr_8,
+	SNPS3_fpr_9,
+	SNPS3_fpr_10,
+	SNPS3_fpr_11,
+	SNPS3_fpr_12,
+	SNPS3_fpr_13,
+	SNPS3_fpr_14,
+	SNPS3_fpr_15,
+	SNPS3_fpr_16,
+	SNPS3_fpr_17,
+	SNPS3_fpr_18,
+	SNPS3_fpr_19,
+	SNPS3_fpr_20,
+	SNPS3_fpr_21,
+	SNPS3_fpr_22,
+	SNPS3_fpr_23,
+	SNPS3_fpr_24,
+	SNPS3_fpr_25,
+	SNPS3_fpr_26,
+	SNPS3_fpr_27,
+	SNPS3_fpr_28,
+	SNPS3_fpr_29,
+	SNPS3_fpr_30,
+	SNPS3_fpr_31,
+
+	SNPS3_vmx_0,
+	SNPS3_vmx_1,
+	SNPS3_vmx_2,
+	SNPS3_vmx_3,
+	SNPS3_vmx_4,
+	SNPS3_vmx_5,
+	SNPS3_vmx_6,
+	SNPS3_vmx_7,
+	SNPS3_vmx_8,
+	SNPS3_vmx_9,
+	SNPS3_vmx_10,
+	SNPS3_vmx_11,
+	SNPS3_vmx_12,
+	SNPS3_vmx_13,
+	SNPS3_vmx_14,
+	SNPS3_vmx_15,
+	SNPS3_vmx_16,
+	SNPS3_vmx_17,
+	SNPS3_vmx_18,
+	SNPS3_vmx_19,
+	SNPS3_vmx_20,
+	SNPS3_vmx_21,
+	SNPS3_vmx_22,
+	SNPS3_vmx_23,
+	SNPS3_vmx_24,
+	SNPS3_vmx_25,
+	SNPS3_vmx_26,
+	SNPS3_vmx_27,
+	SNPS3_vmx_28,
+	SNPS3_vmx_29,
+	SNPS3_vmx_30,
+	SNPS3_vmx_31,
+	SNPS3_vscr,
+	SNPS3_vrsave,
+};
+
+// Target Manager number of the SREG_ registers following the GPRs
+static const uint32 spu_registers_id[] =
+{
+	SNPS3_spu_npc,
+	SNPS3_spu_fpscr,
+	SNPS3_spu_status,
+};
+
+CASSERT(qnumber(registers_id) == TREG_COUNT);
+CASSERT(qnumber(spu_registers_id) == SREG_COUNT - SREG_NPC);
+CASSERT(SNPS3_REGLEN == TREG_SLOT_SIZE);
+
+//-------------------------------------------------------------------------
+bool ConnectToActiveTarget()
+{
+	char* pszUsage = NULL;
+	SNRESULT snr;
+	// Connect to the target.
+	if (SN_FAILED(snr = TMAPI(SNPS3Connect)(TargetID, NULL)))
+	{
+		if (snr == SN_E_TARGET_IN_USE && ForceDC)
+		{
+			if (SN_FAILED( snr = TMAPI(SNPS3ForceDisconnect)(TargetID) ))
+			{
+				debug_printf("Unable to force disconnect %s\n", CUTF8ToWChar(pszUsage).c_str());
+				return false;
+			}
+			else
+			{
+				snr = TMAPI(SNPS3Connect)(TargetID, NULL);
+			}
+		}
+
+		if (SN_FAILED(snr))
+		{
+			debug_printf("Failed to connect to target\n");
+			return false;
+		}
+	}
+	else
+	{
+		WasOriginallyConnected = (snr == SN_S_NO_ACTION);
+	}
+
+	msg("Connected to target\n");
+	return true;
+}
+
+//-------------------------------------------------------------------------
+int __stdcall EnumCallBack(HTARGET hTarget)
+{
+	SNPS3TargetInfo ti;
+	std::auto_ptr<SNPS3TargetInfo> pti(new SNPS3TargetInfo);
+
+	if (pti.get())
+	{
+		ti.hTarget = hTarget;
+		ti.nFlags = SN_TI_TARGETID;
+
+		if (SN_S_OK == TMAPI(SNPS3GetTargetInfo)(&ti))
+		{
+			// Store target parameters.
+			pti->hTarget = hTarget;
+			pti->pszName = _strdup(ti.pszName);
+			pti->pszHomeDir = _strdup(ti.pszHomeDir);
+			pti->pszFSDir = _strdup(ti.pszFSDir);
+
+			// Store this target.
+			Targets.push_back(pti.release());
+		}
+		else
+		{
+			// Terminate enumeration.
+			return 1;
+		}
+	}
+
+	// Carry on with enumeration.
+	return 0;
+}
+
+void SetTargetName(std::string targetName)
+{ 
+	TargetName = targetName; 
+}
+
+void SetTargetId(HTARGET hTargetId) 
+{ 
+	TargetID = hTargetId; 
+}
+
+bool FindFirstConnectedTarget(void)
+{
+	ECONNECTSTATUS nStatus = (ECONNECTSTATUS) -1;
+	char*  pszUsage = 0;
+
+	std::vector<SNPS3TargetInfo*>::iterator iter = Targets.begin();
+
+	while (iter != Targets.end())
+	{
+		SNRESULT snr = TMAPI(SNPS3GetConnectStatus)((*iter)->hTarget,	&nStatus, &pszUsage);
+
+		if (SN_SUCCEEDED( snr ))
+		{
+			if (nStatus == CS_CONNECTED)
+			{
+				SNPS3TargetInfo ti;
+
+				ti.hTarget = (*iter)->hTarget;
+				ti.nFlags = SN_TI_TARGETID;
+
+				if (SN_S_OK == TMAPI(SNPS3GetTargetInfo)(&ti))
+				{
+					// Store target parameters.
+					SetTargetId(ti.hTarget);
+					SetTargetName(ti.pszName);
+
+					return true;
+				}
+			}
+		}
+		iter++;
+	}
+
+	return false;
+}
+
+bool FindFirstAvailableTarget(void)
+{
+	uint   nStatus = -1;
+	char*  pszUsage = 0;
+
+	std::vector<SNPS3TargetInfo*>::iterator iter = Targets.begin();
+
+	while (iter != Targets.end())
+	{
+		SNRESULT snr = TMAPI(SNPS3Connect)((*iter)->hTarget, NULL);
+
+		if (SN_SUCCEEDED( snr ))
+		{
+			SNPS3TargetInfo ti;
+
+			ti.hTarget = (*iter)->hTarget;
+			ti.nFlags = SN_TI_TARGETID;
+
+			if (SN_S_OK == TMAPI(SNPS3GetTargetInfo)(&ti))
+			{
+				// Store target parameters.
+				SetTargetId(ti.hTarget);
+				SetTargetName(ti.pszName);
+				return true;
+			}
+		}
+
+		iter++;
+	}
+
+	return false;
+}
+
+bool GetHostnames(const char* input, std::string& ipOut, std::string& dnsNameOut)
+{
+	WSADATA wsaData;
+	int iResult;
+
+	// Initialize Winsock
+	iResult = WSAStartup(MAKEWORD(2, 2), &wsaData);
+	if (iResult != 0) {
+		return false;
+	}
+
+	sockaddr_in remotemachine;
+	char hostname[NI_MAXHOST];
+
+	remotemachine.sin_family = AF_INET;
+	remotemachine.sin_addr.s_addr = inet_addr(input);
+
+	// IP->Hostname
+	DWORD dwRetVal = getnameinfo((SOCKADDR *)&remotemachine, 
+		sizeof(sockaddr), 
+		hostname, 
+		NI_MAXHOST, 
+		NULL, 
+		0, 
+		NI_NAMEREQD);
+
+	if (dwRetVal == 0)
+	{
+		dnsNameOut = hostname;
+		return true;
+	}
+
+	// Hostname -> IP
+	struct hostent *remoteHost;
+	remoteHost = gethostbyname(input);
+
+	int i = 0;
+	struct in_addr addr = { 0 };
+	if (remoteHost && remoteHost->h_addrtype == AF_INET)
+	{
+		if (remoteHost->h_addr_list[0] != 0)
+		{
+			addr.s_addr = *(u_long *) remoteHost->h_addr_list[0];
+			ipOut = inet_ntoa(addr);
+			return true;
+		}
+	}
+
+	WSACleanup();
+	return false;
+}
+
+bool GetTargetFromAddress(const char *pszIPAddr, HTARGET &hTarget)
+{
+	TMAPI_TCPIP_CONNECT_PROP oConnection;
+	std::vector<SNPS3TargetInfo*>::iterator iter = Targets.begin();
+
+	while (iter != Targets.end())
+	{
+		if (SN_SUCCEEDED( TMAPI(SNPS3GetConnectionInfo)((*iter)->hTarget, &oConnection) ))
+		{
+			if (wcscmp(UTF8ToWChar(std::string(pszIPAddr)).c_str(), CUTF8ToWChar(oConnection.szIPAddress)) == 0)
+			{
+				hTarget = (*iter)->hTarget;
+				return true;
+			}
+		}
+
+		++iter;
+	}
+
+	// If we didn't find a match there, do a DNS lookup
+	std::string ipAddress;
+	std::string dnsName;
+	if (!GetHostnames(pszIPAddr, ipAddress, dnsName))
+		return false;
+
+	// Now iterate again
+	iter = Targets.begin();
+
+	while (iter != Targets.end())
+	{
+		if (SN_SUCCEEDED( TMAPI(SNPS3GetConnectionInfo)((*iter)->hTarget, &oConnection) ))
+		{
+			if (wcscmp(UTF8ToWChar(ipAddress).c_str(), CUTF8ToWChar(oConnection.szIPAddress)) == 0
+				|| wcscmp(UTF8ToWChar(dnsName).c_str(), CUTF8ToWChar(oConnection.szIPAddress)) == 0)
+			{
+				hTarget = (*iter)->hTarget;
+				return true;
+			}
+		}
+
+		++iter;
+	}
+
+	return false;
+}
+
+bool SetUpTarget(void)
+{
+	SNRESULT snr;
+
+	// Enumerate available targets.
+	if (SN_FAILED( snr = TMAPI(SNPS3EnumerateTargets)(EnumCallBack) ))
+	{
+		debug_printf("Failed to enumerate targets\n");
+		return false;
+	}
+
+	// Attempt to get the target name from an environment variable...
+
+	if (LaunchTargetPicker)
+	{
+		debug_printf("Launching target picker...\n");
+		if (SN_FAILED(snr = TMAPI(SNPS3PickTarget)(NULL, &TargetID)))
+		{
+			debug_printf("Failed to pick target\n");
+			return false;
+		}
+
+		SNPS3TargetInfo targetInfo = {};
+		targetInfo.hTarget = TargetID;
+		targetInfo.nFlags = SN_TI_TARGETID;
+
+		if (SN_FAILED( snr = TMAPI(SNPS3GetTargetInfo)(&targetInfo) ))
+		{
+			debug_printf("Failed to get target info\n");
+			return false;
+		}
+
+		TargetName = std::string(targetInfo.pszName);
+	}
+
+	if (TargetName.empty())
+	{
+		wchar_t* pEnv = _wgetenv(L"PS3TARGET");
+		if (pEnv)
+			TargetName = WCharToUTF8(pEnv);
+	}
+
+	if (Targets.size() == 1 && TargetName.empty())
+	{
+		TargetName = Targets[0]->pszName;
+	}
+
+	// If no target has been selected then use the default target
+	if (TargetName.empty())
+	{
+		if (SN_S_OK == TMAPI(SNPS3GetDefaultTarget)(&TargetID))
+		{
+			SNPS3TargetInfo targetInfo = {};
+			targetInfo.hTarget = TargetID;
+			targetInfo.nFlags = SN_TI_TARGETID;
+
+			if (SN_FAILED( snr = TMAPI(SNPS3GetTargetInfo)(&targetInfo) ))
+			{
+				debug_printf("Failed to get target info\n");
+				return false;
+			}
+
+			TargetName = std::string(targetInfo.pszName);
+		}
+	}
+	
+	// If no target has been selected then use the first one connected or the first one available.
+	if (TargetName.empty())
+	{
+		if (!FindFirstConnectedTarget())
+		{
+			FindFirstAvailableTarget();
+		}
+	}
+	// Retrieve the target ID from the name or failing that IP.
+	if (SN_FAILED(snr = TMAPI(SNPS3GetTargetFromName)(TargetName.c_str(), &TargetID)))
+	{
+		if (!GetTargetFromAddress(TargetName.c_str(), TargetID))
+		{
+			debug_printf("Failed to find target! Please ensure target name/ip/hostname is correct\n");
+			return false;
+		}
+	}
+
+	return true;
+}
+
+//--------------------------------------------------------------------------
+class tmapi_backend_t : public target_backend_t
+{
+	uint32 pid;
+	SNRESULT snr;                               // last failure
+	target_event_handler_t *handler;
+	void *handler_ud;
+
+	// SPU thread groups listed along with the PPU threads by get_threads,
+	// valid until the process runs or a group comes or goes
+	std::vector<uint32> spu_groups;
+	bool spu_groups_valid;
+
+	void forget_spu_groups(void) { spu_groups_valid = false; }
+
+	bool check(SNRESULT r)
+	{
+		if (SN_FAILED(r))
+		{
+			snr = r;
+			return false;
+		}
+
+		return true;
+	}
+
+	void dispatch(const SNPS3_DBG_EVENT_DATA *pDbgData);
+
+	static void __stdcall TargetEventCallback(HTARGET hTarget, uint uEventType, uint uEvent,
+		SNRESULT snr, uint uDataLen, byte *pData, void *pUser);
+
+public:
+	tmapi_backend_t() : pid(0), snr(SN_S_OK), handler(NULL), handler_ud(NULL), spu_groups_valid(false) {}
+
+	virtual const char *name(void) const { return "tmapi"; }
+	virtual int error(void) const { return snr; }
+
+	virtual bool open(void);
+	virtual void close(void);
+
+	virtual void set_event_handler(target_event_handler_t *_handler, void *ud) { handler = _handler; handler_ud = ud; }
+	virtual void poll(void);
+
+	virtual bool get_processes(std::vector<target_process_t> *list);
+	virtual bool load_process(const char *path, uint32 *_pid);
+	virtual bool attach(uint32 _pid);
+	virtual bool stop(void) { return check(TMAPI(SNPS3ProcessStop)(TargetID, pid)); }
+	virtual bool resume(void) { forget_spu_groups(); return check(TMAPI(SNPS3ProcessContinue)(TargetID, pid)); }
+
+	virtual bool get_threads(std::vector<uint64> *tids);
+	virtual bool get_thread_info(uint64 tid, target_thread_t *info);
+	virtual bool stop_thread(uint64 tid) { return check(TMAPI(SNPS3ThreadStop)(TargetID, PS3_UI_CPU, pid, tid)); }
+	virtual bool resume_thread(uint64 tid) { return check(TMAPI(SNPS3ThreadContinue)(TargetID, PS3_UI_CPU, pid, tid)); }
+
+	// The Target Manager has no thread scoped step, breakpoints are used instead
+	virtual bool step_thread(uint64 tid) { snr = TARGET_E_UNSUPPORTED; return false; }
+
+	virtual bool get_registers(uint64 tid, uint32 count, const uint32 *regs, uint8 *slots);
+	virtual bool set_registers(uint64 tid, uint32 count, const uint32 *regs, const uint8 *slots);
+
+	virtual bool get_spu_groups(std::vector<uint32> *ids);
+	virtual bool get_spu_group_info(uint32 id, target_spu_group_t *info);
+	virtual bool get_spu_registers(uint32 tid, uint32 count, const uint32 *regs, uint8 *slots);
+
+	virtual bool read_memory(ea_t ea, void *buffer, uint32 size)
+	{
+		return check(TMAPI_IO(SNPS3ProcessGetMemory, size)(TargetID, PS3_UI_CPU, pid, -1, ea, size, (byte *)buffer));
+	}
+
+	virtual bool write_memory(ea_t ea, const void *buffer, uint32 size)
+	{
+		return check(TMAPI_IO(SNPS3ProcessSetMemory, size)(TargetID, PS3_UI_CPU, pid, -1, ea, size, (byte *)buffer));
+	}
+
+	virtual bool get_memory_areas(std::vector<target_memory_area_t> *areas);
+
+	virtual bool read_spu_ls(uint32 tid, uint32 addr, void *buffer, uint32 size)
+	{
+		return check(TMAPI_IO(SNPS3ProcessGetMemory, size)(TargetID, PS3_UI_SPU, pid, tid, addr, size, (byte *)buffer));
+	}
+
+	virtual bool set_breakpoint(uint64 tid, ea_t ea) { return check(TMAPI(SNPS3SetBreakPoint)(TargetID, PS3_UI_CPU, pid, tid, ea)); }
+	virtual bool clear_breakpoint(uint64 tid, ea_t ea) { return check(TMAPI(SNPS3ClearBreakPoint)(TargetID, PS3_UI_CPU, pid, tid, ea)); }
+	virtual bool get_breakpoints(uint64 tid, std::vector<uint64> *list);
+	virtual bool set_dabr(uint64 value) { return check(TMAPI(SNPS3SetDABR)(TargetID, pid, value)); }
+
+	virtual bool get_modules(std::vector<uint32> *ids);
+	virtual bool get_module_info(uint32 id, target_module_t *info);
+};
+
+target_backend_t *create_tmapi_backend(void)
+{
+	return new tmapi_backend_t;
+}
+
+//--------------------------------------------------------------------------
+bool tmapi_backend_t::open(void)
+{
+	if (!check(TMAPI(SNPS3InitTargetComms)()))
+	{
+		msg("Failed to initialize PS3TM SDK\n");
+		return false;
+	}
+
+	if (!SetUpTarget() || !ConnectToActiveTarget())
+	{
+		msg("Error connecting to target %s!\n", UTF8ToWChar(TargetName).c_str());
+		return false;
+	}
+
+	TMAPI(SNPS3RegisterTargetEventHandler)(TargetID, TargetEventCallback, this);
+
+	return true;
+}
+
+void tmapi_backend_t::close(void)
+{
+	// Do post stuff like disconnecting from target
+	if (AlwaysDC || (!WasOriginallyConnected))
+	{
+		if (TargetID != 0xffffffff)
+		{
+			TMAPI(SNPS3Disconnect)(TargetID);
+			debug_printf("Disconnect\n");
+		}
+	}
+
+	TMAPI(SNPS3CloseTargetComms)();
+	//SNPS3Exit();
+}
+
+//--------------------------------------------------------------------------
+void tmapi_backend_t::poll(void)
+{
+	SNRESULT r = SN_S_OK;
+	uint32 kicks = 0;
+
+	// polled every few ms, the calls would drown the requests in the statistics
+	do
+	{
+		r = SNPS3Kick();
+		kicks++;
+
+	} while (r == SN_S_OK);
+
+	tmapi_stats.record_kicks(kicks);
+}
+
+//  Process target event notifications.
+void __stdcall tmapi_backend_t::TargetEventCallback(HTARGET hTarget, uint uEventType, uint /*uEvent*/,
+	SNRESULT snr, uint uDataLen, byte *pData, void *pUser)
+{
+	tmapi_backend_t *self = (tmapi_backend_t *)pUser;
+
+	if (SN_FAILED( snr ) || uEventType != SN_EVENT_TARGET)
+		return;
+
+	uint uDataRemaining = uDataLen;
+
+	while (uDataRemaining)
+	{
+		SN_EVENT_TARGET_HDR *pHeader = (SN_EVENT_TARGET_HDR *)pData;
+
+		if (pHeader->uEvent == SN_TGT_EVENT_TARGET_SPECIFIC)
+			self->dispatch((SNPS3_DBG_EVENT_DATA *)(pData + sizeof(SN_EVENT_TARGET_HDR) + sizeof(SNPS3_DBG_EVENT_HDR)));
+
+		uDataRemaining -= pHeader->uSize;
+		pData += pHeader->uSize;
+	}
+}
+
+// Translate a target specific event and pass it to the handler
+void tmapi_backend_t::dispatch(const SNPS3_DBG_EVENT_DATA *pDbgData)
+{
+	target_event_t ev;
+
+	switch (pDbgData->uEventType)
+	{
+	case SNPS3_DBG_EVENT_PROCESS_CREATE:
+		ev.type = TEV_PROCESS_CREATE;
+		break;
+
+	case SNPS3_DBG_EVENT_PROCESS_EXIT:
+		ev.type = TEV_PROCESS_EXIT;
+		ev.arg = bswap64(pDbgData->ppu_process_exit.uExitCode);
+		break;
+
+	case SNPS3_DBG_EVENT_PPU_EXP_TRAP:          ev.type = TEV_TRAP;             goto exception;
+	case SNPS3_DBG_EVENT_PPU_EXP_PREV_INT:      ev.type = TEV_PRIV_INSTR;       goto exception;
+	case SNPS3_DBG_EVENT_PPU_EXP_ALIGNMENT:     ev.type = TEV_ALIGNMENT;        goto exception;
+	case SNPS3_DBG_EVENT_PPU_EXP_ILL_INST:      ev.type = TEV_ILLEGAL_INSTR;    goto exception;
+	case SNPS3_DBG_EVENT_PPU_EXP_TEXT_HTAB_MISS: ev.type = TEV_TEXT_HTAB_MISS;  goto exception;
+	case SNPS3_DBG_EVENT_PPU_EXP_TEXT_SLB_MISS: ev.type = TEV_TEXT_SLB_MISS;    goto exception;
+	case SNPS3_DBG_EVENT_PPU_EXP_DATA_HTAB_MISS: ev.type = TEV_DATA_HTAB_MISS;  goto exception;
+	case SNPS3_DBG_EVENT_PPU_EXP_FLOAT:         ev.type = TEV_FLOAT;            goto exception;
+	case SNPS3_DBG_EVENT_PPU_EXP_DATA_SLB_MISS: ev.type = TEV_DATA_SLB_MISS;    goto exception;
+	case SNPS3_DBG_EVENT_PPU_EXP_DABR_MATCH:    ev.type = TEV_DABR_MATCH;       goto exception;
+	case SNPS3_DBG_EVENT_PPU_EXP_STOP:          ev.type = TEV_STOP;
+exception:
+		// all PPU exceptions start with the thread and the faulting pc
+		ev.tid = bswap64(pDbgData->ppu_exc_trap.uPPUThreadID);
+		ev.pc = bswap64(pDbgData->ppu_exc_trap.uPC);
+		break;
+
+	case SNPS3_DBG_EVENT_PPU_EXP_STOP_INIT:
+		ev.type = TEV_STOP_INIT;
+		break;
+
+	case SNPS3_DBG_EVENT_PPU_EXC_DATA_MAT:
+		ev.type = TEV_DATA_MAT;
+		break;
+
+	case SNPS3_DBG_EVENT_PPU_THREAD_CREATE:
+		ev.type = TEV_THREAD_CREATE;
+		ev.tid = bswap64(pDbgData->ppu_thread_create.uPPUThreadID);
+		break;
+
+	case SNPS3_DBG_EVENT_PPU_THREAD_EXIT:
+		ev.type = TEV_THREAD_EXIT;
+		ev.tid = bswap64(pDbgData->ppu_thread_exit.uPPUThreadID);
+		break;
+
+	case SNPS3_DBG_EVENT_SPU_THREAD_START:
+		ev.type = TEV_SPU_THREAD_START;
+		ev.tid = bswap32(pDbgData->spu_thread_start.uSPUThreadID);
+		ev.arg = bswap32(pDbgData->spu_thread_start.uSPUThreadGroupID);
+		forget_spu_groups();
+		break;
+
+	case SNPS3_DBG_EVENT_SPU_THREAD_STOP:
+	case SNPS3_DBG_EVENT_SPU_THREAD_STOP_INIT:
+		// both carry the same fields, the reason is the SPU status register
+		ev.type = TEV_SPU_THREAD_STOP;
+		ev.tid = bswap32(pDbgData->spu_thread_stop.uSPUThreadID);
+		ev.pc = bswap32(pDbgData->spu_thread_stop.uPC);
+		ev.arg = bswap32(pDbgData->spu_thread_stop.uReason);
+		break;
+
+	case SNPS3_DBG_EVENT_SPU_THREAD_GROUP_DESTROY:
+		ev.type = TEV_SPU_GROUP_DESTROY;
+		ev.arg = bswap32(pDbgData->spu_thread_group_destroy.uSPUThreadGroupID);
+		forget_spu_groups();
+		break;
+
+	case SNPS3_DBG_EVENT_PRX_LOAD:
+		ev.type = TEV_MODULE_LOAD;
+		ev.tid = bswap64(pDbgData->prx_load.uPPUThreadID);
+		ev.arg = bswap32(pDbgData->prx_load.uPRXID);
+		ev.timebase = bswap64(pDbgData->prx_load.uTimestamp);
+		break;
+
+	case SNPS3_DBG_EVENT_PRX_UNLOAD:
+		ev.type = TEV_MODULE_UNLOAD;
+		ev.tid = bswap64(pDbgData->prx_unload.uPPUThreadID);
+		ev.arg = bswap32(pDbgData->prx_unload.uPRXID);
+		ev.timebase = bswap64(pDbgData->prx_unload.uTimestamp);
+		break;
+
+	default:
+		return;
+	}
+
+	if (handler != NULL)
+		handler(ev, handler_ud);
+}
+
+//--------------------------------------------------------------------------
+bool tmapi_backend_t::get_processes(std::vector<target_process_t> *list)
+{
+	uint32 NumProcesses = 0;
+	std::vector<uint32> ProcessesList;
+	std::vector<uint8> buf;
+
+	if (!check(TMAPI(SNPS3ProcessList)(TargetID, &NumProcesses, NULL)))
+		return false;
+
+	if (NumProcesses == 0)
+		return true;
+
+	ProcessesList.resize(NumProcesses);
+
+	if (!check(TMAPI(SNPS3ProcessList)(TargetID, &NumProcesses, &ProcessesList[0])))
+		return false;
+
+	for (uint32 i = 0; i < NumProcesses; i++)
+	{
+		uint32 ProcessesInfoSize = 0;
+
+		TMAPI(SNPS3ProcessInfo)(TargetID, ProcessesList[i], &ProcessesInfoSize, NULL);
+
+		buf.resize(qmax(ProcessesInfoSize, (uint32)sizeof(SNPS3PROCESSINFO)));
+
+		if (!check(TMAPI(SNPS3ProcessInfo)(TargetID, ProcessesList[i], &ProcessesInfoSize, (SNPS3PROCESSINFO *)&buf[0])))
+			return false;
+
+		target_process_t p;
+		p.pid = ProcessesList[i];
+		p.path = ((SNPS3PROCESSINFO *)&buf[0])->Hdr.szPath;
+		list->push_back(p);
+	}
+
+	return true;
+}
+
+bool tmapi_backend_t::load_process(const char *path, uint32 *_pid)
+{
+	//SNPS3Reset(TargetID, SNPS3TM_RESETP_QUICK_RESET);
+
+	TMAPI(SNPS3Reset)(TargetID, SNPS3TM_BOOTP_DEFAULT);
+
+	//SNPS3ResetEx(TargetID, SNPS3TM_BOOTP_DEBUG_MODE, SNPS3TM_BOOTP_SYSTEM_MODE, 0, (uint64) -1, 0, 0);
+
+	if (!check(TMAPI(SNPS3ProcessLoad)(TargetID, SNPS3_DEF_PROCESS_PRI, path, 0, NULL, 0, NULL, &pid, NULL, SNPS3_LOAD_FLAG_ENABLE_DEBUGGING | SNPS3_LOAD_FLAG_USE_ELF_PRIORITY | SNPS3_LOAD_FLAG_USE_ELF_STACKSIZE)))
+		return false;
+
+	*_pid = pid;
+	return true;
+}
+
+bool tmapi_backend_t::attach(uint32 _pid)
+{
+	pid = _pid;
+	forget_spu_groups();
+	return check(TMAPI(SNPS3ProcessAttach)(TargetID, PS3_UI_CPU, pid));
+}
+
+//--------------------------------------------------------------------------
+bool tmapi_backend_t::get_threads(std::vector<uint64> *tids)
+{
+	uint32 NumPPUThreads = 0;
+	uint32 NumSPUThreadGroups = 0;
+	std::vector<uint64> SPUThreadGroupIDs;
+
+	if (!check(TMAPI(SNPS3ThreadList)(TargetID, pid, &NumPPUThreads, NULL, &NumSPUThreadGroups, NULL)))
+		return false;
+
+	tids->resize(NumPPUThreads + 1);
+	SPUThreadGroupIDs.resize(NumSPUThreadGroups + 1);
+
+	if (!check(TMAPI(SNPS3ThreadList)(TargetID, pid, &NumPPUThreads, &(*tids)[0], &NumSPUThreadGroups, &SPUThreadGroupIDs[0])))
+	{
+		tids->clear();
+		return false;
+	}
+
+	tids->resize(NumPPUThreads);
+
+	// kept for get_spu_groups, which would have to list the threads again
+	spu_groups.clear();
+
+	for (uint32 i = 0; i < NumSPUThreadGroups; i++)
+		spu_groups.push_back(uint32(SPUThreadGroupIDs[i]));
+
+	spu_groups_valid = true;
+
+	return true;
+}
+
+bool tmapi_backend_t::get_thread_info(uint64 tid, target_thread_t *info)
+{
+	uint64 buf[1024 / sizeof(uint64)];
+	uint32 ThreadInfoSize = sizeof(buf);
+	SNPS3_PPU_THREAD_INFO *ThreadInfo = (SNPS3_PPU_THREAD_INFO *)buf;
+
+	if (!check(TMAPI(SNPS3ThreadInfo)(TargetID, PS3_UI_CPU, pid, tid, &ThreadInfoSize, (byte *)buf)))
+		return false;
+
+	info->tid = ThreadInfo->uThreadID;
+	info->state = ThreadInfo->uState;
+	info->priority = ThreadInfo->uPriority;
+	info->stack_addr = ThreadInfo->uStackAddress;
+	info->stack_size = ThreadInfo->uStackSize;
+	info->name = (const char *)(ThreadInfo + 1);
+
+	return true;
+}
+
+//--------------------------------------------------------------------------
+bool tmapi_backend_t::get_spu_groups(std::vector<uint32> *ids)
+{
+	if (!spu_groups_valid)
+	{
+		std::vector<uint64> tids;
+
+		if (!get_threads(&tids))
+			return false;
+	}
+
+	*ids = spu_groups;
+	return true;
+}
+
+bool tmapi_backend_t::get_spu_group_info(uint32 id, target_spu_group_t *info)
+{
+	uint32 buf[1024 / sizeof(uint32)];
+	uint32 GroupInfoSize = sizeof(buf);
+	SNPS3_SPU_THREAD_GROUP_INFO *GroupInfo = (SNPS3_SPU_THREAD_GROUP_INFO *)buf;
+
+	if (!check(TMAPI(SNPS3SPUThreadGroupInfo)(TargetID, pid, id, &GroupInfoSize, (byte *)buf)))
+		return false;
+
+	// the thread ids, then the name
+	const uint8 *end = (const uint8 *)buf + qmin(GroupInfoSize, uint32(sizeof(buf)));
+	const uint32 *ThreadIDs = GroupInfo->aThreadIDs;
+	uint32 NumThreads = qmin(GroupInfo->uNumThreads, uint32((end - (const uint8 *)ThreadIDs) / sizeof(uint32)));
+	const char *Name = (const char *)(ThreadIDs + NumThreads);
+
+	info->id = GroupInfo->uThreadGroupID;
+	info->state = GroupInfo->uState;
+	info->priority = GroupInfo->uPriority;
+	info->threads.assign(ThreadIDs, ThreadIDs + NumThreads);
+	info->name.assign(Name, strnlen(Name, qmin(GroupInfo->uThreadGroupNameLen, uint32(end - (const uint8 *)Name))));
+
+	return true;
+}
+
+bool tmapi_backend_t::get_spu_registers(uint32 tid, uint32 count, const uint32 *regs, uint8 *slots)
+{
+	uint32 ids[SREG_COUNT];
+
+	if (count > SREG_COUNT)
+		return false;
+
+	for (uint32 i = 0; i < count; i++)
+	{
+		if (regs[i] >= SREG_COUNT)
+			return false;
+
+		ids[i] = regs[i] < SREG_NPC ? SNPS3_spu_gpr_0 + regs[i] : spu_registers_id[regs[i] - SREG_NPC];
+	}
+
+	return check(TMAPI_IO(SNPS3ThreadGetRegisters, count * SNPS3_REGLEN)(TargetID, PS3_UI_SPU, pid, tid, count, ids, slots));
+}
+
+//--------------------------------------------------------------------------
+bool tmapi_backend_t::get_registers(uint64 tid, uint32 count, const uint32 *regs, uint8 *slots)
+{
+	uint32 ids[TREG_COUNT];
+
+	if (count > TREG_COUNT)
+		return false;
+
+	for (uint32 i = 0; i < count; i++)
+		ids[i] = registers_id[regs[i]];
+
+	return check(TMAPI_IO(SNPS3ThreadGetRegisters, count * SNPS3_REGLEN)(TargetID, PS3_UI_CPU, pid, tid, count, ids, slots));
+}
+
+bool tmapi_backend_t::set_registers(uint64 tid, uint32 count, const uint32 *regs, const uint8 *slots)
+{
+	uint32 ids[TREG_COUNT];
+
+	if (count > TREG_COUNT)
+		return false;
+
+	for (uint32 i = 0; i < count; i++)
+		ids[i] = registers_id[regs[i]];
+
+	return check(TMAPI_IO(SNPS3ThreadSetRegisters, count * SNPS3_REGLEN)(TargetID, PS3_UI_CPU, pid, tid, count, ids, (byte *)slots));
+}
+
+//--------------------------------------------------------------------------
+bool tmapi_backend_t::get_breakpoints(uint64 tid, std::vector<uint64> *list)
+{
+	uint32 BPCount = 0;
+
+	if (!check(TMAPI(SNPS3GetBreakPoints)(TargetID, PS3_UI_CPU, pid, tid, &BPCount, NULL)))
+		return false;
+
+	list->resize(BPCount);
+
+	if (BPCount == 0)
+		return true;
+
+	if (!check(TMAPI(SNPS3GetBreakPoints)(TargetID, PS3_UI_CPU, pid, tid, &BPCount, &(*list)[0])))
+	{
+		list->clear();
+		return false;
+	}
+
+	list->resize(BPCount);
+	return true;
+}
+
+//--------------------------------------------------------------------------
+bool tmapi_backend_t::get_memory_areas(std::vector<target_memory_area_t> *areas)
+{
+	uint32 AreaCount = 0;
+	uint32 BufSize = 0;
+
+	areas->clear();
+
+	if (!check(TMAPI(SNPS3GetVirtualMemoryInfo)(TargetID, pid, true, &AreaCount, &BufSize, NULL)))
+		return false;
+
+	if (AreaCount == 0 || BufSize == 0)
+		return true;
+
+	std::vector<uint64> buf((BufSize + sizeof(uint64) - 1) / sizeof(uint64));
+	SNPS3VirtualMemoryArea *Areas = (SNPS3VirtualMemoryArea *)&buf[0];
+
+	if (!check(TMAPI(SNPS3GetVirtualMemoryInfo)(TargetID, pid, true, &AreaCount, &BufSize, (byte *)Areas)))
+		return false;
+
+	for (uint32 i = 0; i < AreaCount; i++)
+	{
+		target_memory_area_t a;
+
+		a.base = Areas[i].uAddress;
+		a.size = Areas[i].uVSize;
+		areas->push_back(a);
+	}
+
+	return true;
+}
+
+//--------------------------------------------------------------------------
+bool tmapi_backend_t::get_modules(std::vector<uint32> *ids)
+{
+	uint32 NumModules = 0;
+
+	if (!check(TMAPI(SNPS3GetModuleList)(TargetID, pid, &NumModules, NULL)))
+		return false;
+
+	ids->resize(NumModules);
+
+	if (NumModules == 0)
+		return true;
+
+	if (!check(TMAPI(SNPS3GetModuleList)(TargetID, pid, &NumModules, &(*ids)[0])))
+	{
+		ids->clear();
+		return false;
+	}
+
+	ids->resize(NumModules);
+	return true;
+}
+
+bool tmapi_backend_t::get_module_info(uint32 id, target_module_t *info)
+{
+	uint64 buf[1024 / sizeof(uint64)];
+	uint64 ModuleInfoSize = sizeof(buf);
+	SNPS3MODULEINFO *ModuleInfo = (SNPS3MODULEINFO *)buf;
+
+	if (!check(TMAPI(SNPS3GetModuleInfo)(TargetID, pid, id, &ModuleInfoSize, ModuleInfo)))
+		return false;
+
+	char name[MAXSTR];
+	qsnprintf(name, sizeof(name), "%s - %s", ModuleInfo->Hdr.aElfName, ModuleInfo->Hdr.aName);
+
+	info->id = id;
+	info->name = name;
+	info->segments.resize(ModuleInfo->Hdr.uNumSegments);
+
+	for (uint32 i = 0; i < ModuleInfo->Hdr.uNumSegments; i++)
+	{
+		target_segment_t &s = info->segments[i];
+
+		s.base = ModuleInfo->Segments[i].uBase;
+		s.file_size = ModuleInfo->Segments[i].uFileSize;
+		s.mem_size = ModuleInfo->Segments[i].uMemSize;
+		s.elf_type = ModuleInfo->Segments[i].uElfType;
+	}
+
+	return true;
+}
@@ -0,0 +1,127 @@
+// Copyright (C) 2014 oct0xor
+//
+// This program is free software : you can redistribute it and / or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the
+// GNU General Public License 2.0 for more details.
+//
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http ://www.gnu.org/licenses/
+
+
+#include "tmstats.h"
+
+tmapi_stats_t tmapi_stats;
+
+//--------------------------------------------------------------------------
+int latency_histogram_t::bucket(uint64 us)
+{
+	if (us < LATENCY_SUB_BUCKETS)
+		return int(us);
+
+	int msb = 0;
+	while ((us >> msb) > 1)
+		msb++;
+
+	// top bits below the leading one select the sub-bucket
+	int sub = int(us >> (msb - 2)) & (LATENCY_SUB_BUCKETS - 1);
+	int b = (msb - 1) * LATENCY_SUB_BUCKETS + sub;
+
+	return qmin(b, LATENCY_BUCKETS - 1);
+}
+
+uint64 latency_histogram_t::bucket_limit(int b)
+{
+	if (b < LATENCY_SUB_BUCKETS)
+		return uint64(b);
+
+	int msb = b / LATENCY_SUB_BUCKETS + 1;
+	int sub = b % LATENCY_SUB_BUCKETS;
+
+	return ((uint64(LATENCY_SUB_BUCKETS + sub + 1)) << (msb - 2)) - 1;
+}
+
+uint64 latency_histogram_t::percentile(double q, uint64 total) const
+{
+	uint64 want = uint64(q * total + 0.5);
+	uint64 seen = 0;
+
+	if (want == 0)
+		want = 1;
+
+	for (int b = 0; b < LATENCY_BUCKETS; b++)
+	{
+		seen += counts[b];
+
+		if (seen >= want)
+			return bucket_limit(b);
+	}
+
+	return 0;
+}
+
+//--------------------------------------------------------------------------
+void tmapi_stats_t::record(const char *name, uint32 bytes, uint64 ns)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	api_stats_t &api = apis[name];
+
+	api.calls++;
+	api.bytes += bytes;
+	api.total_ns += ns;
+	api.max_ns = qmax(api.max_ns, ns);
+	api.hist.add(ns / 1000);
+}
+
+void tmapi_stats_t::record_kicks(uint32 count)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	kicks += count;
+}
+
+void tmapi_stats_t::reset(void)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	apis.clear();
+	kicks = 0;
+}
+
+uint64 tmapi_stats_t::get_kicks(void)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	return kicks;
+}
+
+void tmapi_stats_t::get(std::vector<tmapi_stat_record_t> *out)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	out->clear();
+	out->reserve(apis.size());
+
+	for (std::map<std::string, api_stats_t>::const_iterator it = apis.begin(); it != apis.end(); ++it)
+	{
+		const api_stats_t &api = it->second;
+		tmapi_stat_record_t r;
+
+		memset(&r, 0, sizeof(r));
+		qstrncpy(r.name, it->first.c_str(), sizeof(r.name));
+		r.calls = api.calls;
+		r.bytes = api.bytes;
+		r.total_us = api.total_ns / 1000;
+		r.max_us = api.max_ns / 1000;
+		r.p50_us = uint32(api.hist.percentile(0.50, api.calls));
+		r.p90_us = uint32(api.hist.percentile(0.90, api.calls));
+		r.p99_us = uint32(api.hist.percentile(0.99, api.calls));
+
+		out->push_back(r);
+	}
+}
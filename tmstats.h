@@ -0,0 +1,107 @@
+#ifndef __TMSTATS__
+#define __TMSTATS__
+
+//
+//      Call counts, transfer sizes and latency histograms of the
+//      Target Manager API, per function. The SNPS3Kick polls of the event
+//      pump aren't requests, they are only counted.
+//
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <pro.h>
+#include "evtrace.h"
+
+// Latencies are counted in buckets of microseconds, 4 per power of two
+// (HDR histogram style, within 25% of the real value) up to ~2^40 us
+#define LATENCY_SUB_BUCKETS 4
+#define LATENCY_BUCKETS (40 * LATENCY_SUB_BUCKETS)
+
+struct latency_histogram_t
+{
+	uint32 counts[LATENCY_BUCKETS];
+
+	latency_histogram_t() { clear(); }
+	void clear(void) { memset(counts, 0, sizeof(counts)); }
+	void add(uint64 us) { counts[bucket(us)]++; }
+
+	// Upper bound of the bucket holding the 'q' quantile (0..1) of 'total' samples
+	uint64 percentile(double q, uint64 total) const;
+
+	static int bucket(uint64 us);
+	static uint64 bucket_limit(int b);
+};
+
+struct api_stats_t
+{
+	uint64 calls;
+	uint64 bytes;
+	uint64 total_ns;
+	uint64 max_ns;
+	latency_histogram_t hist;
+
+	api_stats_t() : calls(0), bytes(0), total_ns(0), max_ns(0) {}
+};
+
+// Records returned by DECI3_IOCTL_GET_TMAPI_STATS
+#pragma pack(push, 1)
+struct tmapi_stat_record_t
+{
+	char name[48];
+	uint64 calls;
+	uint64 bytes;
+	uint64 total_us;
+	uint64 max_us;
+	uint32 p50_us;
+	uint32 p90_us;
+	uint32 p99_us;
+	uint32 reserved;
+};
+#pragma pack(pop)
+
+// send_ioctl codes
+#define DECI3_IOCTL_GET_TMAPI_STATS   0x100     // out: array of tmapi_stat_record_t
+#define DECI3_IOCTL_RESET_TMAPI_STATS 0x101
+
+class tmapi_stats_t
+{
+	std::mutex lock;
+	std::map<std::string, api_stats_t> apis;
+	uint64 kicks;
+
+public:
+	tmapi_stats_t() : kicks(0) {}
+
+	void record(const char *name, uint32 bytes, uint64 ns);
+	void record_kicks(uint32 count);
+	void reset(void);
+
+	// SNPS3Kick calls made by the event pump
+	uint64 get_kicks(void);
+
+	// One record per function called so far, sorted by name
+	void get(std::vector<tmapi_stat_record_t> *out);
+};
+
+extern tmapi_stats_t tmapi_stats;
+
+// Times one call, see TMAPI()
+class tmapi_probe_t
+{
+	const char *name;
+	uint32 bytes;
+	uint64 start;
+
+public:
+	tmapi_probe_t(const char *_name, uint32 _bytes) : name(_name), bytes(_bytes), start(host_clock()) {}
+	~tmapi_probe_t() { tmapi_stats.record(name, bytes, host_clock() - start); }
+};
+
+// Instrumented TMAPI call: TMAPI(SNPS3Foo)(args) or TMAPI_IO(SNPS3Foo, bytes)(args).
+// The probe is a temporary, it is destroyed once the call has returned.
+#define TMAPI(fn) (tmapi_probe_t(#fn, 0), fn)
+#define TMAPI_IO(fn, bytes) (tmapi_probe_t(#fn, uint32(bytes)), fn)
+
+#endif